@@ -0,0 +1,226 @@
+/**
+ * @file ByteSource.h
+ * @brief Abstract random-access input for PE files and its backends.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef BYTESOURCE_H
+#define BYTESOURCE_H
+
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+namespace PeLib
+{
+	/**
+	 * Read-only view of a range of bytes owned by someone else, e.g. a byte source or a buffer.
+	 */
+	struct ByteSpan
+	{
+		const unsigned char* data = nullptr;
+		std::size_t size = 0;
+
+		ByteSpan() = default;
+		ByteSpan(const unsigned char* spanData, std::size_t spanSize) : data(spanData), size(spanSize) {}
+
+		const unsigned char* begin() const { return data; }
+		const unsigned char* end() const { return data + size; }
+		bool empty() const { return size == 0; }
+		unsigned char operator[](std::size_t pos) const { return data[pos]; }
+	};
+
+	/**
+	 * Random-access source of the bytes of a PE file. Backends which keep the whole
+	 * file in memory (mapped files, caller-owned buffers) expose it through data(),
+	 * so readers can decode structures in place instead of copying them out.
+	 */
+	class ByteSource
+	{
+		public:
+		  virtual ~ByteSource();
+
+		  /// Returns the total number of bytes available in the source.
+		  virtual std::uint64_t size() const = 0;
+		  /// Copies up to ulLength bytes starting at ulOffset, returns the number of bytes copied.
+		  virtual std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const = 0;
+		  /// Returns pointer to the contiguous contents of the source or nullptr if there is none.
+		  virtual const unsigned char* data() const;
+
+		  /// Checks whether the byte range [ulOffset, ulOffset + ulLength) lies within the source.
+		  bool contains(std::uint64_t ulOffset, std::uint64_t ulLength) const;
+		  /// Makes a range available in memory, without copying it if the source is contiguous.
+		  const unsigned char* readRange(std::uint64_t ulOffset, std::size_t uiSize, std::vector<unsigned char>& vBuffer) const;
+	};
+
+	/**
+	 * Source over a memory span owned by the caller. The memory must outlive the source.
+	 */
+	class MemoryByteSource : public ByteSource
+	{
+		private:
+		  const unsigned char* m_data;
+		  std::size_t m_size;
+
+		public:
+		  MemoryByteSource(const unsigned char* data, std::size_t size);
+		  explicit MemoryByteSource(const std::vector<unsigned char>& vBuffer);
+
+		  std::uint64_t size() const override;
+		  std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const override;
+		  const unsigned char* data() const override;
+	};
+
+	/**
+	 * Source which maps a whole file into memory. If the file cannot be mapped
+	 * (e.g. because it is empty), the source behaves as an empty one.
+	 */
+	class MappedFileByteSource : public ByteSource
+	{
+		private:
+		  const unsigned char* m_data;
+		  std::size_t m_size;
+		  bool m_isOpen;
+#ifdef _WIN32
+		  void* m_hFile;
+		  void* m_hMapping;
+#endif
+
+		public:
+		  explicit MappedFileByteSource(const std::string& strFilename);
+		  ~MappedFileByteSource() override;
+
+		  MappedFileByteSource(const MappedFileByteSource&) = delete;
+		  MappedFileByteSource& operator=(const MappedFileByteSource&) = delete;
+
+		  /// Returns true if the file was successfully opened.
+		  bool isOpen() const;
+
+		  std::uint64_t size() const override;
+		  std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const override;
+		  const unsigned char* data() const override;
+	};
+
+	/**
+	 * Source which reads from a file descriptor with positional reads, so it never
+	 * moves the file pointer of the descriptor.
+	 */
+	class FileDescriptorByteSource : public ByteSource
+	{
+		private:
+		  int m_fd;
+		  bool m_ownsDescriptor;
+		  std::uint64_t m_size;
+
+		public:
+		  FileDescriptorByteSource(int fd, bool ownsDescriptor = false);
+		  ~FileDescriptorByteSource() override;
+
+		  FileDescriptorByteSource(const FileDescriptorByteSource&) = delete;
+		  FileDescriptorByteSource& operator=(const FileDescriptorByteSource&) = delete;
+
+		  std::uint64_t size() const override;
+		  std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const override;
+	};
+
+	/**
+	 * Source over an existing input stream. The stream position and state are preserved.
+	 */
+	class StreamByteSource : public ByteSource
+	{
+		private:
+		  std::istream& m_stream;
+		  std::uint64_t m_size;
+
+		public:
+		  explicit StreamByteSource(std::istream& stream);
+
+		  std::uint64_t size() const override;
+		  std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const override;
+	};
+
+	/**
+	 * Source which serves reads of an underlying source from ranges read ahead of time.
+	 * Prefetching merges nearby ranges and reads them in ascending offset order, so
+	 * a number of scattered reads turns into a few sequential ones. Reads outside of
+	 * the prefetched ranges are passed to the underlying source one at a time, so once
+	 * prefetched, the source can be read from several threads.
+	 */
+	class PrefetchByteSource : public ByteSource
+	{
+		private:
+		  struct Extent
+		  {
+			  std::uint64_t offset;
+			  std::vector<unsigned char> data;
+		  };
+
+		  const ByteSource& m_source;
+		  std::vector<Extent> m_extents; ///< Prefetched ranges, sorted by offset and disjoint.
+		  mutable std::mutex m_sourceMutex; ///< Serializes reads of the underlying source.
+
+		public:
+		  explicit PrefetchByteSource(const ByteSource& source);
+
+		  /// Reads the (offset, length) ranges ahead, ranges at most ulMaxGap bytes apart are read at once.
+		  /// No more than ulMaxSize bytes are read ahead in total.
+		  void prefetch(std::vector<std::pair<std::uint64_t, std::uint64_t>> vRanges, std::uint64_t ulMaxGap, std::uint64_t ulMaxSize);
+
+		  std::uint64_t size() const override;
+		  std::size_t read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const override;
+	};
+
+	/**
+	 * Read-only stream buffer on top of a ByteSource. Contiguous sources are exposed
+	 * directly as the get area, so seeking and reading never copy the file contents
+	 * into intermediate buffers. Other sources are read through a small window.
+	 */
+	class ByteSourceStreamBuf : public std::streambuf
+	{
+		private:
+		  const ByteSource& m_source;
+		  std::vector<char> m_window;
+		  std::uint64_t m_windowOffset; ///< File offset which corresponds to eback().
+
+		  std::uint64_t position() const;
+		  pos_type seekTo(std::uint64_t ulPosition);
+
+		public:
+		  explicit ByteSourceStreamBuf(const ByteSource& source);
+
+		  /// Returns the byte source the buffer reads from.
+		  const ByteSource& source() const;
+
+		protected:
+		  int_type underflow() override;
+		  std::streamsize xsgetn(char_type* s, std::streamsize n) override;
+		  std::streamsize showmanyc() override;
+		  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override;
+		  pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override;
+	};
+
+	/**
+	 * Input stream which reads from a ByteSource. Allows the existing stream based
+	 * readers to consume any byte source.
+	 */
+	class ByteSourceStream : public std::istream
+	{
+		private:
+		  ByteSourceStreamBuf m_streamBuf;
+
+		public:
+		  explicit ByteSourceStream(const ByteSource& source);
+	};
+
+	/// Returns the contents of the byte source behind the stream if it is contiguous in memory.
+	const ByteSource* getContiguousByteSource(std::istream& stream);
+	/// Makes a range of the stream available in memory, without copying it if possible.
+	/// The range is cut at the end of the stream and uiSize receives its remaining size.
+	const unsigned char* readStreamRange(std::istream& stream, std::uint64_t ulOffset, std::size_t& uiSize, std::vector<unsigned char>& vBuffer);
+}
+
+#endif
@@ -23,6 +23,8 @@ namespace PeLib
 
 		private:
 			std::vector<PELIB_IMAGE_DELAY_IMPORT_DIRECTORY_RECORD<bits> > records;
+			/// Pool the names of files and functions are interned in when read, if any.
+			StringPool* m_stringPool;
 
 			void init()
 			{
@@ -30,7 +32,7 @@ namespace PeLib
 			}
 
 		public:
-			DelayImportDirectory()
+			DelayImportDirectory() : m_stringPool(nullptr)
 			{
 				init();
 			}
@@ -134,7 +136,12 @@ namespace PeLib
 					rec.DelayImportNameTableOffset = (dword)peHeader.rvaToOffset(rec.DelayImportNameTableRva);
 
 					// Get name of library
-					getStringFromFileOffset(inStream_w, rec.Name, (std::size_t)peHeader.rvaToOffset(rec.NameRva), IMPORT_LIBRARY_MAX_LENGTH);
+					std::string strName;
+					getStringFromFileOffset(inStream_w, strName, (std::size_t)peHeader.rvaToOffset(rec.NameRva), IMPORT_LIBRARY_MAX_LENGTH);
+					if (m_stringPool)
+						rec.PooledName = m_stringPool->intern(strName);
+					else
+						rec.Name = std::move(strName);
 
 					//
 					//  LOADING NAME ADDRESSES/NAME ORDINALS
@@ -224,7 +231,12 @@ namespace PeLib
 								break;
 
 							// Read the function name
-							getStringFromFileOffset(inStream_w, function.fname, inStream_w.tellg(), IMPORT_SYMBOL_MAX_LENGTH);
+							std::string strFuncname;
+							getStringFromFileOffset(inStream_w, strFuncname, inStream_w.tellg(), IMPORT_SYMBOL_MAX_LENGTH);
+							if (m_stringPool)
+								function.pooledFname = m_stringPool->intern(strFuncname);
+							else
+								function.fname = std::move(strFuncname);
 						}
 						else
 						{
@@ -246,6 +258,18 @@ namespace PeLib
 				return ERROR_NONE;
 			}
 
+			/// Interns the names read by later calls of read in the pool, which must outlive the directory.
+			/// The names are then kept in PooledName and pooledFname instead of Name and fname.
+			void setStringPool(StringPool* pool)
+			{
+				m_stringPool = pool;
+			}
+
+			StringPool* getStringPool() const
+			{
+				return m_stringPool;
+			}
+
 			std::size_t getNumberOfFiles() const
 			{
 				return records.size();
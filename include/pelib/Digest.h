@@ -0,0 +1,70 @@
+/**
+ * @file Digest.h
+ * @brief MD5 and SHA-256 message digests.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace PeLib
+{
+	/**
+	 * Incremental MD5 digest (RFC 1321).
+	 */
+	class Md5
+	{
+		public:
+		  static const std::size_t DIGEST_SIZE = 16;
+		  typedef std::array<unsigned char, DIGEST_SIZE> Digest;
+
+		private:
+		  std::uint32_t m_state[4];
+		  std::uint64_t m_length; ///< Number of bytes hashed so far.
+		  unsigned char m_block[64];
+
+		  void transform(const unsigned char* block);
+
+		public:
+		  Md5();
+
+		  /// Hashes the next part of the message.
+		  void update(const void* data, std::size_t size);
+		  /// Finishes the message and returns its digest. The object must not be updated afterwards.
+		  Digest digest();
+	};
+
+	/**
+	 * Incremental SHA-256 digest (FIPS 180-4).
+	 */
+	class Sha256
+	{
+		public:
+		  static const std::size_t DIGEST_SIZE = 32;
+		  typedef std::array<unsigned char, DIGEST_SIZE> Digest;
+
+		private:
+		  std::uint32_t m_state[8];
+		  std::uint64_t m_length; ///< Number of bytes hashed so far.
+		  unsigned char m_block[64];
+
+		  void transform(const unsigned char* block);
+
+		public:
+		  Sha256();
+
+		  /// Hashes the next part of the message.
+		  void update(const void* data, std::size_t size);
+		  /// Finishes the message and returns its digest. The object must not be updated afterwards.
+		  Digest digest();
+	};
+
+	/// Formats bytes as a string of lower case hexadecimal digits.
+	std::string toHexString(const unsigned char* data, std::size_t size);
+}
+
+#endif
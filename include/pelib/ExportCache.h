@@ -0,0 +1,193 @@
+/**
+ * @file ExportCache.h
+ * @brief Cache of the export tables of DLLs for resolving forwarders and binding imports.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef EXPORT_CACHE_H
+#define EXPORT_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pelib/PeFile.h"
+
+namespace PeLib
+{
+	/**
+	 * Exports of a DLL in the form needed to look functions up, immutable once read.
+	 * Functions are identified by their index, which is the ordinal minus the base.
+	 */
+	class ExportTable
+	{
+		private:
+		  struct Function
+		  {
+			  dword rva = 0;
+			  bool forwarded = false; ///< The RVA points into the export directory, at the forwarder string.
+			  std::string forwarder; ///< "DLL.Function" or "DLL.#Ordinal" if the function is forwarded.
+		  };
+
+		  std::string m_name;
+		  dword m_base = 0;
+		  std::vector<Function> m_functions;
+		  /// Names and indexes of the named functions in the order of the name table, which a valid file sorts by name.
+		  /// A function with aliases has several names.
+		  std::vector<std::pair<std::string, unsigned int>> m_names;
+		  /// Positions in m_names sorted by name, empty if the name table is sorted already.
+		  std::vector<unsigned int> m_sortedNames;
+
+		  template<int bits> int read(PeFileT<bits>& file, const ByteSource& source);
+
+		public:
+		  /// Reads the exports of a file.
+		  int read(const std::string& strFilename);
+
+		  /// Returns the name of the DLL from its export directory.
+		  const std::string& getName() const;
+		  /// Returns the ordinal of the first function.
+		  dword getBase() const;
+		  /// Returns the number of functions.
+		  std::size_t getNumberOfFunctions() const;
+		  /// Returns the index of the function with the given ordinal, -1 if there is none or its RVA is 0.
+		  int getFunctionIndex(dword dwOrdinal) const;
+		  /// Returns the index of the function with the given name, -1 if there is none.
+		  int getFunctionIndex(const std::string& strFuncname, int iHint = -1) const;
+		  /// Returns the RVA of a function, the RVA of the forwarder string if it is forwarded.
+		  dword getFunctionRva(std::size_t index) const;
+		  /// Returns whether a function is forwarded to another DLL.
+		  bool isForwarded(std::size_t index) const;
+		  /// Returns the forwarder string of a function, empty if it is not forwarded.
+		  const std::string& getForwarder(std::size_t index) const;
+	};
+
+	/**
+	 * Function which an export resolves to after following its forwarders.
+	 */
+	struct ResolvedExport
+	{
+		/// ERROR_NONE, ERROR_OPENING_FILE if a DLL cannot be read, ERROR_ENTRY_NOT_FOUND if a DLL
+		/// does not export the function or ERROR_FORWARDER_CYCLE if the forwarders form a cycle.
+		int result = ERROR_ENTRY_NOT_FOUND;
+		std::string dllName; ///< File which implements the function, or the last one looked at on failure.
+		dword ordinal = 0; ///< Ordinal of the function, 0 on failure.
+		dword rva = 0; ///< RVA of the function, 0 on failure.
+		unsigned int forwards = 0; ///< Number of forwarders followed.
+	};
+
+	/**
+	 * Imported function bound to the function which implements it.
+	 */
+	struct BoundImport
+	{
+		unsigned int fileIndex = 0;
+		unsigned int functionIndex = 0;
+		ResolvedExport target;
+	};
+
+	/**
+	 * Thread-safe cache of the export tables of the DLLs in a directory, which stands in for
+	 * the system directory. Every DLL is parsed once and parsed again only if its size or
+	 * modification time changes. The tables are shared between the threads and never modified.
+	 */
+	class ExportCache
+	{
+		private:
+		  /// Size and modification time of a file.
+		  struct FileIdentity
+		  {
+			  std::uint64_t size = 0;
+			  std::int64_t modificationTime = 0;
+
+			  bool operator==(const FileIdentity& other) const;
+		  };
+
+		  struct Entry
+		  {
+			  FileIdentity identity;
+			  std::shared_ptr<const ExportTable> table; ///< Null if the file has no valid exports.
+		  };
+
+		  /// Upper case DLL name -> its exports, so that one resolution or binding checks every file only once.
+		  typedef std::unordered_map<std::string, std::shared_ptr<const ExportTable>> TableSnapshot;
+
+		  static const unsigned int MAX_FORWARDS = 32;
+
+		  std::string m_directory;
+		  mutable std::mutex m_mutex;
+		  std::unordered_map<std::string, Entry> m_tables; ///< Path of the file -> its exports.
+		  std::unordered_map<std::string, std::string> m_fileNames; ///< Upper case file name -> file name in the directory.
+		  std::int64_t m_directoryTime = 0; ///< Modification time of the directory when m_fileNames was listed.
+		  std::int64_t m_listingTime = 0; ///< Time when m_fileNames was listed, 0 if it was not listed yet.
+
+		  std::string findFile(const std::string& strDllName);
+		  static bool getFileIdentity(const std::string& strPath, FileIdentity& identity);
+		  const ExportTable* getExportTable(const std::string& strDllName, TableSnapshot& tables);
+		  ResolvedExport resolveExport(std::string strDllName, bool bByOrdinal, std::string strFuncname, dword dwOrdinal, int iHint, TableSnapshot& tables);
+
+		public:
+		  /// Creates a cache of the DLLs in a directory.
+		  explicit ExportCache(const std::string& strDirectory);
+		  ExportCache(const ExportCache&) = delete;
+		  ExportCache& operator=(const ExportCache&) = delete;
+
+		  /// Returns the exports of a DLL in the directory, nullptr if it cannot be read.
+		  std::shared_ptr<const ExportTable> getExportTable(const std::string& strDllName);
+		  /// Resolves a function exported by name, following its forwarders.
+		  ResolvedExport resolve(const std::string& strDllName, const std::string& strFuncname, int iHint = -1);
+		  /// Resolves a function exported by ordinal, following its forwarders.
+		  ResolvedExport resolve(const std::string& strDllName, dword dwOrdinal);
+		  /// Binds the imported functions to the functions which implement them.
+		  template<int bits> std::vector<BoundImport> bind(const ImportDirectory<bits>& impDir, currdir cdDir = OLDDIR);
+
+		  /// Drops all the cached tables.
+		  void clear();
+		  /// Returns the number of cached files.
+		  std::size_t size() const;
+	};
+
+	/**
+	* Resolves every imported function of an import directory. Functions imported by name
+	* use their hint as the index into the name table of the DLL before searching it.
+	* @param impDir Import directory.
+	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
+	* @return Bound function for every imported function, in the order of the import directory.
+	**/
+	template<int bits>
+	std::vector<BoundImport> ExportCache::bind(const ImportDirectory<bits>& impDir, currdir cdDir)
+	{
+		std::vector<BoundImport> vBound;
+		TableSnapshot tables;
+		for (unsigned int i = 0; i < impDir.getNumberOfFiles(cdDir); i++)
+		{
+			std::string strDllName = impDir.getFileName(i, cdDir);
+			for (unsigned int j = 0; j < impDir.getNumberOfFunctions(i, cdDir); j++)
+			{
+				BoundImport bound;
+				bound.fileIndex = i;
+				bound.functionIndex = j;
+
+				auto thunk = impDir.getFunctionThunk(i, j, cdDir);
+				if (thunk & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG)
+				{
+					bound.target = resolveExport(strDllName, true, "", static_cast<dword>(thunk & 0xFFFF), -1, tables);
+				}
+				else
+				{
+					bound.target = resolveExport(strDllName, false, impDir.getFunctionName(i, j, cdDir), 0, impDir.getFunctionHint(i, j, cdDir), tables);
+				}
+
+				vBound.push_back(std::move(bound));
+			}
+		}
+
+		return vBound;
+	}
+}
+
+#endif
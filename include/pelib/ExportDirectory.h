@@ -13,6 +13,11 @@
 #ifndef EXPORTDIRECTORY_H
 #define EXPORTDIRECTORY_H
 
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "pelib/PeHeader.h"
 
 namespace PeLib
@@ -24,11 +29,52 @@ namespace PeLib
 	**/
 	class ExportDirectory
 	{
+		private:
+		  /// Index of the function names, built on the first lookup by name.
+		  struct NameIndex
+		  {
+			  bool valid = false;
+			  /// True if byName is sorted by the case-insensitive names, so it can be searched.
+			  bool sorted = false;
+			  /// Indexes of the named functions.
+			  std::vector<unsigned int> byName;
+			  /// Upper case name -> lowest index of a function with that name, used if byName is not sorted.
+			  std::unordered_map<std::string, unsigned int> hashed;
+			  /// Lowest index of a function without a name, -1 if all functions have names.
+			  int unnamed = -1;
+		  };
+
+		  /// Mutex which keeps the directory copyable, every copy has its own one.
+		  struct NameIndexMutex
+		  {
+			  std::mutex mutex;
+
+			  NameIndexMutex() {}
+			  NameIndexMutex(const NameIndexMutex&) {}
+			  NameIndexMutex& operator=(const NameIndexMutex&) { return *this; }
+		  };
+
+		  mutable NameIndex m_nameIndex;
+		  mutable NameIndexMutex m_nameIndexMutex;
+
+		  /// Returns the index of the function names, builds it if necessary.
+		  const NameIndex& nameIndex() const;
+
 		protected:
 		  /// Used to store all necessary information about a file's exported functions.
 		  PELIB_IMAGE_EXP_DIRECTORY m_ied;
 		  /// Stores RVAs which are occupied by this export directory.
 		  std::vector<std::pair<unsigned int, unsigned int>> m_occupiedAddresses;
+		  /// Pool the names of functions are interned in when read, if any.
+		  StringPool* m_stringPool = nullptr;
+		  /// Indexes of the named functions in the order of the name table they were read from.
+		  /// Empty once the functions were modified.
+		  std::vector<unsigned int> m_nameOrder;
+
+		  /// Drops the index of the function names after the functions were modified.
+		  void invalidateNameIndex();
+		  /// Makes a zero terminated name available in memory, without copying it if possible.
+		  static const char* readName(const ByteSource& source, std::uint64_t ulOffset, std::vector<unsigned char>& vBuffer, std::size_t& uiLength);
 
 		public:
 		  virtual ~ExportDirectory() = default;
@@ -39,6 +85,8 @@ namespace PeLib
 		  void clear(); // EXPORT
 		  /// Identifies a function through it's name.
 		  int getFunctionIndex(const std::string& strFunctionName) const; // EXPORT
+		  /// Identifies a function through it's ordinal.
+		  int getFunctionIndexByOrdinal(word wOrdinal) const; // EXPORT
 		  /// Rebuild the current export directory.
 		  void rebuild(std::vector<byte>& vBuffer, dword dwRva) const; // EXPORT
 		  void removeFunction(unsigned int index); // EXPORT
@@ -132,6 +180,11 @@ namespace PeLib
 		  void setAddressOfNameOrdinals(dword value); // EXPORT
 
 		  const std::vector<std::pair<unsigned int, unsigned int>>& getOccupiedAddresses() const;
+
+		  /// Interns the function names read by later calls of read in the pool, which must outlive the directory.
+		  void setStringPool(StringPool* pool); // EXPORT
+		  /// Returns the pool the function names are interned in, if any.
+		  StringPool* getStringPool() const; // EXPORT
 	};
 
 	template <int bits>
@@ -192,35 +245,51 @@ namespace PeLib
 		if (iedCurr.ied.NumberOfFunctions > PELIB_MAX_EXPORTED_FUNCTIONS || iedCurr.ied.NumberOfNames > PELIB_MAX_EXPORTED_FUNCTIONS)
 			return ERROR_INVALID_FILE;
 
+		// The arrays and the names are decoded from the file contents in memory
+		std::unique_ptr<ByteSource> streamSource;
+		const ByteSource* source = getContiguousByteSource(inStream_w);
+		if (source == nullptr)
+		{
+			inStream_w.clear();
+			streamSource.reset(new StreamByteSource(inStream_w));
+			source = streamSource.get();
+		}
+		std::vector<unsigned char> vNameBuffer;
+		std::size_t uiNameLength = 0;
+
 		unsigned int offset = peHeader.rvaToOffset(iedCurr.ied.Name);
 		if (offset >= ulFileSize)
 			return ERROR_INVALID_FILE;
-		inStream_w.seekg(offset, std::ios::beg);
+		const char* name = readName(*source, offset, vNameBuffer, uiNameLength);
+		if (name == nullptr)
+			return ERROR_INVALID_FILE;
+		iedCurr.name.assign(name, uiNameLength);
+		m_occupiedAddresses.push_back(std::make_pair(iedCurr.ied.Name, iedCurr.ied.Name + iedCurr.name.length() + 1));
 
-		char c = 0;
-		std::string strFname = "";
-		do
+		// Each of the three arrays is read as one block. Entries are valid as long as they
+		// lie completely within the file, the directory is rejected at the first one which does not.
+		auto readArray = [&](unsigned int uiArrayOffset, std::size_t uiCount, std::size_t uiEntrySize, std::vector<unsigned char>& vBuffer, std::size_t& uiValid)
 		{
-			inStream_w.read(reinterpret_cast<char*>(&c), sizeof(c));
-			if (!inStream_w) return ERROR_INVALID_FILE;
-			if (c) strFname += c;
-		}
-		while (c != 0);
-		iedCurr.name = strFname;
-		m_occupiedAddresses.push_back(std::make_pair(iedCurr.ied.Name, iedCurr.ied.Name + strFname.length() + 1));
+			uiValid = (uiArrayOffset < ulFileSize) ? static_cast<std::size_t>(std::min<std::uint64_t>(uiCount, (ulFileSize - uiArrayOffset) / uiEntrySize)) : 0;
+			return source->readRange(uiArrayOffset, uiValid * uiEntrySize, vBuffer);
+		};
+
+		std::vector<unsigned char> vFunctions, vOrdinals, vNames;
+		std::size_t uiValidFunctions, uiValidOrdinals, uiValidNames;
+		unsigned int uiFunctionsOffset = peHeader.rvaToOffset(iedCurr.ied.AddressOfFunctions);
+		unsigned int uiOrdinalsOffset = peHeader.rvaToOffset(iedCurr.ied.AddressOfNameOrdinals);
+		unsigned int uiNamesOffset = peHeader.rvaToOffset(iedCurr.ied.AddressOfNames);
+		const unsigned char* functions = readArray(uiFunctionsOffset, iedCurr.ied.NumberOfFunctions, sizeof(dword), vFunctions, uiValidFunctions);
+		const unsigned char* ordinals = readArray(uiOrdinalsOffset, iedCurr.ied.NumberOfNames, sizeof(word), vOrdinals, uiValidOrdinals);
+		const unsigned char* names = readArray(uiNamesOffset, iedCurr.ied.NumberOfNames, sizeof(dword), vNames, uiValidNames);
 
 		PELIB_EXP_FUNC_INFORMATION efiCurr;
 		efiCurr.ordinal = 0; efiCurr.addroffunc = 0; efiCurr.addrofname = 0;
-		for (unsigned int i=0;i<iedCurr.ied.NumberOfFunctions;i++)
+		iedCurr.functions.reserve(uiValidFunctions);
+		m_occupiedAddresses.reserve(m_occupiedAddresses.size() + uiValidFunctions + 3 * uiValidOrdinals);
+		for (unsigned int i=0;i<uiValidFunctions;i++)
 		{
-			unsigned int offset = peHeader.rvaToOffset(iedCurr.ied.AddressOfFunctions) + i * sizeof(efiCurr.addroffunc);
-			if (offset >= ulFileSize)
-				return ERROR_INVALID_FILE;
-			inStream_w.seekg(offset, std::ios::beg);
-			inStream_w.read(reinterpret_cast<char*>(&efiCurr.addroffunc), sizeof(efiCurr.addroffunc));
-			if (!inStream_w)
-				return ERROR_INVALID_FILE;
-
+			std::memcpy(&efiCurr.addroffunc, functions + i * sizeof(efiCurr.addroffunc), sizeof(efiCurr.addroffunc));
 			efiCurr.ordinal = iedCurr.ied.Base + i;
 			iedCurr.functions.push_back(efiCurr);
 
@@ -230,65 +299,72 @@ namespace PeLib
 				);
 		}
 
+		if (uiValidFunctions < iedCurr.ied.NumberOfFunctions)
+			return ERROR_INVALID_FILE;
+
+		// Translate the RVAs of all names at once, they are mostly sorted
+		typedef typename FieldSizes<bits>::VAR4_8 VAR4_8;
+		std::vector<VAR4_8> vNameRvas(uiValidNames), vNameOffsets(uiValidNames);
+		for (std::size_t i = 0; i < uiValidNames; i++)
+		{
+			dword addrofname;
+			std::memcpy(&addrofname, names + i * sizeof(addrofname), sizeof(addrofname));
+			vNameRvas[i] = addrofname;
+		}
+		peHeader.rvaToOffsets(vNameRvas.data(), uiValidNames, vNameOffsets.data());
+
+		std::vector<unsigned int> vNameOrder;
+		vNameOrder.reserve(uiValidOrdinals);
 		for (unsigned int i=0;i<iedCurr.ied.NumberOfNames;i++)
 		{
-			unsigned int offset = peHeader.rvaToOffset(iedCurr.ied.AddressOfNameOrdinals) + i*sizeof(efiCurr.ordinal);
-			if (offset >= ulFileSize)
+			// An ordinal which starts before the end of the file is still recorded as occupied
+			if (uiOrdinalsOffset + static_cast<std::uint64_t>(i) * sizeof(efiCurr.ordinal) >= ulFileSize)
 				return ERROR_INVALID_FILE;
-			inStream_w.seekg(offset, std::ios::beg);
-			word ordinal;
-			inStream_w.read(reinterpret_cast<char*>(&ordinal), sizeof(ordinal));
 			m_occupiedAddresses.emplace_back(
 					iedCurr.ied.AddressOfNameOrdinals + i*sizeof(efiCurr.ordinal),
 					iedCurr.ied.AddressOfNameOrdinals + i*sizeof(efiCurr.ordinal) + sizeof(efiCurr.ordinal) - 1
 				);
-
-			if (!inStream_w)
+			if (i >= uiValidOrdinals)
 				return ERROR_INVALID_FILE;
-			else if (ordinal >= iedCurr.functions.size())
+
+			word ordinal;
+			std::memcpy(&ordinal, ordinals + i * sizeof(ordinal), sizeof(ordinal));
+			if (ordinal >= iedCurr.functions.size())
 				continue;
 
-			iedCurr.functions[ordinal].ordinal = iedCurr.ied.Base + ordinal;
+			PELIB_EXP_FUNC_INFORMATION& efi = iedCurr.functions[ordinal];
+			efi.ordinal = iedCurr.ied.Base + ordinal;
 
-			offset = peHeader.rvaToOffset(iedCurr.ied.AddressOfNames) + i*sizeof(efiCurr.addrofname);
-			if (offset >= ulFileSize)
-				return ERROR_INVALID_FILE;
-			inStream_w.seekg(offset, std::ios::beg);
-			inStream_w.read(reinterpret_cast<char*>(&iedCurr.functions[ordinal].addrofname), sizeof(iedCurr.functions[ordinal].addrofname));
-			if (!inStream_w)
+			if (i >= uiValidNames)
 				return ERROR_INVALID_FILE;
+			efi.addrofname = static_cast<dword>(vNameRvas[i]);
 			m_occupiedAddresses.emplace_back(
 					iedCurr.ied.AddressOfNames + i*sizeof(efiCurr.addrofname),
-					iedCurr.ied.AddressOfNames + i*sizeof(efiCurr.addrofname) + sizeof(iedCurr.functions[ordinal].addrofname) - 1
+					iedCurr.ied.AddressOfNames + i*sizeof(efiCurr.addrofname) + sizeof(efi.addrofname) - 1
 				);
 
-			offset = peHeader.rvaToOffset(iedCurr.functions[ordinal].addrofname);
+			offset = static_cast<unsigned int>(vNameOffsets[i]);
 			if (offset >= ulFileSize)
 				return ERROR_INVALID_FILE;
-			inStream_w.seekg(offset, std::ios::beg);
-
-			char cc = 0;
-			std::string strFname2 = "";
-			do
-			{
-				inStream_w.read(reinterpret_cast<char*>(&cc), sizeof(cc));
-
-				if (!inStream_w)
-					return ERROR_INVALID_FILE;
-
-				if (cc) strFname2 += cc;
-			}
-			while (cc != 0);
-
-			iedCurr.functions[ordinal].funcname = strFname2;
+			name = readName(*source, offset, vNameBuffer, uiNameLength);
+			if (name == nullptr)
+				return ERROR_INVALID_FILE;
 
 			m_occupiedAddresses.emplace_back(
-					iedCurr.functions[ordinal].addrofname,
-					iedCurr.functions[ordinal].addrofname + strFname2.length() + 1
+					efi.addrofname,
+					efi.addrofname + uiNameLength + 1
 				);
+
+			if (m_stringPool)
+				efi.pooledFuncname = m_stringPool->intern(name, uiNameLength);
+			else
+				efi.funcname.assign(name, uiNameLength);
+			vNameOrder.push_back(ordinal);
 		}
 
 		std::swap(m_ied, iedCurr);
+		invalidateNameIndex();
+		m_nameOrder = std::move(vNameOrder);
 
 		return ERROR_NONE;
 	}
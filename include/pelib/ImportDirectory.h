@@ -13,14 +13,23 @@
 #ifndef IMPORTDIRECTORY_H
 #define IMPORTDIRECTORY_H
 
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
+
 #include "pelib/PeLibAux.h"
 #include "pelib/PeHeader.h"
+#include "pelib/Digest.h"
+#include "pelib/OrdinalNames.h"
 
 namespace PeLib
 {
 	/// Parameter for functions that can operate on the OLDDIR or new import directory.
 	enum currdir {OLDDIR = 1, NEWDIR};
 
+	/// Digest algorithm of import hashes.
+	enum ImportHashType {IMPORT_HASH_MD5, IMPORT_HASH_SHA256};
+
 	class PeLibException;
 
 	/// Class that handles import directories.
@@ -42,8 +51,43 @@ namespace PeLib
 		typedef typename std::vector<PELIB_IMAGE_IMPORT_DIRECTORY<bits> >::const_iterator ConstImpDirFileIterator;
 
 		private:
+		  /// Imports read from a file, stored as a structure of arrays.
+		  /**
+		  * The thunks of all the imported files are kept in one array, the OriginalFirstThunks and
+		  * the FirstThunks of every file in a contiguous range. The hints and the offsets of the
+		  * function names are kept in arrays parallel to the thunks and all the names in one blob.
+		  **/
+		  struct FlatDirectory
+		  {
+			  struct File
+			  {
+				  PELIB_IMAGE_IMPORT_DESCRIPTOR impdesc;
+				  std::uint32_t nameOffset; ///< Offset of the name of the file in names.
+				  std::uint32_t firstOft; ///< Index of the first OriginalFirstThunk in thunks.
+				  std::uint32_t numberOfOft;
+				  std::uint32_t firstFt; ///< Index of the first FirstThunk in thunks.
+				  std::uint32_t numberOfFt;
+			  };
+
+			  std::vector<File> files;
+			  std::vector<VAR4_8> thunks;
+			  std::vector<word> hints; ///< Hints of the thunks.
+			  std::vector<std::uint32_t> nameOffsets; ///< Offsets of the function names of the thunks in names.
+			  /// Zero terminated names of the files and functions, starts with the empty name.
+			  /// Renamed entries get a new name, the old one stays in the blob.
+			  std::string names = std::string(1, '\0');
+
+			  /// Adds a name to the blob and returns its offset.
+			  std::uint32_t addName(const char* data, std::size_t size);
+			  const char* name(std::uint32_t offset) const { return names.c_str() + offset; }
+			  /// Returns the index of the thunk the name and the hint of a function are taken from.
+			  std::size_t functionThunk(const File& file, std::size_t funcnr) const;
+			  /// Appends a file with all its thunks.
+			  void append(const PELIB_IMAGE_IMPORT_DIRECTORY<bits>& iid);
+		  };
+
 		  /// Stores information about already imported DLLs.
-		  std::vector<PELIB_IMAGE_IMPORT_DIRECTORY<bits> > m_vOldiid;
+		  FlatDirectory m_oldDir;
 		  /// Stores information about imported DLLs which will be added.
 		  std::vector<PELIB_IMAGE_IMPORT_DIRECTORY<bits> > m_vNewiid;
 		  /// Stores RVAs which are occupied by this import directory.
@@ -51,46 +95,129 @@ namespace PeLib
 		  /// Error detected by the import table parser
 		  LoaderError m_ldrError;
 
-		// I can't convince Borland C++ to compile the function outside of the class declaration.
-		// That's why the function definition is here.
-		/// Tests if a certain function is imported.
-		template<typename T> bool hasFunction(std::string strFilename, T value, bool(PELIB_THUNK_DATA<bits>::* comp)(T) const) const
-		{
-			ConstImpDirFileIterator FileIter = m_vOldiid.begin();
-			ConstImpDirFileIterator EndIter = m_vOldiid.end();
+		  /// Reads the thunks of a thunk array one after another from blocks of the file contents.
+		  /**
+		  * Behaves like reading the thunks from a stream: a thunk which reaches beyond the end
+		  * of the file is read partially and fails the reader, later thunks are not read at all.
+		  **/
+		  class ThunkArrayReader
+		  {
+			  private:
+				const ByteSource& m_source;
+				std::vector<unsigned char> m_vBlock;
+				const unsigned char* m_blockData;
+				std::uint64_t m_ulBlockOffset;
+				std::uint64_t m_ulBlockSize;
+				std::uint64_t m_ulOffset;
+				bool m_failed;
+
+			  public:
+				/// Number of thunks read from the source at once if it is not contiguous.
+				static const std::size_t BLOCK_THUNKS = 64;
+
+				explicit ThunkArrayReader(const ByteSource& source) : m_source(source), m_blockData(nullptr),
+						m_ulBlockOffset(0), m_ulBlockSize(0), m_ulOffset(0), m_failed(false)
+				{
+				}
 
-			for (int i=0;i<=1;i++) // Loop once for m_vOldiid and once for m_vNewiid
-			{
-				do
+				/// Starts reading at the given file offset and clears the failure.
+				void seek(std::uint64_t ulOffset)
 				{
-					FileIter = std::find_if(
-							FileIter,
-							EndIter,
-							[&](const auto& i) { return i == strFilename; }
-					);
+					m_ulOffset = ulOffset;
+					m_failed = false;
+				}
+
+				/// Reads the next thunk. Leaves the bytes of the thunk which are beyond the file untouched.
+				void read(VAR4_8& thunk)
+				{
+					if (m_failed)
+						return;
 
-					if (FileIter != EndIter)
+					if (!m_source.contains(m_ulOffset, sizeof(thunk)))
 					{
-						auto Iter = std::find_if(
-								FileIter->originalfirstthunk.begin(),
-								FileIter->originalfirstthunk.end(),
-								std::bind(comp, std::placeholders::_1, value)
-						);
-						if (Iter != FileIter->originalfirstthunk.end())
-						{
-							return true;
-						}
-						++FileIter;
+						if (m_ulOffset < m_source.size())
+							m_source.read(m_ulOffset, &thunk, static_cast<std::size_t>(m_source.size() - m_ulOffset));
+						m_failed = true;
+						return;
 					}
-				}
-				while (FileIter != EndIter);
 
-				FileIter = m_vNewiid.begin();
-				EndIter = m_vNewiid.end();
-	 		}
+					if (m_ulOffset < m_ulBlockOffset || m_ulOffset + sizeof(thunk) > m_ulBlockOffset + m_ulBlockSize)
+					{
+						m_ulBlockOffset = m_source.data() ? 0 : m_ulOffset;
+						m_ulBlockSize = m_source.data() ? m_source.size() : std::min<std::uint64_t>(BLOCK_THUNKS * sizeof(thunk), m_source.size() - m_ulOffset);
+						m_blockData = m_source.readRange(m_ulBlockOffset, static_cast<std::size_t>(m_ulBlockSize), m_vBlock);
+					}
 
-	 		return false;
-		}
+					std::memcpy(&thunk, m_blockData + (m_ulOffset - m_ulBlockOffset), sizeof(thunk));
+					m_ulOffset += sizeof(thunk);
+				}
+
+				/// Checks whether a thunk reached beyond the end of the file since the last seek.
+				bool failed() const
+				{
+					return m_failed;
+				}
+		  };
+
+		  /// Decodes the hint and the name of an imported function from the file contents.
+		  static bool readHintName(const ByteSource& source, std::uint64_t ulOffset, std::vector<unsigned char>& vBuffer, FlatDirectory& dir, std::size_t uiThunk);
+
+		  /// Index of the files and functions of one import directory, built on the first lookup.
+		  struct LookupIndex
+		  {
+			  struct File
+			  {
+				  /// Upper case function name -> indexes of the functions as returned by getFunctionName.
+				  std::unordered_map<std::string, std::vector<unsigned int>> functions;
+				  /// Upper case names of the OriginalFirstThunk entries.
+				  std::unordered_set<std::string> thunkNames;
+				  /// Hints of the OriginalFirstThunk entries.
+				  std::unordered_set<word> thunkHints;
+			  };
+
+			  bool valid = false;
+			  /// Upper case file name -> indexes of the files with that name.
+			  std::unordered_map<std::string, std::vector<unsigned int>> fileIndexes;
+			  std::vector<File> files;
+		  };
+
+		  /// Mutex which keeps the directory copyable, every copy has its own one.
+		  struct LookupMutex
+		  {
+			  std::mutex mutex;
+
+			  LookupMutex() {}
+			  LookupMutex(const LookupMutex&) {}
+			  LookupMutex& operator=(const LookupMutex&) { return *this; }
+		  };
+
+		  mutable LookupIndex m_oldLookup;
+		  mutable LookupIndex m_newLookup;
+		  mutable LookupMutex m_lookupMutex;
+
+		  /// Returns the lookup index of a directory, builds it if necessary.
+		  const LookupIndex& lookupIndex(currdir cdDir) const;
+		  /// Drops the lookup index of a directory after it was modified.
+		  void invalidateLookupIndex(currdir cdDir);
+		  /// Adds a function to the new import directory.
+		  void addNewFunction(const std::string& strFilename, const PELIB_THUNK_DATA<bits>& td);
+		  /// Returns the indexes of the files with the given name.
+		  const std::vector<unsigned int>* lookupFiles(const LookupIndex& index, const std::string& strFilename) const;
+
+		  /// Tests if a certain function is imported.
+		  bool hasFunction(const std::string& strFilename, word wHint) const;
+		  /// Tests if a certain function is imported.
+		  bool hasFunction(const std::string& strFilename, const std::string& strFuncname) const;
+
+		  /// Returns the name of a function imported by ordinal from a well-known file.
+		  static const char* ordinalName(const char* filename, std::size_t size, VAR4_8 thunk);
+
+		  /// Hashes the normalized names of the imported functions.
+		  template<typename Hash> void computeImportHash(std::string& strHash, std::string* strUnorderedHash) const;
+		  /// Returns the length of the file name without the extensions that import hashes drop.
+		  static std::size_t importHashFileNameLength(const char* filename, std::size_t size);
+		  /// Hashes the characters in lower case.
+		  template<typename Hash> static void updateLowerCase(Hash& hash, const char* data, std::size_t size);
 
 		public:
 
@@ -117,12 +244,17 @@ namespace PeLib
 		  LoaderError loaderError() const;
 		  void setLoaderError(LoaderError ldrError);
 
+
 		  /// Get the hint of an imported function.
 		  word getFunctionHint(dword dwFilenr, dword dwFuncnr, currdir cdDir) const; // EXPORT
 		  void setFunctionHint(dword dwFilenr, dword dwFuncnr, currdir cdDir, word value); // EXPORT
 		  /// Get the name of an imported function.
 		  std::string getFunctionName(dword dwFilenr, dword dwFuncnr, currdir cdDir) const; // EXPORT
 		  void setFunctionName(dword dwFilenr, dword dwFuncnr, currdir cdDir, const std::string& functionName); // EXPORT
+		  /// Get the name of a function imported by ordinal from a well-known file.
+		  const char* getOrdinalFunctionName(dword dwFilenr, dword dwFuncnr, currdir cdDir) const; // EXPORT
+		  /// Returns the thunk which identifies an imported function, by ordinal or by name.
+		  VAR4_8 getFunctionThunk(dword dwFilenr, dword dwFuncnr, currdir cdDir) const; // EXPORT
 		  /// Get the number of files which are imported.
 		  dword getNumberOfFiles(currdir cdDir) const; // EXPORT
 		  /// Get the number of fucntions which are imported by a specific file.
@@ -179,6 +311,11 @@ namespace PeLib
 
 		  const std::vector<std::pair<unsigned int, unsigned int>>& getOccupiedAddresses() const;
 
+		  /// Computes the import hash (imphash) and its order-independent variant.
+		  void getImportHash(std::string& strHash, std::string& strUnorderedHash, ImportHashType hashType = IMPORT_HASH_MD5) const; // EXPORT
+		  /// Computes the import hash (imphash).
+		  std::string getImportHash(ImportHashType hashType = IMPORT_HASH_MD5) const; // EXPORT
+
 //		  word getFunctionHint(const std::string& strFilename, const std::string& strFuncname, currdir cdDir) const throw (PeLibException);
 	};
 
@@ -209,35 +346,15 @@ namespace PeLib
 	template<int bits>
 	int ImportDirectory<bits>::addFunction(const std::string& strFilename, word wHint)
 	{
-		if (hasFunction(strFilename, wHint, &PELIB_THUNK_DATA<bits>::equalHint))
+		if (hasFunction(strFilename, wHint))
 		{
 			return ERROR_DUPLICATE_ENTRY;
 		}
 
-	 	// Find the imported file.
-		ImpDirFileIterator FileIter = std::find_if(
-				m_vNewiid.begin(),
-				m_vNewiid.end(),
-				[&](const auto& i) { return i == strFilename; }
-		);
-
-		PELIB_IMAGE_IMPORT_DIRECTORY<bits> iid;
 		PELIB_THUNK_DATA<bits> td;
 		td.hint = wHint;
 		td.itd.Ordinal = wHint | PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG;
-		iid.name = strFilename;
-		if (FileIter == m_vNewiid.end())
-		{
-			iid.originalfirstthunk.push_back(td);
-			iid.firstthunk.push_back(td);
-			m_vNewiid.push_back(iid);
-		}
-		else
-		{
-			FileIter->originalfirstthunk.push_back(td);
-			FileIter->firstthunk.push_back(td);
-		}
-
+		addNewFunction(strFilename, td);
 		return ERROR_NONE;
 	}
 
@@ -249,75 +366,247 @@ namespace PeLib
 	template<int bits>
 	int ImportDirectory<bits>::addFunction(const std::string& strFilename, const std::string& strFuncname)
 	{
-		if (hasFunction(strFilename, strFuncname, &PELIB_THUNK_DATA<bits>::equalFunctionName))
+		if (hasFunction(strFilename, strFuncname))
 		{
 			return ERROR_DUPLICATE_ENTRY;
 		}
 
-	 	// Find the imported file.
-		ImpDirFileIterator FileIter = std::find_if(
-				m_vNewiid.begin(),
-				m_vNewiid.end(),
-				[&](const auto& i) { return i == strFilename; }
-		);
-
-		PELIB_IMAGE_IMPORT_DIRECTORY<bits> iid;
 		PELIB_THUNK_DATA<bits> td;
 		td.fname = strFuncname;
-		iid.name = strFilename;
-		if (FileIter == m_vNewiid.end())
+		addNewFunction(strFilename, td);
+		return ERROR_NONE;
+	}
+
+	/**
+	* Appends a function to the first new file with the given name, or to a new file if there
+	* is none, and updates the lookup index of the new directory in place. Rebuilding the index
+	* after every added function would make adding many functions take quadratic time.
+	* @param strFilename Name of the imported file.
+	* @param td Thunk of the function, added as both its OriginalFirstThunk and FirstThunk.
+	**/
+	template<int bits>
+	void ImportDirectory<bits>::addNewFunction(const std::string& strFilename, const PELIB_THUNK_DATA<bits>& td)
+	{
+	 	// Find the imported file.
+		const std::vector<unsigned int>* vFiles = lookupFiles(lookupIndex(NEWDIR), strFilename);
+		bool bNewFile = (vFiles == nullptr);
+		unsigned int uiFile = bNewFile ? static_cast<unsigned int>(m_vNewiid.size()) : vFiles->front();
+
+		if (bNewFile)
 		{
-			iid.originalfirstthunk.push_back(td);
-			iid.firstthunk.push_back(td);
+			PELIB_IMAGE_IMPORT_DIRECTORY<bits> iid;
+			iid.name = strFilename;
 			m_vNewiid.push_back(iid);
 		}
-		else
+
+		PELIB_IMAGE_IMPORT_DIRECTORY<bits>& iid = m_vNewiid[uiFile];
+		// Once functions were removed, the thunk arrays differ and the indexes of the named functions may shift
+		bool bInSync = iid.originalfirstthunk.size() == iid.firstthunk.size();
+		iid.originalfirstthunk.push_back(td);
+		iid.firstthunk.push_back(td);
+
+		std::lock_guard<std::mutex> lock(m_lookupMutex.mutex);
+		if (!bInSync || !m_newLookup.valid)
 		{
-			FileIter->originalfirstthunk.push_back(td);
-			FileIter->firstthunk.push_back(td);
+			m_newLookup = LookupIndex();
+			return;
 		}
 
-		return ERROR_NONE;
+		if (bNewFile)
+		{
+			m_newLookup.fileIndexes[toUpperCase(strFilename)].push_back(uiFile);
+			m_newLookup.files.emplace_back();
+		}
+
+		typename LookupIndex::File& file = m_newLookup.files[uiFile];
+		std::string strUpperFuncname = toUpperCase(td.fname);
+		unsigned int uiFunc = static_cast<unsigned int>(iid.firstthunk.size() - 1);
+		file.functions[strUpperFuncname].push_back(uiFunc);
+		if (const char* ordName = ordinalName(iid.name.data(), iid.name.size(), td.itd.Ordinal))
+		{
+			file.functions[toUpperCase(ordName)].push_back(uiFunc);
+		}
+		file.thunkNames.insert(strUpperFuncname);
+		file.thunkHints.insert(td.hint);
 	}
 
 	/**
-	* Searches through the import directory and returns the number of the import
-	* directory entry which belongs to the given filename.
-	* @param strFilename Name of the imported file.
+	* Returns the lookup index of the OLDDIR or new import directory. The index is built
+	* on the first call after the directory was read or modified.
 	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
-	* @return The ID of an imported file.
+	* @return Lookup index of the directory.
 	**/
 	template<int bits>
-	unsigned int ImportDirectory<bits>::getFileIndex(const std::string& strFilename, currdir cdDir) const
+	const typename ImportDirectory<bits>::LookupIndex& ImportDirectory<bits>::lookupIndex(currdir cdDir) const
 	{
-		const std::vector<PELIB_IMAGE_IMPORT_DIRECTORY<bits> >* currDir;
+		std::lock_guard<std::mutex> lock(m_lookupMutex.mutex);
+
+		LookupIndex& index = (cdDir == OLDDIR) ? m_oldLookup : m_newLookup;
+		if (index.valid)
+		{
+			return index;
+		}
+
+		index.fileIndexes.clear();
 
 		if (cdDir == OLDDIR)
 		{
-			 currDir = &m_vOldiid;
+			index.files.assign(m_oldDir.files.size(), typename LookupIndex::File());
+
+			for (unsigned int i = 0; i < m_oldDir.files.size(); i++)
+			{
+				const typename FlatDirectory::File& iid = m_oldDir.files[i];
+				typename LookupIndex::File& file = index.files[i];
+				const char* filename = m_oldDir.name(iid.nameOffset);
+				std::size_t uiFilenameLength = std::strlen(filename);
+				index.fileIndexes[toUpperCase(filename)].push_back(i);
+
+				for (unsigned int j = 0; j < iid.numberOfFt; j++)
+				{
+					std::size_t uiThunk = m_oldDir.functionThunk(iid, j);
+					file.functions[toUpperCase(m_oldDir.name(m_oldDir.nameOffsets[uiThunk]))].push_back(j);
+
+					// Functions imported by ordinal can also be found by their well-known names
+					if (const char* ordName = ordinalName(filename, uiFilenameLength, m_oldDir.thunks[uiThunk]))
+					{
+						file.functions[toUpperCase(ordName)].push_back(j);
+					}
+				}
+
+				for (std::size_t uiThunk = iid.firstOft; uiThunk < iid.firstOft + iid.numberOfOft; uiThunk++)
+				{
+					file.thunkNames.insert(toUpperCase(m_oldDir.name(m_oldDir.nameOffsets[uiThunk])));
+					file.thunkHints.insert(m_oldDir.hints[uiThunk]);
+				}
+			}
 		}
 		else
 		{
-			 currDir = &m_vNewiid;
+			index.files.assign(m_vNewiid.size(), typename LookupIndex::File());
+
+			for (unsigned int i = 0; i < m_vNewiid.size(); i++)
+			{
+				const PELIB_IMAGE_IMPORT_DIRECTORY<bits>& iid = m_vNewiid[i];
+				typename LookupIndex::File& file = index.files[i];
+				index.fileIndexes[toUpperCase(iid.name)].push_back(i);
+
+				// Same choice of the thunk as in getFunctionName
+				for (unsigned int j = 0; j < iid.firstthunk.size(); j++)
+				{
+					bool useOft = iid.impdesc.OriginalFirstThunk != 0;
+					if (useOft && j >= iid.originalfirstthunk.size())
+						continue;
+
+					const PELIB_THUNK_DATA<bits>& thunk = useOft ? iid.originalfirstthunk[j] : iid.firstthunk[j];
+					file.functions[toUpperCase(thunk.fname)].push_back(j);
+
+					if (const char* ordName = ordinalName(iid.name.data(), iid.name.size(), thunk.itd.Ordinal))
+					{
+						file.functions[toUpperCase(ordName)].push_back(j);
+					}
+				}
+
+				for (const auto& thunk : iid.originalfirstthunk)
+				{
+					file.thunkNames.insert(toUpperCase(thunk.fname));
+					file.thunkHints.insert(thunk.hint);
+				}
+			}
 		}
 
-		ConstImpDirFileIterator FileIter = std::find_if(
-				currDir->begin(),
-				currDir->end(),
-				[&](const auto& i) { return i == strFilename; }
-		);
+		index.valid = true;
+		return index;
+	}
+
+	/**
+	* Drops the lookup index of a directory, it is built again by the next lookup.
+	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
+	**/
+	template<int bits>
+	void ImportDirectory<bits>::invalidateLookupIndex(currdir cdDir)
+	{
+		std::lock_guard<std::mutex> lock(m_lookupMutex.mutex);
+
+		if (cdDir == OLDDIR) m_oldLookup = LookupIndex();
+		else m_newLookup = LookupIndex();
+	}
+
+	/**
+	* @param index Lookup index of a directory.
+	* @param strFilename Name of the imported file, compared case-insensitively.
+	* @return Ascending indexes of the files with the given name or nullptr if there are none.
+	**/
+	template<int bits>
+	const std::vector<unsigned int>* ImportDirectory<bits>::lookupFiles(const LookupIndex& index, const std::string& strFilename) const
+	{
+		auto Iter = index.fileIndexes.find(toUpperCase(strFilename));
+		return (Iter != index.fileIndexes.end()) ? &Iter->second : nullptr;
+	}
 
-		if (FileIter != currDir->end())
+	/**
+	* Tests if any of the files with the given name imports a function with the given hint.
+	* @param strFilename Name of the imported file.
+	* @param wHint Hint of the function.
+	**/
+	template<int bits>
+	bool ImportDirectory<bits>::hasFunction(const std::string& strFilename, word wHint) const
+	{
+		for (currdir cdDir : {OLDDIR, NEWDIR})
 		{
-			return static_cast<unsigned int>(std::distance(currDir->begin(), FileIter));
+			const LookupIndex& index = lookupIndex(cdDir);
+			const std::vector<unsigned int>* vFiles = lookupFiles(index, strFilename);
+			if (vFiles == nullptr)
+				continue;
+
+			for (unsigned int uiFile : *vFiles)
+			{
+				if (index.files[uiFile].thunkHints.count(wHint))
+					return true;
+			}
 		}
-		else
+
+		return false;
+	}
+
+	/**
+	* Tests if any of the files with the given name imports a function with the given name.
+	* @param strFilename Name of the imported file.
+	* @param strFuncname Name of the function, compared case-insensitively.
+	**/
+	template<int bits>
+	bool ImportDirectory<bits>::hasFunction(const std::string& strFilename, const std::string& strFuncname) const
+	{
+		std::string strUpperFuncname = toUpperCase(strFuncname);
+
+		for (currdir cdDir : {OLDDIR, NEWDIR})
 		{
-			return -1;
-			// throw Exceptions::InvalidName(ImportDirectoryId, __LINE__);
+			const LookupIndex& index = lookupIndex(cdDir);
+			const std::vector<unsigned int>* vFiles = lookupFiles(index, strFilename);
+			if (vFiles == nullptr)
+				continue;
+
+			for (unsigned int uiFile : *vFiles)
+			{
+				if (index.files[uiFile].thunkNames.count(strUpperFuncname))
+					return true;
+			}
 		}
 
-		return ERROR_NONE;
+		return false;
+	}
+
+	/**
+	* Searches through the import directory and returns the number of the import
+	* directory entry which belongs to the given filename.
+	* @param strFilename Name of the imported file.
+	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
+	* @return The ID of an imported file.
+	**/
+	template<int bits>
+	unsigned int ImportDirectory<bits>::getFileIndex(const std::string& strFilename, currdir cdDir) const
+	{
+		const std::vector<unsigned int>* vFiles = lookupFiles(lookupIndex(cdDir), strFilename);
+		return vFiles ? vFiles->front() : -1;
 	}
 
 	/**
@@ -330,11 +619,25 @@ namespace PeLib
 	template<int bits>
 	unsigned int ImportDirectory<bits>::getFunctionIndex(const std::string& strFilename, const std::string& strFuncname, currdir cdDir) const
 	{
-		unsigned int uiFile = getFileIndex(strFilename, cdDir);
+		const LookupIndex& index = lookupIndex(cdDir);
+		const std::vector<unsigned int>* vFiles = lookupFiles(index, strFilename);
+		if (vFiles == nullptr)
+		{
+			return -1;
+		}
 
-		for (unsigned int i=0;i<getNumberOfFunctions(uiFile, cdDir);i++)
+		// The index is case-insensitive, but function names are compared exactly
+		unsigned int uiFile = vFiles->front();
+		auto Iter = index.files[uiFile].functions.find(toUpperCase(strFuncname));
+		if (Iter != index.files[uiFile].functions.end())
 		{
-			if (getFunctionName(uiFile, i, cdDir) == strFuncname) return i;
+			for (unsigned int uiFunc : Iter->second)
+			{
+				if (getFunctionName(uiFile, uiFunc, cdDir) == strFuncname) return uiFunc;
+
+				const char* ordName = getOrdinalFunctionName(uiFile, uiFunc, cdDir);
+				if (ordName && strFuncname == ordName) return uiFunc;
+			}
 		}
 
 		return -1;
@@ -349,15 +652,17 @@ namespace PeLib
 	template<int bits>
 	std::string ImportDirectory<bits>::getFileName(dword dwFilenr, currdir cdDir) const
 	{
-		if (cdDir == OLDDIR) return m_vOldiid[dwFilenr].name;
+		if (cdDir == OLDDIR) return m_oldDir.name(m_oldDir.files[dwFilenr].nameOffset);
 		else return m_vNewiid[dwFilenr].name;
 	}
 
 	template<int bits>
 	void ImportDirectory<bits>::setFileName(dword filenr, currdir dir, const std::string& name)
 	{
-		if (dir == OLDDIR) m_vOldiid[filenr].name = name;
+		if (dir == OLDDIR) m_oldDir.files[filenr].nameOffset = m_oldDir.addName(name.data(), name.size());
 		else m_vNewiid[filenr].name = name;
+
+		invalidateLookupIndex(dir);
 	}
 
 	/**
@@ -373,16 +678,8 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			// Unsafe
 			// mz: fix #1189
-			if (m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk && dwFuncnr < m_vOldiid[dwFilenr].originalfirstthunk.size())
-			{
-				return m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].fname;
-			}
-			else
-			{
-				return m_vOldiid[dwFilenr].firstthunk[dwFuncnr].fname;
-			}
+			return m_oldDir.name(m_oldDir.nameOffsets[m_oldDir.functionThunk(m_oldDir.files[dwFilenr], dwFuncnr)]);
 		}
 		else
 		{
@@ -397,20 +694,59 @@ namespace PeLib
 		}
 	}
 
+	/**
+	* Get the name of a function which a well-known file exports by ordinal only (see getOrdinalName).
+	* The name is not copied, so the call never allocates.
+	* @param dwFilenr Identifies which file should be checked.
+	* @param dwFuncnr Identifies which function should be checked.
+	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
+	* @return Name of the function, nullptr if it is imported by name or the ordinal is not known.
+	**/
+	template<int bits>
+	const char* ImportDirectory<bits>::getOrdinalFunctionName(dword dwFilenr, dword dwFuncnr, currdir cdDir) const
+	{
+		if (cdDir == OLDDIR)
+		{
+			const char* filename = m_oldDir.name(m_oldDir.files[dwFilenr].nameOffset);
+			return ordinalName(filename, std::strlen(filename), getFunctionThunk(dwFilenr, dwFuncnr, cdDir));
+		}
+		else
+		{
+			const std::string& name = m_vNewiid[dwFilenr].name;
+			return ordinalName(name.data(), name.size(), getFunctionThunk(dwFilenr, dwFuncnr, cdDir));
+		}
+	}
+
+	/**
+	* Returns the thunk which identifies an imported function, the same one getFunctionName decodes.
+	* Functions imported by ordinal have the ordinal flag set, the others have the RVA of their hint and name.
+	* @param dwFilenr Identifies which file should be checked.
+	* @param dwFuncnr Identifies which function should be checked.
+	* @param cdDir Flag to decide if the OLDDIR or new import directory is used.
+	* @return Thunk of the function.
+	**/
+	template<int bits>
+	typename ImportDirectory<bits>::VAR4_8 ImportDirectory<bits>::getFunctionThunk(dword dwFilenr, dword dwFuncnr, currdir cdDir) const
+	{
+		if (cdDir == OLDDIR)
+		{
+			return m_oldDir.thunks[m_oldDir.functionThunk(m_oldDir.files[dwFilenr], dwFuncnr)];
+		}
+		else
+		{
+			const PELIB_IMAGE_IMPORT_DIRECTORY<bits>& iid = m_vNewiid[dwFilenr];
+			return (iid.impdesc.OriginalFirstThunk ? iid.originalfirstthunk[dwFuncnr] : iid.firstthunk[dwFuncnr]).itd.Ordinal;
+		}
+	}
+
 	template<int bits>
 	void ImportDirectory<bits>::setFunctionName(dword dwFilenr, dword dwFuncnr, currdir cdDir, const std::string& functionName)
 	{
 		if (cdDir == OLDDIR)
 		{
 			// Unsafe
-			if (m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk)
-			{
-				m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].fname = functionName;
-			}
-			else
-			{
-				m_vOldiid[dwFilenr].firstthunk[dwFuncnr].fname = functionName;
-			}
+			std::size_t uiThunk = m_oldDir.functionThunk(m_oldDir.files[dwFilenr], dwFuncnr);
+			m_oldDir.nameOffsets[uiThunk] = m_oldDir.addName(functionName.data(), functionName.size());
 		}
 		else
 		{
@@ -423,6 +759,8 @@ namespace PeLib
 				m_vNewiid[dwFilenr].firstthunk[dwFuncnr].fname = functionName;
 			}
 		}
+
+		invalidateLookupIndex(cdDir);
 	}
 
 	/**
@@ -457,14 +795,7 @@ namespace PeLib
 		if (cdDir == OLDDIR)
 		{
 			// mz: fix #1189
-			if (m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk && dwFuncnr < m_vOldiid[dwFilenr].originalfirstthunk.size())
-			{
-				return m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].hint;
-			}
-			else
-			{
-				return m_vOldiid[dwFilenr].firstthunk[dwFuncnr].hint;
-			}
+			return m_oldDir.hints[m_oldDir.functionThunk(m_oldDir.files[dwFilenr], dwFuncnr)];
 		}
 		else return m_vNewiid[dwFilenr].originalfirstthunk[dwFuncnr].hint;
 	}
@@ -474,16 +805,11 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			if (m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk)
-			{
-				m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].hint = value;
-			}
-			else
-			{
-				m_vOldiid[dwFilenr].firstthunk[dwFuncnr].hint = value;
-			}
+			m_oldDir.hints[m_oldDir.functionThunk(m_oldDir.files[dwFilenr], dwFuncnr)] = value;
 		}
 		else m_vNewiid[dwFilenr].originalfirstthunk[dwFuncnr].hint = value;
+
+		invalidateLookupIndex(cdDir);
 	}
 
 	/**
@@ -494,7 +820,7 @@ namespace PeLib
 	template<int bits>
 	dword ImportDirectory<bits>::getNumberOfFiles(currdir cdDir) const
 	{
-		if (cdDir == OLDDIR) return static_cast<dword>(m_vOldiid.size());
+		if (cdDir == OLDDIR) return static_cast<dword>(m_oldDir.files.size());
 		else return static_cast<dword>(m_vNewiid.size());
 	}
 
@@ -507,7 +833,7 @@ namespace PeLib
 	template<int bits>
 	dword ImportDirectory<bits>::getNumberOfFunctions(dword dwFilenr, currdir cdDir) const
 	{
-		if (cdDir == OLDDIR) return static_cast<unsigned int>(m_vOldiid[dwFilenr].firstthunk.size());
+		if (cdDir == OLDDIR) return m_oldDir.files[dwFilenr].numberOfFt;
 		else return static_cast<unsigned int>(m_vNewiid[dwFilenr].firstthunk.size());
 	}
 
@@ -553,8 +879,8 @@ namespace PeLib
 
 		inStream_w.seekg(uiOffset, std::ios_base::beg);
 
-		PELIB_IMAGE_IMPORT_DIRECTORY<bits> iidCurr;
-		std::vector<PELIB_IMAGE_IMPORT_DIRECTORY<bits> > vOldIidCurr;
+		typename FlatDirectory::File iidCurr = {};
+		FlatDirectory oldDir;
 		unsigned int uiDescCounter = 0;
 		unsigned int uiDescOffset = uiOffset;
 
@@ -615,15 +941,16 @@ namespace PeLib
 			}
 
 			// Retrieve the import name string from the image
-			getStringFromFileOffset(inStream_w, iidCurr.name, peHeader.rvaToOffset(iidCurr.impdesc.Name), IMPORT_LIBRARY_MAX_LENGTH);
+			std::string strName;
+			getStringFromFileOffset(inStream_w, strName, peHeader.rvaToOffset(iidCurr.impdesc.Name), IMPORT_LIBRARY_MAX_LENGTH);
 
 			// Ignore too large import directories
 			// Sample: CCE461B6EB23728BA3B8A97B9BE84C0FB9175DB31B9949E64144198AB3F702CE, # of impdesc 0x6253 (invalid)
 			// Sample: 395e64e7071d35cb85d8312095aede5166db731aac44920679eee5c7637cc58c, # of impdesc 0x0131 (valid)
-			if (uniqueDllList.find(iidCurr.name) == uniqueDllList.end())
+			if (uniqueDllList.find(strName) == uniqueDllList.end())
 			{
 				// Remember that the DLL was imported before
-				uniqueDllList.emplace(iidCurr.name, 1);
+				uniqueDllList.emplace(strName, 1);
 
 				// Check the total number of imported DLLs
 				if(uniqueDllList.size() > PELIB_MAX_IMPORT_DLLS)
@@ -636,41 +963,54 @@ namespace PeLib
 			// Mark the range occupied by name
 			// +1 for null terminator
 			// If the end address is even, we need to align it by 2, so next name always starts at even address
-			m_occupiedAddresses.emplace_back(iidCurr.impdesc.Name, iidCurr.impdesc.Name + iidCurr.name.length() + 1);
+			m_occupiedAddresses.emplace_back(iidCurr.impdesc.Name, iidCurr.impdesc.Name + strName.length() + 1);
 			if (!(m_occupiedAddresses.back().second & 1))
 				m_occupiedAddresses.back().second += 1;
 
 			// Push the import descriptor into the vector
-			vOldIidCurr.push_back(iidCurr);
+			iidCurr.nameOffset = oldDir.addName(strName.data(), strName.size());
+			oldDir.files.push_back(iidCurr);
 		}
 
 		// Space occupied by import descriptors
 		m_occupiedAddresses.emplace_back(peHeader.getIddImportRva(), peHeader.getIddImportRva() + (uiDescOffset - uiOffset - 1));
 
+		// The thunk arrays and the names are decoded from the file contents in memory
+		std::unique_ptr<ByteSource> streamSource;
+		const ByteSource* source = getContiguousByteSource(inStream_w);
+		if (source == nullptr)
+		{
+			inStream_w.clear();
+			streamSource.reset(new StreamByteSource(inStream_w));
+			source = streamSource.get();
+		}
+		ThunkArrayReader thunkReader(*source);
+
 		// OriginalFirstThunk - ILT
-		for (unsigned int i=0;i<vOldIidCurr.size();i++)
+		for (unsigned int i=0;i<oldDir.files.size();i++)
 		{
-			if (!hasValidOriginalFirstThunk(vOldIidCurr[i].impdesc, peHeader))
+			typename FlatDirectory::File& file = oldDir.files[i];
+			file.firstOft = static_cast<std::uint32_t>(oldDir.thunks.size());
+			if (!hasValidOriginalFirstThunk(file.impdesc, peHeader))
 				continue;
 
-			PELIB_THUNK_DATA<bits> tdCurr;
-			dword uiVaoft = vOldIidCurr[i].impdesc.OriginalFirstThunk;
+			PELIB_IMAGE_THUNK_DATA<bits> tdCurr;
+			dword uiVaoft = file.impdesc.OriginalFirstThunk;
 
-			inStream_w.clear();
-			inStream_w.seekg(static_cast<unsigned int>(peHeader.rvaToOffset(uiVaoft)), std::ios_base::beg);
+			thunkReader.seek(static_cast<unsigned int>(peHeader.rvaToOffset(uiVaoft)));
 
 			for(uiIndex = 0; ; uiIndex++)
 			{
-				if (ulFileSize < peHeader.rvaToOffset(uiVaoft) + sizeof(tdCurr.itd.Ordinal))
+				if (ulFileSize < peHeader.rvaToOffset(uiVaoft) + sizeof(tdCurr.Ordinal))
 				{
 					return ERROR_INVALID_FILE;
 				}
-				uiVaoft += sizeof(tdCurr.itd.Ordinal);
+				uiVaoft += sizeof(tdCurr.Ordinal);
 
-				inStream_w.read(reinterpret_cast<char*>(&tdCurr.itd.Ordinal), sizeof(tdCurr.itd.Ordinal));
+				thunkReader.read(tdCurr.Ordinal);
 
 				// Are we at the end of the list?
-				if (tdCurr.itd.Ordinal == 0)
+				if (tdCurr.Ordinal == 0)
 					break;
 
 				// Did we exceed the count of imported functions?
@@ -682,54 +1022,56 @@ namespace PeLib
 
 				// Check samples that have import name out of the image
 				// Sample: CCE461B6EB23728BA3B8A97B9BE84C0FB9175DB31B9949E64144198AB3F702CE
-				if ((tdCurr.itd.Ordinal & OrdinalMask) == 0 && (tdCurr.itd.Ordinal >= SizeOfImage))
+				if ((tdCurr.Ordinal & OrdinalMask) == 0 && (tdCurr.Ordinal >= SizeOfImage))
 				{
 					setLoaderError(LDR_ERROR_IMPDIR_NAME_RVA_INVALID);
 					break;
 				}
 
 				// Insert ordinal to the list
-				vOldIidCurr[i].originalfirstthunk.push_back(tdCurr);
+				oldDir.thunks.push_back(tdCurr.Ordinal);
+				file.numberOfOft++;
 			}
 
 			// Space occupied by OriginalFirstThunks
 			// -1 because we need open interval
-			if (vOldIidCurr[i].impdesc.OriginalFirstThunk < uiVaoft)
-				m_occupiedAddresses.emplace_back(vOldIidCurr[i].impdesc.OriginalFirstThunk, uiVaoft - 1);
+			if (file.impdesc.OriginalFirstThunk < uiVaoft)
+				m_occupiedAddresses.emplace_back(file.impdesc.OriginalFirstThunk, uiVaoft - 1);
 		}
 
 		// FirstThunk - IAT
-		for (unsigned int i=0;i<vOldIidCurr.size();i++)
+		for (unsigned int i=0;i<oldDir.files.size();i++)
 		{
-			bool hasValidIlt = hasValidOriginalFirstThunk(vOldIidCurr[i].impdesc, peHeader);
+			typename FlatDirectory::File& file = oldDir.files[i];
+			file.firstFt = static_cast<std::uint32_t>(oldDir.thunks.size());
+			bool hasValidIlt = hasValidOriginalFirstThunk(file.impdesc, peHeader);
 
-			dword uiVaoft = vOldIidCurr[i].impdesc.FirstThunk;
+			dword uiVaoft = file.impdesc.FirstThunk;
 			if (!peHeader.isValidRva(uiVaoft))
 			{
 				return ERROR_INVALID_FILE;
 			}
 
-			PELIB_THUNK_DATA<bits> tdCurr;
+			PELIB_IMAGE_THUNK_DATA<bits> tdCurr;
 
-			inStream_w.clear();
-			inStream_w.seekg(static_cast<unsigned int>(peHeader.rvaToOffset(uiVaoft)), std::ios_base::beg);
+			thunkReader.seek(static_cast<unsigned int>(peHeader.rvaToOffset(uiVaoft)));
 
 			for(uiIndex = 0; ; uiIndex++)
 			{
-				if (ulFileSize < peHeader.rvaToOffset(uiVaoft) + sizeof(tdCurr.itd.Ordinal))
+				if (ulFileSize < peHeader.rvaToOffset(uiVaoft) + sizeof(tdCurr.Ordinal))
 				{
 					setLoaderError(LDR_ERROR_IMPDIR_THUNK_RVA_INVALID);
 					return ERROR_INVALID_FILE;
 				}
 
-				uiVaoft += sizeof(tdCurr.itd.Ordinal);
+				uiVaoft += sizeof(tdCurr.Ordinal);
 
 				// Read the import thunk. Make sure it's initialized in case the file read fails
-				tdCurr.itd.Ordinal = 0;
-				inStream_w.read(reinterpret_cast<char*>(&tdCurr.itd.Ordinal), sizeof(tdCurr.itd.Ordinal));
+				tdCurr.Ordinal = 0;
+				thunkReader.read(tdCurr.Ordinal);
 
 				// Are we at the end of the list?
-				if (tdCurr.itd.Ordinal == 0)
+				if (tdCurr.Ordinal == 0)
 					break;
 
 				// Did the number of imported functions exceede maximum?
@@ -741,171 +1083,221 @@ namespace PeLib
 
 				// Check samples that have import name out of the image
 				// Sample: CCE461B6EB23728BA3B8A97B9BE84C0FB9175DB31B9949E64144198AB3F702CE
-//				if ((tdCurr.itd.Ordinal & OrdinalMask) == 0 && (tdCurr.itd.Ordinal >= SizeOfImage))
+//				if ((tdCurr.Ordinal & OrdinalMask) == 0 && (tdCurr.Ordinal >= SizeOfImage))
 //					break;
 
-				vOldIidCurr[i].firstthunk.push_back(tdCurr);
+				oldDir.thunks.push_back(tdCurr.Ordinal);
+				file.numberOfFt++;
 
 				// If this import descriptor has valid ILT, then size of IAT is determined from the size of ILT
-				if (hasValidIlt && vOldIidCurr[i].originalfirstthunk.size() == vOldIidCurr[i].firstthunk.size())
+				if (hasValidIlt && file.numberOfOft == file.numberOfFt)
 				{
 					// We need to move this offset in this case because otherwise we would calculate the occupied addresses wrongly
-					uiVaoft += sizeof(tdCurr.itd.Ordinal);
+					uiVaoft += sizeof(tdCurr.Ordinal);
 					break;
 				}
 			}
 
 			// Space occupied by FirstThunks
 			// -1 because we need open interval
-			if (vOldIidCurr[i].impdesc.FirstThunk < uiVaoft)
-				m_occupiedAddresses.emplace_back(vOldIidCurr[i].impdesc.FirstThunk, uiVaoft - 1);
+			if (file.impdesc.FirstThunk < uiVaoft)
+				m_occupiedAddresses.emplace_back(file.impdesc.FirstThunk, uiVaoft - 1);
 		}
 
 		// Names
-		for (unsigned int i=0;i<vOldIidCurr.size();i++)
-		{
-			if (hasValidOriginalFirstThunk(vOldIidCurr[i].impdesc, peHeader))
+		oldDir.hints.assign(oldDir.thunks.size(), 0);
+		oldDir.nameOffsets.assign(oldDir.thunks.size(), 0);
+		std::vector<VAR4_8> vNameOffsets;
+		std::vector<unsigned char> vNameBuffer;
+		for (unsigned int i=0;i<oldDir.files.size();i++)
+		{
+			// The names are read from the ILT if it is valid, from the IAT otherwise
+			const typename FlatDirectory::File& file = oldDir.files[i];
+			bool hasValidIlt = hasValidOriginalFirstThunk(file.impdesc, peHeader);
+			std::size_t uiFirst = hasValidIlt ? file.firstOft : file.firstFt;
+			std::size_t uiCount = hasValidIlt ? file.numberOfOft : file.numberOfFt;
+
+			// Translate the name RVAs of the whole thunk array at once, they are mostly sorted
+			vNameOffsets.resize(uiCount);
+			peHeader.rvaToOffsets(oldDir.thunks.data() + uiFirst, uiCount, vNameOffsets.data());
+
+			for (std::size_t j = 0; j < uiCount; j++)
 			{
-				for (unsigned int j=0;j<vOldIidCurr[i].originalfirstthunk.size();j++)
-				{
-					if (vOldIidCurr[i].originalfirstthunk[j].itd.Ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG)
-					{
-						vOldIidCurr[i].originalfirstthunk[j].hint = 0;
-						continue;
-					}
+				VAR4_8 ordinal = oldDir.thunks[uiFirst + j];
+				if (ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG)
+					continue;
 
-					inStream_w.seekg(static_cast<unsigned int>(peHeader.rvaToOffset(vOldIidCurr[i].originalfirstthunk[j].itd.Ordinal)), std::ios_base::beg);
-
-					inStream_w.read(reinterpret_cast<char*>(&vOldIidCurr[i].originalfirstthunk[j].hint), sizeof(vOldIidCurr[i].originalfirstthunk[j].hint));
-
-					if (!inStream_w)
-						return ERROR_INVALID_FILE;
-
-					getStringFromFileOffset(
-							inStream_w,
-							vOldIidCurr[i].originalfirstthunk[j].fname,
-							inStream_w.tellg(),
-							IMPORT_SYMBOL_MAX_LENGTH);
+				if (thunkReader.failed() || !readHintName(*source, static_cast<unsigned int>(vNameOffsets[j]), vNameBuffer, oldDir, uiFirst + j))
+					return ERROR_INVALID_FILE;
 
-					// Space occupied by names
-					// +1 for null terminator
-					// If the end address is even, we need to align it by 2, so next name always starts at even address
-					m_occupiedAddresses.emplace_back(
-						static_cast<unsigned int>(vOldIidCurr[i].originalfirstthunk[j].itd.Ordinal),
-						static_cast<unsigned int>(vOldIidCurr[i].originalfirstthunk[j].itd.Ordinal + sizeof(vOldIidCurr[i].originalfirstthunk[j].hint) + vOldIidCurr[i].originalfirstthunk[j].fname.length() + 1)
-						);
-					if (!(m_occupiedAddresses.back().second & 1))
-						m_occupiedAddresses.back().second += 1;
-				}
+				// Space occupied by names
+				// +1 for null terminator
+				// If the end address is even, we need to align it by 2, so next name always starts at even address
+				std::size_t uiNameLength = std::strlen(oldDir.name(oldDir.nameOffsets[uiFirst + j]));
+				m_occupiedAddresses.emplace_back(
+					static_cast<unsigned int>(ordinal),
+					static_cast<unsigned int>(ordinal + sizeof(word) + uiNameLength + 1)
+					);
+				if (!(m_occupiedAddresses.back().second & 1))
+					m_occupiedAddresses.back().second += 1;
 			}
-			else
-			{
-				for (unsigned int j=0;j<vOldIidCurr[i].firstthunk.size();j++)
-				{
-					if (vOldIidCurr[i].firstthunk[j].itd.Ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG)
-					{
-						continue;
-					}
+		}
+		std::swap(oldDir, m_oldDir);
+		invalidateLookupIndex(OLDDIR);
+		return ERROR_NONE;
+	}
 
-					inStream_w.seekg(static_cast<unsigned int>(peHeader.rvaToOffset(vOldIidCurr[i].firstthunk[j].itd.Ordinal)), std::ios_base::beg);
+	/**
+	* Decodes the hint and the name of an imported function. The name ends at the first zero byte,
+	* at the end of the file or after IMPORT_SYMBOL_MAX_LENGTH characters, whichever comes first.
+	* @param source Contents of the file.
+	* @param ulOffset File offset of the hint.
+	* @param vBuffer Buffer used when the source is not contiguous.
+	* @param dir Directory which receives the hint and the name.
+	* @param uiThunk Index of the thunk of the function in the directory.
+	* @return False if the hint is beyond the end of the file.
+	**/
+	template<int bits>
+	bool ImportDirectory<bits>::readHintName(const ByteSource& source, std::uint64_t ulOffset, std::vector<unsigned char>& vBuffer, FlatDirectory& dir, std::size_t uiThunk)
+	{
+		if (!source.contains(ulOffset, sizeof(word)))
+			return false;
+
+		// Bytes beyond the end of the file read as zeros and terminate the name
+		const unsigned char* data = source.readRange(ulOffset, sizeof(word) + IMPORT_SYMBOL_MAX_LENGTH, vBuffer);
+		const unsigned char* name = data + sizeof(word);
+		std::memcpy(&dir.hints[uiThunk], data, sizeof(word));
+		dir.nameOffsets[uiThunk] = dir.addName(reinterpret_cast<const char*>(name), std::find(name, name + IMPORT_SYMBOL_MAX_LENGTH, 0) - name);
+		return true;
+	}
 
-					inStream_w.read(reinterpret_cast<char*>(&vOldIidCurr[i].firstthunk[j].hint), sizeof(vOldIidCurr[i].firstthunk[j].hint));
+	/**
+	* @param data Characters of the name.
+	* @param size Number of characters.
+	* @return Offset of the name in the blob, the empty name is not stored again.
+	**/
+	template<int bits>
+	std::uint32_t ImportDirectory<bits>::FlatDirectory::addName(const char* data, std::size_t size)
+	{
+		if (size == 0)
+			return 0;
 
-					if (!inStream_w)
-						return ERROR_INVALID_FILE;
+		std::uint32_t offset = static_cast<std::uint32_t>(names.size());
+		names.append(data, size);
+		names.push_back('\0');
+		return offset;
+	}
 
-					getStringFromFileOffset(
-							inStream_w,
-							vOldIidCurr[i].firstthunk[j].fname,
-							inStream_w.tellg(),
-							IMPORT_SYMBOL_MAX_LENGTH);
+	/**
+	* Same choice as in getFunctionName: the OriginalFirstThunk if the file has any
+	* and the function has one, the FirstThunk otherwise.
+	* @param file File of the function.
+	* @param funcnr Index of the function in the file.
+	* @return Index of the thunk in thunks.
+	**/
+	template<int bits>
+	std::size_t ImportDirectory<bits>::FlatDirectory::functionThunk(const File& file, std::size_t funcnr) const
+	{
+		if (file.impdesc.OriginalFirstThunk && funcnr < file.numberOfOft)
+			return file.firstOft + funcnr;
+		return file.firstFt + funcnr;
+	}
 
-					// Space occupied by names
-					// +1 for null terminator
-					// If the end address is even, we need to align it by 2, so next name always starts at even address
-					m_occupiedAddresses.emplace_back(
-							static_cast<unsigned int>(vOldIidCurr[i].firstthunk[j].itd.Ordinal),
-						    static_cast<unsigned int>(vOldIidCurr[i].firstthunk[j].itd.Ordinal + sizeof(vOldIidCurr[i].firstthunk[j].hint) + vOldIidCurr[i].firstthunk[j].fname.length() + 1)
-						);
-					if (!(m_occupiedAddresses.back().second & 1))
-						m_occupiedAddresses.back().second += 1;
-				}
+	/**
+	* @param iid File with its OriginalFirstThunks and FirstThunks.
+	**/
+	template<int bits>
+	void ImportDirectory<bits>::FlatDirectory::append(const PELIB_IMAGE_IMPORT_DIRECTORY<bits>& iid)
+	{
+		File file;
+		file.impdesc = iid.impdesc;
+		file.nameOffset = addName(iid.name.data(), iid.name.size());
+		file.firstOft = static_cast<std::uint32_t>(thunks.size());
+		file.numberOfOft = static_cast<std::uint32_t>(iid.originalfirstthunk.size());
+		file.firstFt = file.firstOft + file.numberOfOft;
+		file.numberOfFt = static_cast<std::uint32_t>(iid.firstthunk.size());
+		files.push_back(file);
+
+		for (const auto* vThunks : {&iid.originalfirstthunk, &iid.firstthunk})
+		{
+			for (const auto& thunk : *vThunks)
+			{
+				thunks.push_back(thunk.itd.Ordinal);
+				hints.push_back(thunk.hint);
+				nameOffsets.push_back(addName(thunk.fname.data(), thunk.fname.size()));
 			}
 		}
-		std::swap(vOldIidCurr, m_vOldiid);
-		return ERROR_NONE;
 	}
 
 	/**
-	* Rebuilds the import directory.
+	* Rebuilds the import directory. The descriptors of the old and the new files come first,
+	* followed by the OriginalFirstThunks of the new files, their names and the hints and names
+	* of their functions. The layout is computed up front, so the time is linear in the size
+	* of the directory.
 	* @param vBuffer Buffer the rebuilt import directory will be written to.
 	* @param dwRva The RVA of the ImportDirectory in the file.
-	* \todo uiSizeoffuncnames is not used.
+	* @param fixEntries Store the RVAs of the rebuilt OriginalFirstThunks and names in the new files.
 	**/
 	template<int bits>
 	void ImportDirectory<bits>::rebuild(std::vector<byte>& vBuffer, dword dwRva, bool fixEntries)
 	{
 		unsigned int uiImprva = dwRva;
-		unsigned int uiSizeofdescriptors = (static_cast<unsigned int>(m_vNewiid.size() + m_vOldiid.size()) + 1) * PELIB_IMAGE_IMPORT_DESCRIPTOR::size();
+		unsigned int uiSizeofdescriptors = (static_cast<unsigned int>(m_vNewiid.size() + m_oldDir.files.size()) + 1) * PELIB_IMAGE_IMPORT_DESCRIPTOR::size();
 
 		unsigned int uiSizeofdllnames = 0, uiSizeoffuncnames = 0;
 		unsigned int uiSizeofoft = 0;
 
-		for (unsigned int i=0;i<m_vNewiid.size();i++)
+		for (const auto& iid : m_vNewiid)
 		{
-			uiSizeofdllnames += static_cast<unsigned int>(m_vNewiid[i].name.size()) + 1;
-			uiSizeofoft += (static_cast<unsigned int>(m_vNewiid[i].originalfirstthunk.size())+1) * PELIB_IMAGE_THUNK_DATA<bits>::size();
+			uiSizeofdllnames += static_cast<unsigned int>(iid.name.size()) + 1;
+			uiSizeofoft += (static_cast<unsigned int>(iid.originalfirstthunk.size())+1) * PELIB_IMAGE_THUNK_DATA<bits>::size();
 
-			for(unsigned int j=0;j<m_vNewiid[i].originalfirstthunk.size();j++)
+			for (const auto& thunk : iid.originalfirstthunk)
 			{
 				// +3 for hint (word) and 00-byte
-				uiSizeoffuncnames += (static_cast<unsigned int>(m_vNewiid[i].originalfirstthunk[j].fname.size()) + 3);
+				uiSizeoffuncnames += static_cast<unsigned int>(thunk.fname.size()) + 3;
 			}
 		}
 
-//		for (unsigned int i=0;i<m_vNewiid.size();i++)
-//		{
-//			uiSizeofoft += (static_cast<unsigned int>(m_vNewiid[i].originalfirstthunk.size())+1) * PELIB_IMAGE_THUNK_DATA<bits>::size();
-//		}
-
 		OutputBuffer obBuffer(vBuffer);
+		obBuffer.reserve(uiSizeofdescriptors + uiSizeofoft + uiSizeofdllnames + uiSizeoffuncnames);
 
 		// Rebuild IMAGE_IMPORT_DESCRIPTORS
-		for (unsigned int i=0;i<m_vOldiid.size();i++)
+		for (const auto& file : m_oldDir.files)
 		{
-			obBuffer << m_vOldiid[i].impdesc.OriginalFirstThunk;
-			obBuffer << m_vOldiid[i].impdesc.TimeDateStamp;
-			obBuffer << m_vOldiid[i].impdesc.ForwarderChain;
-			obBuffer << m_vOldiid[i].impdesc.Name;
-			obBuffer << m_vOldiid[i].impdesc.FirstThunk;
+			obBuffer << file.impdesc.OriginalFirstThunk;
+			obBuffer << file.impdesc.TimeDateStamp;
+			obBuffer << file.impdesc.ForwarderChain;
+			obBuffer << file.impdesc.Name;
+			obBuffer << file.impdesc.FirstThunk;
 		}
 
-		unsigned int dllsize = 0;
+		dword dwPoft = uiSizeofdescriptors + uiImprva;
+		dword dwPdll = uiSizeofdescriptors + uiSizeofoft + uiImprva;
 
-		for (unsigned int i=0;i<m_vNewiid.size();i++)
+		for (auto& iid : m_vNewiid)
 		{
-			dword dwPoft = uiSizeofdescriptors + uiImprva;
-
-			for (unsigned int j=1;j<=i;j++)
-			{
-				dwPoft += (static_cast<unsigned int>(m_vNewiid[j-1].originalfirstthunk.size()) + 1) * PELIB_IMAGE_THUNK_DATA<bits>::size();
-			}
-
-			obBuffer << (fixEntries ? dwPoft : m_vNewiid[i].impdesc.OriginalFirstThunk);
-			obBuffer << m_vNewiid[i].impdesc.TimeDateStamp;
-			obBuffer << m_vNewiid[i].impdesc.ForwarderChain;
-			dword dwPdll = uiSizeofdescriptors + uiSizeofoft + uiImprva + dllsize;
-			obBuffer << (fixEntries ? dwPdll : m_vNewiid[i].impdesc.Name);
-			obBuffer << m_vNewiid[i].impdesc.FirstThunk;
+			obBuffer << (fixEntries ? dwPoft : iid.impdesc.OriginalFirstThunk);
+			obBuffer << iid.impdesc.TimeDateStamp;
+			obBuffer << iid.impdesc.ForwarderChain;
+			obBuffer << (fixEntries ? dwPdll : iid.impdesc.Name);
+			obBuffer << iid.impdesc.FirstThunk;
 
 			// store the recalculated values
 			if (fixEntries)
 			{
-				m_vNewiid[i].impdesc.OriginalFirstThunk = dwPoft;
-				m_vNewiid[i].impdesc.Name = dwPdll;
+				iid.impdesc.OriginalFirstThunk = dwPoft;
+				iid.impdesc.Name = dwPdll;
 			}
 
-			dllsize += static_cast<unsigned int>(m_vNewiid[i].name.size()) + 1;
+			dwPoft += (static_cast<unsigned int>(iid.originalfirstthunk.size()) + 1) * PELIB_IMAGE_THUNK_DATA<bits>::size();
+			dwPdll += static_cast<unsigned int>(iid.name.size()) + 1;
+		}
+
+		// The function names of the new files are now taken from the OriginalFirstThunks
+		if (fixEntries)
+		{
+			invalidateLookupIndex(NEWDIR);
 		}
 
 		obBuffer << static_cast<dword>(0);
@@ -917,39 +1309,39 @@ namespace PeLib
 		VAR4_8 uiPfunc = uiSizeofdescriptors + uiSizeofoft + uiSizeofdllnames + uiImprva;
 
 		// Rebuild original first thunk
-		for (unsigned int i=0;i<m_vNewiid.size();i++)
+		for (auto& iid : m_vNewiid)
 		{
-			for (unsigned int j=0;j<m_vNewiid[i].originalfirstthunk.size();j++)
+			for (auto& thunk : iid.originalfirstthunk)
 			{
-				if (m_vNewiid[i].originalfirstthunk[j].itd.Ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG
+				if (thunk.itd.Ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG
 					|| fixEntries == false)
 				{
-					obBuffer << m_vNewiid[i].originalfirstthunk[j].itd.Ordinal;
+					obBuffer << thunk.itd.Ordinal;
 				}
 				else
 				{
 					obBuffer << uiPfunc;
 					// store the offset in Ordinal, they cannot overlay thanks to PELIB_IMAGE_ORDINAL_FLAG
-					m_vNewiid[i].originalfirstthunk[j].itd.Ordinal = uiPfunc;
+					thunk.itd.Ordinal = uiPfunc;
 				}
-				uiPfunc += static_cast<VAR4_8>(m_vNewiid[i].originalfirstthunk[j].fname.size()) + 3;
+				uiPfunc += static_cast<VAR4_8>(thunk.fname.size()) + 3;
 			}
 			obBuffer << static_cast<VAR4_8>(0);
 		}
 
 		// Write dllnames into import directory
-		for (unsigned int i=0;i<m_vNewiid.size();i++)
+		for (const auto& iid : m_vNewiid)
 		{
-			obBuffer.add(m_vNewiid[i].name.c_str(), static_cast<unsigned int>(m_vNewiid[i].name.size())+1);
+			obBuffer.add(iid.name.c_str(), static_cast<unsigned int>(iid.name.size())+1);
 		}
 
 		// Write function names into directory
-		for (unsigned int i=0;i<m_vNewiid.size();i++)
+		for (const auto& iid : m_vNewiid)
 		{
-			for (unsigned int j=0;j<m_vNewiid[i].originalfirstthunk.size();j++)
+			for (const auto& thunk : iid.originalfirstthunk)
 			{
-				obBuffer << m_vNewiid[i].originalfirstthunk[j].hint;
-				obBuffer.add(m_vNewiid[i].originalfirstthunk[j].fname.c_str(), static_cast<unsigned int>(m_vNewiid[i].originalfirstthunk[j].fname.size()) + 1);
+				obBuffer << thunk.hint;
+				obBuffer.add(thunk.fname.c_str(), static_cast<unsigned int>(thunk.fname.size()) + 1);
 			}
 		}
 	}
@@ -961,18 +1353,19 @@ namespace PeLib
 	template<int bits>
 	int ImportDirectory<bits>::removeFile(const std::string& strFilename)
 	{
-		unsigned int oldSize = static_cast<unsigned int>(m_vNewiid.size());
-
-		m_vNewiid.erase(
-			std::remove_if(
-				m_vNewiid.begin(),
-				m_vNewiid.end(),
-				[&](const auto& i) { return i == strFilename; }
-			),
-			m_vNewiid.end()
-		);
-
-		return oldSize == m_vNewiid.size() ? 1 : 0;
+		const std::vector<unsigned int>* vFiles = lookupFiles(lookupIndex(NEWDIR), strFilename);
+		if (vFiles == nullptr)
+		{
+			return 1;
+		}
+
+		for (auto Iter = vFiles->rbegin(); Iter != vFiles->rend(); ++Iter)
+		{
+			m_vNewiid.erase(m_vNewiid.begin() + *Iter);
+		}
+
+		invalidateLookupIndex(NEWDIR);
+		return 0;
 	}
 
 	/**
@@ -983,28 +1376,29 @@ namespace PeLib
 	template<int bits>
 	int ImportDirectory<bits>::removeFunction(const std::string& strFilename, const std::string& strFuncname)
 	{
-		ImpDirFileIterator viPos = m_vNewiid.begin();
-
+		const LookupIndex& index = lookupIndex(NEWDIR);
+		const std::vector<unsigned int>* vFiles = lookupFiles(index, strFilename);
+		std::string strUpperFuncname = toUpperCase(strFuncname);
 		int notFound = 1;
 
-		while (viPos != m_vNewiid.end())
+		for (unsigned int uiFile = 0; vFiles && uiFile < vFiles->size(); uiFile++)
 		{
-			if (isEqualNc(viPos->name, strFilename))
-			{
-				unsigned int oldSize = static_cast<unsigned int>(viPos->originalfirstthunk.size());
-				viPos->originalfirstthunk.erase(
-					std::remove_if(
-						viPos->originalfirstthunk.begin(),
-						viPos->originalfirstthunk.end(),
-						[&](const auto& i) { return i.equalFunctionName(strFuncname); }
-					),
-					viPos->originalfirstthunk.end()
-				);
-				if (viPos->originalfirstthunk.size() != oldSize) notFound = 0;
-			}
-			++viPos;
+			if (!index.files[(*vFiles)[uiFile]].thunkNames.count(strUpperFuncname))
+				continue;
+
+			std::vector<PELIB_THUNK_DATA<bits>>& vThunks = m_vNewiid[(*vFiles)[uiFile]].originalfirstthunk;
+			vThunks.erase(
+				std::remove_if(
+					vThunks.begin(),
+					vThunks.end(),
+					[&](const auto& i) { return isEqualNc(i.fname, strFuncname); }
+				),
+				vThunks.end()
+			);
+			notFound = 0;
 		}
 
+		if (!notFound) invalidateLookupIndex(NEWDIR);
 		return notFound;
 	}
 
@@ -1016,27 +1410,28 @@ namespace PeLib
 	template<int bits>
 	int ImportDirectory<bits>::removeFunction(const std::string& strFilename, word wHint)
 	{
-		ImpDirFileIterator viPos = m_vNewiid.begin();
+		const LookupIndex& index = lookupIndex(NEWDIR);
+		const std::vector<unsigned int>* vFiles = lookupFiles(index, strFilename);
 		int notFound = 1;
 
-		while (viPos != m_vNewiid.end())
+		for (unsigned int uiFile = 0; vFiles && uiFile < vFiles->size(); uiFile++)
 		{
-			if (isEqualNc(viPos->name, strFilename))
-			{
-				unsigned int oldSize = static_cast<unsigned int>(viPos->originalfirstthunk.size());
-				viPos->originalfirstthunk.erase(
-					std::remove_if(
-						viPos->originalfirstthunk.begin(),
-						viPos->originalfirstthunk.end(),
-						[&](const auto& i) { return i.equalHint(wHint); }
-					),
-					viPos->originalfirstthunk.end()
-				);
-				if (viPos->originalfirstthunk.size() != oldSize) notFound = 0;
-			}
-			++viPos;
+			if (!index.files[(*vFiles)[uiFile]].thunkHints.count(wHint))
+				continue;
+
+			std::vector<PELIB_THUNK_DATA<bits>>& vThunks = m_vNewiid[(*vFiles)[uiFile]].originalfirstthunk;
+			vThunks.erase(
+				std::remove_if(
+					vThunks.begin(),
+					vThunks.end(),
+					[&](const auto& i) { return i.equalHint(wHint); }
+				),
+				vThunks.end()
+			);
+			notFound = 0;
 		}
 
+		if (!notFound) invalidateLookupIndex(NEWDIR);
 		return notFound;
 	}
 
@@ -1076,8 +1471,13 @@ namespace PeLib
 		ofFile.write(reinterpret_cast<const char*>(vBuffer.data()), vBuffer.size());
 		ofFile.close();
 
-		std::copy(m_vNewiid.begin(), m_vNewiid.end(), std::back_inserter(m_vOldiid));
+		for (const auto& iid : m_vNewiid)
+		{
+			m_oldDir.append(iid);
+		}
 		m_vNewiid.clear();
+		invalidateLookupIndex(OLDDIR);
+		invalidateLookupIndex(NEWDIR);
 
 		return ERROR_NONE;
 	}
@@ -1089,9 +1489,9 @@ namespace PeLib
 	template<int bits>
 	unsigned int ImportDirectory<bits>::size() const
 	{
-		// Only the descriptors of m_vOldiid must be rebuilt, not the data they point to.
+		// Only the descriptors of the old directory must be rebuilt, not the data they point to.
 		return std::accumulate(m_vNewiid.begin(), m_vNewiid.end(), 0, accumulate<PELIB_IMAGE_IMPORT_DIRECTORY<bits> >)
-		+ (m_vOldiid.size() + 1) * PELIB_IMAGE_IMPORT_DESCRIPTOR::size();
+		+ (m_oldDir.files.size() + 1) * PELIB_IMAGE_IMPORT_DESCRIPTOR::size();
 	}
 
 	/**
@@ -1104,7 +1504,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[getFileIndex(strFilename, cdDir)].impdesc.FirstThunk;
+			return m_oldDir.files[getFileIndex(strFilename, cdDir)].impdesc.FirstThunk;
 		}
 		else
 		{
@@ -1122,7 +1522,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[getFileIndex(strFilename, cdDir)].impdesc.OriginalFirstThunk;
+			return m_oldDir.files[getFileIndex(strFilename, cdDir)].impdesc.OriginalFirstThunk;
 		}
 		else
 		{
@@ -1140,7 +1540,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[getFileIndex(strFilename, cdDir)].impdesc.ForwarderChain;
+			return m_oldDir.files[getFileIndex(strFilename, cdDir)].impdesc.ForwarderChain;
 		}
 		else
 		{
@@ -1158,7 +1558,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[getFileIndex(strFilename, cdDir)].impdesc.TimeDateStamp;
+			return m_oldDir.files[getFileIndex(strFilename, cdDir)].impdesc.TimeDateStamp;
 		}
 		else
 		{
@@ -1171,7 +1571,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[getFileIndex(strFilename, cdDir)].impdesc.Name;
+			return m_oldDir.files[getFileIndex(strFilename, cdDir)].impdesc.Name;
 		}
 		else
 		{
@@ -1189,7 +1589,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[dwFilenr].impdesc.FirstThunk;
+			return m_oldDir.files[dwFilenr].impdesc.FirstThunk;
 		}
 		else
 		{
@@ -1202,7 +1602,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			m_vOldiid[dwFilenr].impdesc.FirstThunk = value;
+			m_oldDir.files[dwFilenr].impdesc.FirstThunk = value;
 		}
 		else
 		{
@@ -1220,7 +1620,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk;
+			return m_oldDir.files[dwFilenr].impdesc.OriginalFirstThunk;
 		}
 		else
 		{
@@ -1233,12 +1633,15 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			m_vOldiid[dwFilenr].impdesc.OriginalFirstThunk = value;
+			m_oldDir.files[dwFilenr].impdesc.OriginalFirstThunk = value;
 		}
 		else
 		{
 			m_vNewiid[dwFilenr].impdesc.OriginalFirstThunk = value;
 		}
+
+		// Decides which thunks the function names are taken from
+		invalidateLookupIndex(cdDir);
 	}
 
 	/**
@@ -1251,7 +1654,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[dwFilenr].impdesc.ForwarderChain;
+			return m_oldDir.files[dwFilenr].impdesc.ForwarderChain;
 		}
 		else
 		{
@@ -1264,7 +1667,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			m_vOldiid[dwFilenr].impdesc.ForwarderChain = value;
+			m_oldDir.files[dwFilenr].impdesc.ForwarderChain = value;
 		}
 		else
 		{
@@ -1282,7 +1685,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[dwFilenr].impdesc.TimeDateStamp;
+			return m_oldDir.files[dwFilenr].impdesc.TimeDateStamp;
 		}
 		else
 		{
@@ -1295,7 +1698,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			m_vOldiid[dwFilenr].impdesc.TimeDateStamp = value;
+			m_oldDir.files[dwFilenr].impdesc.TimeDateStamp = value;
 		}
 		else
 		{
@@ -1308,7 +1711,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			return m_vOldiid[dwFilenr].impdesc.Name;
+			return m_oldDir.files[dwFilenr].impdesc.Name;
 		}
 		else
 		{
@@ -1321,7 +1724,7 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			m_vOldiid[dwFilenr].impdesc.Name = value;
+			m_oldDir.files[dwFilenr].impdesc.Name = value;
 		}
 		else
 		{
@@ -1338,14 +1741,14 @@ namespace PeLib
 	template<int bits>
 	typename FieldSizes<bits>::VAR4_8 ImportDirectory<bits>::getFirstThunk(dword dwFilenr, dword dwFuncnr, currdir cdDir) const
 	{
-		if (cdDir == OLDDIR) return m_vOldiid[dwFilenr].firstthunk[dwFuncnr].itd.Ordinal;
+		if (cdDir == OLDDIR) return m_oldDir.thunks[m_oldDir.files[dwFilenr].firstFt + dwFuncnr];
 		else return m_vNewiid[dwFilenr].firstthunk[dwFuncnr].itd.Ordinal;
 	}
 
 	template<int bits>
 	void ImportDirectory<bits>::setFirstThunk(dword dwFilenr, dword dwFuncnr, currdir cdDir, VAR4_8 value)
 	{
-		if (cdDir == OLDDIR) m_vOldiid[dwFilenr].firstthunk[dwFuncnr].itd.Ordinal = value;
+		if (cdDir == OLDDIR) m_oldDir.thunks[m_oldDir.files[dwFilenr].firstFt + dwFuncnr] = value;
 		else m_vNewiid[dwFilenr].firstthunk[dwFuncnr].itd.Ordinal = value;
 	}
 
@@ -1360,9 +1763,9 @@ namespace PeLib
 	{
 		if (cdDir == OLDDIR)
 		{
-			if (dwFuncnr < m_vOldiid[dwFilenr].originalfirstthunk.size())
+			if (dwFuncnr < m_oldDir.files[dwFilenr].numberOfOft)
 			{
-				return m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].itd.Ordinal;
+				return m_oldDir.thunks[m_oldDir.files[dwFilenr].firstOft + dwFuncnr];
 			}
 			else
 			{
@@ -1378,7 +1781,7 @@ namespace PeLib
 	template<int bits>
 	void ImportDirectory<bits>::setOriginalFirstThunk(dword dwFilenr, dword dwFuncnr, currdir cdDir, VAR4_8 value)
 	{
-		if (cdDir == OLDDIR) m_vOldiid[dwFilenr].originalfirstthunk[dwFuncnr].itd.Ordinal = value;
+		if (cdDir == OLDDIR) m_oldDir.thunks[m_oldDir.files[dwFilenr].firstOft + dwFuncnr] = value;
 		else m_vNewiid[dwFilenr].originalfirstthunk[dwFuncnr].itd.Ordinal = value;
 	}
 
@@ -1388,6 +1791,199 @@ namespace PeLib
 		return m_occupiedAddresses;
 	}
 
+	/**
+	* Computes the import hash (imphash) of the imported functions read from the file and
+	* its order-independent variant. The import hash is the digest of the comma separated
+	* "file.function" names of all the imported functions, in lower case and in the order
+	* of the import directory. The extensions .dll, .ocx and .sys are dropped from the file
+	* names. Functions imported by ordinal from the files known to getOrdinalName are named
+	* by their well-known names, the other ones "ord" followed by the ordinal.
+	* The order-independent variant is the sum of the digests of the single names, so it
+	* does not change when the files or functions are reordered.
+	* Both are empty if the file has no import directory.
+	* @param strHash Receives the import hash as a hexadecimal string.
+	* @param strUnorderedHash Receives the order-independent variant as a hexadecimal string.
+	* @param hashType Digest algorithm.
+	**/
+	template<int bits>
+	void ImportDirectory<bits>::getImportHash(std::string& strHash, std::string& strUnorderedHash, ImportHashType hashType) const
+	{
+		if (hashType == IMPORT_HASH_SHA256) computeImportHash<Sha256>(strHash, &strUnorderedHash);
+		else computeImportHash<Md5>(strHash, &strUnorderedHash);
+	}
+
+	/**
+	* Computes the import hash (imphash) of the imported functions read from the file.
+	* @param hashType Digest algorithm.
+	* @return Import hash as a hexadecimal string, empty if the file has no import directory.
+	**/
+	template<int bits>
+	std::string ImportDirectory<bits>::getImportHash(ImportHashType hashType) const
+	{
+		std::string strHash;
+		if (hashType == IMPORT_HASH_SHA256) computeImportHash<Sha256>(strHash, nullptr);
+		else computeImportHash<Md5>(strHash, nullptr);
+		return strHash;
+	}
+
+	/**
+	* Streams the normalized names of the imported functions into the digests, without
+	* building the names in memory.
+	* @param strHash Receives the import hash.
+	* @param strUnorderedHash Receives the order-independent variant, not computed if nullptr.
+	**/
+	template<int bits>
+	template<typename Hash>
+	void ImportDirectory<bits>::computeImportHash(std::string& strHash, std::string* strUnorderedHash) const
+	{
+		strHash.clear();
+		if (strUnorderedHash) strUnorderedHash->clear();
+		if (m_oldDir.files.empty())
+		{
+			return;
+		}
+
+		Hash orderedHash;
+		typename Hash::Digest unorderedSum = {};
+		bool firstFunction = true;
+		char ordinalNumber[16];
+
+		for (const auto& file : m_oldDir.files)
+		{
+			const char* filename = m_oldDir.name(file.nameOffset);
+			std::size_t uiFilenameLengthFull = std::strlen(filename);
+			std::size_t uiFilenameLength = importHashFileNameLength(filename, uiFilenameLengthFull);
+
+			for (std::size_t j = 0; j < file.numberOfFt; j++)
+			{
+				std::size_t uiThunk = m_oldDir.functionThunk(file, j);
+				VAR4_8 ordinal = m_oldDir.thunks[uiThunk];
+
+				const char* funcname = m_oldDir.name(m_oldDir.nameOffsets[uiThunk]);
+				std::size_t uiFuncnameLength = std::strlen(funcname);
+				if (ordinal & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG)
+				{
+					// Well-known ordinals are hashed by their names, the rest as "ord<number>"
+					funcname = ordinalName(filename, uiFilenameLengthFull, ordinal);
+					if (funcname)
+					{
+						uiFuncnameLength = std::strlen(funcname);
+					}
+					else
+					{
+						int length = std::snprintf(ordinalNumber, sizeof(ordinalNumber), "ord%u", static_cast<unsigned int>(ordinal & 0xFFFF));
+						funcname = ordinalNumber;
+						uiFuncnameLength = static_cast<std::size_t>(length);
+					}
+				}
+
+				if (!firstFunction)
+				{
+					orderedHash.update(",", 1);
+				}
+				firstFunction = false;
+
+				updateLowerCase(orderedHash, filename, uiFilenameLength);
+				orderedHash.update(".", 1);
+				updateLowerCase(orderedHash, funcname, uiFuncnameLength);
+
+				if (strUnorderedHash)
+				{
+					Hash functionHash;
+					updateLowerCase(functionHash, filename, uiFilenameLength);
+					functionHash.update(".", 1);
+					updateLowerCase(functionHash, funcname, uiFuncnameLength);
+
+					// Add the digest as a big endian number, the carry out of the top byte is dropped
+					typename Hash::Digest functionDigest = functionHash.digest();
+					unsigned int carry = 0;
+					for (std::size_t i = Hash::DIGEST_SIZE; i-- > 0;)
+					{
+						carry += unorderedSum[i] + functionDigest[i];
+						unorderedSum[i] = static_cast<unsigned char>(carry);
+						carry >>= 8;
+					}
+				}
+			}
+		}
+
+		typename Hash::Digest orderedDigest = orderedHash.digest();
+		strHash = toHexString(orderedDigest.data(), orderedDigest.size());
+		if (strUnorderedHash) *strUnorderedHash = toHexString(unorderedSum.data(), unorderedSum.size());
+	}
+
+	/**
+	* @param filename Name of the imported file.
+	* @param size Length of the name.
+	* @param thunk Thunk of the function.
+	* @return Name of the function, nullptr if the thunk is not an ordinal or the ordinal is not known.
+	**/
+	template<int bits>
+	const char* ImportDirectory<bits>::ordinalName(const char* filename, std::size_t size, VAR4_8 thunk)
+	{
+		if (!(thunk & PELIB_IMAGE_ORDINAL_FLAGS<bits>::PELIB_IMAGE_ORDINAL_FLAG))
+		{
+			return nullptr;
+		}
+
+		return getOrdinalName(filename, size, static_cast<word>(thunk & 0xFFFF));
+	}
+
+	/**
+	* @param filename Name of an imported file.
+	* @param size Length of the name.
+	* @return Length of the name without the extension if the extension is .dll, .ocx or .sys.
+	**/
+	template<int bits>
+	std::size_t ImportDirectory<bits>::importHashFileNameLength(const char* filename, std::size_t size)
+	{
+		// Only a dot followed by exactly three characters can start one of the extensions
+		if (size < 4 || filename[size - 4] != '.' || std::memchr(filename + size - 3, '.', 3) != nullptr)
+		{
+			return size;
+		}
+
+		std::size_t uiDot = size - 4;
+		char extension[3];
+		for (std::size_t i = 0; i < 3; i++)
+		{
+			char c = filename[uiDot + 1 + i];
+			extension[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+
+		if (!std::memcmp(extension, "dll", 3) || !std::memcmp(extension, "ocx", 3) || !std::memcmp(extension, "sys", 3))
+		{
+			return uiDot;
+		}
+
+		return size;
+	}
+
+	/**
+	* @param hash Digest to update.
+	* @param data Characters to hash.
+	* @param size Number of the characters.
+	**/
+	template<int bits>
+	template<typename Hash>
+	void ImportDirectory<bits>::updateLowerCase(Hash& hash, const char* data, std::size_t size)
+	{
+		char buffer[64];
+
+		while (size > 0)
+		{
+			std::size_t uiChunk = std::min(size, sizeof(buffer));
+			for (std::size_t i = 0; i < uiChunk; i++)
+			{
+				buffer[i] = (data[i] >= 'A' && data[i] <= 'Z') ? static_cast<char>(data[i] - 'A' + 'a') : data[i];
+			}
+
+			hash.update(buffer, uiChunk);
+			data += uiChunk;
+			size -= uiChunk;
+		}
+	}
+
 	typedef ImportDirectory<32> ImportDirectory32;
 	typedef ImportDirectory<64> ImportDirectory64;
 }
@@ -16,20 +16,30 @@
 #include <vector>
 #include <iterator>
 #include <cassert>
+#include <cstring>
 
 namespace PeLib
 {
+	/**
+	* Read cursor over a block of constant memory. Values are decoded in place,
+	* reads beyond the end of the block yield zero bytes.
+	**/
 	class InputBuffer
 	{
 		private:
-		  std::vector<unsigned char>& m_vBuffer;
+		  const unsigned char* m_data;
+		  unsigned long m_size;
+		  std::vector<unsigned char>* m_pvBuffer; ///< Wrapped vector, if the buffer was constructed from one.
 		  unsigned long ulIndex;
 
 		public:
 		  InputBuffer(std::vector<unsigned char>& vBuffer);
+		  InputBuffer(const unsigned char* data, unsigned long size);
 
 		  const unsigned char* data() const;
 		  unsigned long size();
+		  /// Returns the number of bytes between the current position and the end of the buffer.
+		  unsigned long remaining() const;
 
 		  template<typename T>
 		  InputBuffer& operator>>(T& value)
@@ -37,10 +47,25 @@ namespace PeLib
 //jk: temporarily disabled because of fails on 64bit systems
 //			assert(ulIndex + sizeof(value) <= m_vBuffer.size());
 
-			std::vector<char> data(sizeof(T), 0);
-			std::size_t size = ulIndex + sizeof(T) > m_vBuffer.size() ? m_vBuffer.size() - ulIndex : sizeof(T);
-			read(data.data(), (unsigned long)size);
-			value = *reinterpret_cast<T*>(data.data());
+			if (ulIndex <= m_size && sizeof(T) <= m_size - ulIndex)
+			{
+				std::memcpy(&value, m_data + ulIndex, sizeof(T));
+				ulIndex += sizeof(T);
+			}
+			else
+			{
+				std::memset(&value, 0, sizeof(T));
+				read(reinterpret_cast<char*>(&value), sizeof(T));
+			}
+			return *this;
+		  }
+
+		  /// Reads an array of values at once, missing trailing values are zeroed.
+		  template<typename T>
+		  InputBuffer& readArray(T* values, std::size_t count)
+		  {
+			std::memset(values, 0, count * sizeof(T));
+			read(reinterpret_cast<char*>(values), static_cast<unsigned long>(count * sizeof(T)));
 			return *this;
 		  }
 
@@ -50,6 +75,7 @@ namespace PeLib
 		  void move(unsigned long shift);
 		  unsigned long get();
 		  void setBuffer(std::vector<unsigned char>& vBuffer);
+		  void setBuffer(const unsigned char* data, unsigned long size);
 //		  void updateData(unsigned long ulIndex,
 	};
 }
@@ -0,0 +1,30 @@
+/**
+ * @file OrdinalNames.h
+ * @brief Names of the functions which well-known files export by ordinal only.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef ORDINAL_NAMES_H
+#define ORDINAL_NAMES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace PeLib
+{
+	/**
+	 * Returns the name of a function which a well-known file (ws2_32.dll, wsock32.dll, oleaut32.dll)
+	 * exports by the ordinal. The names come from tables compiled into the library, so the lookup
+	 * never allocates. The file name is compared case-insensitively and must include the extension.
+	 * @param filename Name of the imported file.
+	 * @param size Length of the name.
+	 * @param ordinal Ordinal of the function.
+	 * @return Name of the function, nullptr if the file or the ordinal is not known.
+	 */
+	const char* getOrdinalName(const char* filename, std::size_t size, std::uint16_t ordinal);
+	/// Returns the name of a function which a well-known file exports by the ordinal, nullptr if it is not known.
+	const char* getOrdinalName(const std::string& filename, std::uint16_t ordinal);
+}
+
+#endif
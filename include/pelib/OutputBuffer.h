@@ -32,12 +32,14 @@ namespace PeLib
 		  OutputBuffer& operator<<(const T& value)
 		  {
 			const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
-			std::copy(p, p + sizeof(value), std::back_inserter(m_vBuffer));
+			m_vBuffer.insert(m_vBuffer.end(), p, p + sizeof(value));
 			return *this;
 		  }
 		  void add(const char* lpBuffer, unsigned long ulSize);
 		  void reset();
 		  void resize(unsigned int uiSize);
+		  /// Allocates space for the given total size, so that adding data up to it does not reallocate.
+		  void reserve(unsigned long ulSize);
 		  void set(unsigned int uiPosition);
 
 		  template<typename T>
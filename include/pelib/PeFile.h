@@ -13,7 +13,15 @@
 #ifndef PEFILE_H
 #define PEFILE_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
 #include "pelib/PeLibInc.h"
+#include "pelib/ByteSource.h"
 #include "pelib/MzHeader.h"
 #include "pelib/PeHeader.h"
 #include "pelib/ImportDirectory.h"
@@ -29,6 +37,7 @@
 #include "pelib/CoffSymbolTable.h"
 #include "pelib/DelayImportDirectory.h"
 #include "pelib/SecurityDirectory.h"
+#include "pelib/TaskExecutor.h"
 
 namespace PeLib
 {
@@ -46,6 +55,38 @@ namespace PeLib
 		  virtual ~PeFileVisitor(){}
 	};
 
+	/**
+	* Parts of a PE file which can be requested from PeFile::readAll. The MZ and PE headers
+	* are always read.
+	**/
+	enum PeReadFlags
+	{
+		PELIB_READ_RICH_HEADER = 0x0001,
+		PELIB_READ_COFF_SYMBOL_TABLE = 0x0002,
+		PELIB_READ_EXPORTS = 0x0004,
+		PELIB_READ_IMPORTS = 0x0008,
+		PELIB_READ_RESOURCES = 0x0010,
+		PELIB_READ_SECURITY = 0x0020,
+		PELIB_READ_RELOCATIONS = 0x0040,
+		PELIB_READ_DEBUG = 0x0080,
+		PELIB_READ_TLS = 0x0100,
+		PELIB_READ_BOUND_IMPORTS = 0x0200,
+		PELIB_READ_IAT = 0x0400,
+		PELIB_READ_DELAY_IMPORTS = 0x0800,
+		PELIB_READ_COM_HEADER = 0x1000,
+		PELIB_READ_ALL = 0x1FFF
+	};
+
+	/**
+	* State of a part of a PE file, see PeReadFlags.
+	**/
+	enum PeReadStatus
+	{
+		PELIB_READ_STATUS_NOT_READ, ///< The part was neither read nor requested.
+		PELIB_READ_STATUS_DEFERRED, ///< The part will be read when it is first accessed.
+		PELIB_READ_STATUS_READ ///< The part was read, see PeFile::readResult.
+	};
+
 	/**
 	* Traits class that's used to decide of what type the PeHeader in a PeFile is.
 	**/
@@ -75,6 +116,9 @@ namespace PeLib
 		  RichHeader m_richheader; ///< Rich header of the current file.
 		  CoffSymbolTable m_coffsymtab; ///< Symbol table of the current file.
 		  SecurityDirectory m_secdir; ///< Security directory of the current file.
+
+		  /// Reads a part (one of PeReadFlags) of the current file if its reading was deferred.
+		  virtual void readDeferredPart(std::uint32_t part) const = 0;
 		public:
 		  virtual ~PeFile();
 
@@ -82,6 +126,8 @@ namespace PeLib
 		  virtual std::string getFileName() const = 0; // EXPORT
 		  /// Changes the name of the current file.
 		  virtual void setFileName(std::string strFilename) = 0; // EXPORT
+		  /// Interns the names of delay imported and exported functions read later in the pool.
+		  virtual void setStringPool(StringPool* pool) = 0; // EXPORT
 
 		  virtual void visit(PeFileVisitor &v) = 0;
 
@@ -115,6 +161,16 @@ namespace PeLib
 		  virtual int readDelayImportDirectory() = 0; // EXPORT
 		  /// Reads security directory of the current file.
 		  virtual int readSecurityDirectory() = 0; // EXPORT
+		  /// Reads the headers and the requested parts of the current file in one pass over the file.
+		  virtual int readAll(std::uint32_t flags = PELIB_READ_ALL) = 0; // EXPORT
+		  /// Same as readAll(flags), parses the requested parts in parallel using the executor.
+		  virtual int readAll(std::uint32_t flags, TaskExecutor& executor) = 0; // EXPORT
+		  /// Reads the headers of the current file, the requested parts are read when first accessed.
+		  virtual int readLazy(std::uint32_t flags = PELIB_READ_ALL) = 0; // EXPORT
+		  /// Returns whether a part of the current file was read or is deferred.
+		  virtual PeReadStatus readStatus(std::uint32_t part) const = 0;
+		  /// Returns the result of reading of a part of the current file.
+		  virtual int readResult(std::uint32_t part) const = 0;
 		  /// Returns a loader error, if there was any
 		  virtual LoaderError loaderError() const = 0;
 
@@ -151,7 +207,9 @@ namespace PeLib
 
 		private:
 	      std::ifstream m_ifStream;
-	      std::istream& m_iStream;
+	      std::shared_ptr<ByteSource> m_source; ///< Byte source of the current file, if any, shared with the resource leaves.
+	      std::unique_ptr<ByteSourceStream> m_sourceStream; ///< Stream over m_source used by the readers.
+	      std::istream* m_iStream; ///< Stream the current file is read from.
 
 		  PeHeader32_64 m_peh; ///< PE header of the current file.
 		  ExportDirectoryT<bits> m_expdir; ///< Export directory of the current file.
@@ -165,6 +223,65 @@ namespace PeLib
 		  DelayImportDirectory<bits> m_delayimpdir; ///< Delay import directory of the current file.
 		  TlsDirectory<bits> m_tlsdir; ///< TLS directory of the current file.
 
+		  bool m_headersRead = false; ///< The MZ and PE headers were read since the last change of the file.
+		  std::atomic<std::uint32_t> m_readParts{0}; ///< Parts which were read, see PeReadFlags.
+		  std::atomic<std::uint32_t> m_deferredParts{0}; ///< Parts which are read on first access.
+		  int m_partResults[13]; ///< Results of reading of the parts, indexed by bit of PeReadFlags.
+		  mutable std::mutex m_deferredMutex; ///< Serializes reading of the deferred parts.
+
+		  /// One step of readAll, the part of the file and the file range it starts reading from.
+		  struct ReadPlanEntry
+		  {
+			  std::uint32_t part;
+			  std::uint64_t offset;
+			  std::uint64_t size;
+		  };
+
+		  /// Progress of a parallel readAll, shared by the tasks which read the planned parts.
+		  struct ParallelReadState
+		  {
+			  PeFileT* file;
+			  const ByteSource* source;
+			  std::vector<ReadPlanEntry> plan;
+			  std::vector<int> results;
+			  std::atomic<std::size_t> nextPart;
+			  std::size_t finishedParts;
+			  std::mutex mutex;
+			  std::condition_variable finished;
+		  };
+
+		  /// Reads the MZ and PE headers if they were not read yet.
+		  int readHeaders();
+		  /// Orders the requested parts of the file by the file offset of their data.
+		  std::vector<ReadPlanEntry> buildReadPlan(std::uint32_t flags) const;
+		  /// Returns an in-memory view of the file data the planned parts read from.
+		  const ByteSource* prepareReadSource(const std::vector<ReadPlanEntry>& plan, std::unique_ptr<ByteSource>& streamSource, std::unique_ptr<PrefetchByteSource>& prefetchSource);
+		  /// Reads one part of the file (one of PeReadFlags) from the given stream.
+		  int readPart(std::uint32_t part, std::istream& stream);
+		  /// Remembers the result of reading of a part of the file.
+		  void recordPartResult(std::uint32_t part, int result);
+		  /// Returns the index of a part of the file in m_partResults.
+		  static std::size_t partIndex(std::uint32_t part);
+		  void readDeferredPart(std::uint32_t part) const override;
+		  /// Reads parts of a parallel readAll until no unclaimed part is left.
+		  static void readClaimedParts(ParallelReadState& state);
+		  /// Combines the results of the planned parts into the result of readAll.
+		  static int combinePartResults(const std::vector<int>& results);
+
+		  int readRichHeader(std::istream& stream, std::size_t offset, std::size_t size, bool ignoreInvalidKey);
+		  int readCoffSymbolTable(std::istream& stream);
+		  int readExportDirectory(std::istream& stream);
+		  int readImportDirectory(std::istream& stream);
+		  int readResourceDirectory(std::istream& stream);
+		  int readSecurityDirectory(std::istream& stream);
+		  int readRelocationsDirectory(std::istream& stream);
+		  int readDebugDirectory(std::istream& stream);
+		  int readTlsDirectory(std::istream& stream);
+		  int readBoundImportDirectory(std::istream& stream);
+		  int readIatDirectory(std::istream& stream);
+		  int readDelayImportDirectory(std::istream& stream);
+		  int readComHeaderDirectory(std::istream& stream);
+
 		public:
 		  /// Default constructor which exists only for the sake of allowing to construct files without filenames.
 		  PeFileT();
@@ -174,11 +291,18 @@ namespace PeLib
 		  /// Initializes a PeFile with a filename
 		  explicit PeFileT(const std::string& strFilename);
 		  PeFileT(std::istream& stream);
+		  /// Initializes a PeFile with a byte source (mapped file, memory span, file descriptor, ...)
+		  explicit PeFileT(std::unique_ptr<ByteSource> source, const std::string& strFilename = "");
+
+		  /// Returns the byte source of the current file or nullptr if the file is read from a stream.
+		  const ByteSource* byteSource() const;
 
 		  /// Returns the name of the current file.
 		  std::string getFileName() const;
 		  /// Changes the name of the current file.
 		  void setFileName(std::string strFilename);
+		  /// Interns the names of delay imported and exported functions read later in the pool.
+		  void setStringPool(StringPool* pool) override;
 
 		  /// Reads the MZ header of the current file from disc.
 		  int readMzHeader() ;
@@ -210,11 +334,21 @@ namespace PeLib
 		  int readDelayImportDirectory() ;
 		  /// Reads the security directory of the current file.
 		  int readSecurityDirectory() ;
+		  /// Reads the headers and the requested parts of the current file in one pass over the file.
+		  int readAll(std::uint32_t flags = PELIB_READ_ALL);
+		  /// Same as readAll(flags), parses the requested parts in parallel using the executor.
+		  int readAll(std::uint32_t flags, TaskExecutor& executor);
+		  /// Reads the headers of the current file, the requested parts are read when first accessed.
+		  int readLazy(std::uint32_t flags = PELIB_READ_ALL);
+		  /// Returns whether a part of the current file was read or is deferred.
+		  PeReadStatus readStatus(std::uint32_t part) const;
+		  /// Returns the result of reading of a part of the current file.
+		  int readResult(std::uint32_t part) const;
 
 		  /// Checks the entry point code
 		  LoaderError checkEntryPointErrors() const;
 
-		  /// Returns a loader error, if there was any
+		  /// Returns a loader error, if there was any, reading the deferred parts which may cause one
 		  LoaderError loaderError() const;
 
 		  unsigned int getBits() const
@@ -290,6 +424,7 @@ namespace PeLib
 		  /// Initializes a PeFile with a filename
 		  explicit PeFile32(const std::string& strFlename);
 		  PeFile32(std::istream& stream);
+		  explicit PeFile32(std::unique_ptr<ByteSource> source, const std::string& strFilename = "");
 		  virtual void visit(PeFileVisitor &v) { v.callback( *this ); }
 	};
 
@@ -305,6 +440,7 @@ namespace PeLib
 		  /// Initializes a PeFile with a filename
 		  explicit PeFile64(const std::string& strFlename);
 		  PeFile64(std::istream& stream);
+		  explicit PeFile64(std::unique_ptr<ByteSource> source, const std::string& strFilename = "");
 		  virtual void visit(PeFileVisitor &v) { v.callback( *this ); }
 	};
 
@@ -316,7 +452,7 @@ namespace PeLib
 	**/
 	template<int bits>
 	PeFileT<bits>::PeFileT(const std::string& strFilename) :
-			m_iStream(m_ifStream)
+			m_iStream(&m_ifStream)
 	{
 		m_filename = strFilename;
 		m_ifStream.open(m_filename, std::ifstream::binary);
@@ -327,20 +463,57 @@ namespace PeLib
 	**/
 	template<int bits>
 	PeFileT<bits>::PeFileT(std::istream& stream) :
-			m_iStream(stream)
+			m_iStream(&stream)
 	{
  	}
 
+	/**
+	* @param source Byte source the file is read from.
+	* @param strFilename Name of the file, if the source comes from one.
+	**/
+	template<int bits>
+	PeFileT<bits>::PeFileT(std::unique_ptr<ByteSource> source, const std::string& strFilename) :
+			m_source(std::move(source)),
+			m_sourceStream(m_source ? new ByteSourceStream(*m_source) : nullptr),
+			m_iStream(m_sourceStream ? static_cast<std::istream*>(m_sourceStream.get()) : &m_ifStream)
+	{
+		m_filename = strFilename;
+	}
+
 	template<int bits>
 	PeFileT<bits>::PeFileT() :
-			m_iStream(m_ifStream)
+			m_iStream(&m_ifStream)
 	{
 	}
 
+	template<int bits>
+	const ByteSource* PeFileT<bits>::byteSource() const
+	{
+		return m_source.get();
+	}
+
 	template<int bits>
 	int PeFileT<bits>::readPeHeader()
 	{
-		return peHeader().read(m_iStream, mzHeader().getAddressOfPeHeader(), mzHeader());
+		int result = peHeader().read(*m_iStream, mzHeader().getAddressOfPeHeader(), mzHeader());
+		m_headersRead = (result == ERROR_NONE);
+		return result;
+	}
+
+	/**
+	* Reads the MZ and PE headers unless they have been read already, e.g. by openPeFile.
+	**/
+	template<int bits>
+	int PeFileT<bits>::readHeaders()
+	{
+		if (m_headersRead)
+			return ERROR_NONE;
+
+		int result = readMzHeader();
+		if (result != ERROR_NONE)
+			return result;
+
+		return readPeHeader();
 	}
 
 	/**
@@ -367,6 +540,7 @@ namespace PeLib
 	template<int bits>
 	const ImportDirectory<bits>& PeFileT<bits>::impDir() const
 	{
+		readDeferredPart(PELIB_READ_IMPORTS);
 		return m_impdir;
 	}
 
@@ -376,18 +550,21 @@ namespace PeLib
 	template<int bits>
 	ImportDirectory<bits>& PeFileT<bits>::impDir()
 	{
+		readDeferredPart(PELIB_READ_IMPORTS);
 		return m_impdir;
 	}
 
 	template<int bits>
 	const TlsDirectory<bits>& PeFileT<bits>::tlsDir() const
 	{
+		readDeferredPart(PELIB_READ_TLS);
 		return m_tlsdir;
 	}
 
 	template<int bits>
 	TlsDirectory<bits>& PeFileT<bits>::tlsDir()
 	{
+		readDeferredPart(PELIB_READ_TLS);
 		return m_tlsdir;
 	}
 
@@ -397,6 +574,7 @@ namespace PeLib
 	template<int bits>
 	const DelayImportDirectory<bits>& PeFileT<bits>::delayImports() const
 	{
+		readDeferredPart(PELIB_READ_DELAY_IMPORTS);
 		return m_delayimpdir;
 	}
 
@@ -406,6 +584,7 @@ namespace PeLib
 	template<int bits>
 	DelayImportDirectory<bits>& PeFileT<bits>::delayImports()
 	{
+		readDeferredPart(PELIB_READ_DELAY_IMPORTS);
 		return m_delayimpdir;
 	}
 
@@ -415,6 +594,7 @@ namespace PeLib
 	template <int bits>
 	const ExportDirectoryT<bits>& PeFileT<bits>::expDir() const
 	{
+		readDeferredPart(PELIB_READ_EXPORTS);
 		return m_expdir;
 	}
 
@@ -424,6 +604,7 @@ namespace PeLib
 	template <int bits>
 	ExportDirectoryT<bits>& PeFileT<bits>::expDir()
 	{
+		readDeferredPart(PELIB_READ_EXPORTS);
 		return m_expdir;
 	}
 
@@ -433,6 +614,7 @@ namespace PeLib
 	template <int bits>
 	const BoundImportDirectoryT<bits>& PeFileT<bits>::boundImpDir() const
 	{
+		readDeferredPart(PELIB_READ_BOUND_IMPORTS);
 		return m_boundimpdir;
 	}
 
@@ -442,6 +624,7 @@ namespace PeLib
 	template <int bits>
 	BoundImportDirectoryT<bits>& PeFileT<bits>::boundImpDir()
 	{
+		readDeferredPart(PELIB_READ_BOUND_IMPORTS);
 		return m_boundimpdir;
 	}
 
@@ -451,6 +634,7 @@ namespace PeLib
 	template <int bits>
 	const ResourceDirectoryT<bits>& PeFileT<bits>::resDir() const
 	{
+		readDeferredPart(PELIB_READ_RESOURCES);
 		return m_resdir;
 	}
 
@@ -460,6 +644,7 @@ namespace PeLib
 	template <int bits>
 	ResourceDirectoryT<bits>& PeFileT<bits>::resDir()
 	{
+		readDeferredPart(PELIB_READ_RESOURCES);
 		return m_resdir;
 	}
 
@@ -469,6 +654,7 @@ namespace PeLib
 	template <int bits>
 	const RelocationsDirectoryT<bits>& PeFileT<bits>::relocDir() const
 	{
+		readDeferredPart(PELIB_READ_RELOCATIONS);
 		return m_relocs;
 	}
 
@@ -478,6 +664,7 @@ namespace PeLib
 	template <int bits>
 	RelocationsDirectoryT<bits>& PeFileT<bits>::relocDir()
 	{
+		readDeferredPart(PELIB_READ_RELOCATIONS);
 		return m_relocs;
 	}
 
@@ -487,6 +674,7 @@ namespace PeLib
 	template <int bits>
 	const ComHeaderDirectoryT<bits>& PeFileT<bits>::comDir() const
 	{
+		readDeferredPart(PELIB_READ_COM_HEADER);
 		return m_comdesc;
 	}
 
@@ -496,30 +684,35 @@ namespace PeLib
 	template <int bits>
 	ComHeaderDirectoryT<bits>& PeFileT<bits>::comDir()
 	{
+		readDeferredPart(PELIB_READ_COM_HEADER);
 		return m_comdesc;
 	}
 
 	template <int bits>
 	const IatDirectoryT<bits>& PeFileT<bits>::iatDir() const
 	{
+		readDeferredPart(PELIB_READ_IAT);
 		return m_iat;
 	}
 
 	template <int bits>
 	IatDirectoryT<bits>& PeFileT<bits>::iatDir()
 	{
+		readDeferredPart(PELIB_READ_IAT);
 		return m_iat;
 	}
 
 	template <int bits>
 	const DebugDirectoryT<bits>& PeFileT<bits>::debugDir() const
 	{
+		readDeferredPart(PELIB_READ_DEBUG);
 		return m_debugdir;
 	}
 
 	template <int bits>
 	DebugDirectoryT<bits>& PeFileT<bits>::debugDir()
 	{
+		readDeferredPart(PELIB_READ_DEBUG);
 		return m_debugdir;
 	}
 
@@ -533,42 +726,103 @@ namespace PeLib
 	}
 
 	/**
+	* Makes the file read from the file of the given name. A file which was read from a byte
+	* source reads the new file memory mapped, otherwise the new file is read as a stream.
+	* The parts read from the old file count as not read, and no part is deferred anymore.
 	* @param strFilename New filename.
 	**/
 	template<int bits>
 	void PeFileT<bits>::setFileName(std::string strFilename)
 	{
 		m_filename = strFilename;
+		m_headersRead = false;
+
+		// Nothing of the new file is read yet
+		m_readParts = 0;
+		m_deferredParts = 0;
+		std::fill(std::begin(m_partResults), std::end(m_partResults), ERROR_NONE);
 		if (m_ifStream.is_open())
 		{
 			m_ifStream.close();
 		}
-		m_ifStream.open(m_filename, std::ifstream::binary);
+
+		bool bMapped = false;
+		if (m_source)
+		{
+			std::unique_ptr<MappedFileByteSource> source(new MappedFileByteSource(m_filename));
+			bMapped = source->isOpen() && source->size() != 0;
+			m_sourceStream.reset();
+			m_source.reset(bMapped ? source.release() : nullptr);
+		}
+
+		if (bMapped)
+		{
+			m_sourceStream.reset(new ByteSourceStream(*m_source));
+			m_iStream = m_sourceStream.get();
+		}
+		else
+		{
+			m_ifStream.open(m_filename, std::ifstream::binary);
+			m_iStream = &m_ifStream;
+		}
+	}
+
+	/**
+	* The delay import and export directories read after this call intern their names in the
+	* pool. Files read with the same pool share the storage of equal names, which saves memory
+	* when many files are kept. The pool must outlive the file. The import directory keeps its
+	* names in a blob of its own.
+	* @param pool Pool to intern the names in, or nullptr to let every name own its storage.
+	**/
+	template<int bits>
+	void PeFileT<bits>::setStringPool(StringPool* pool)
+	{
+		m_delayimpdir.setStringPool(pool);
+		m_expdir.setStringPool(pool);
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readMzHeader()
 	{
-		return mzHeader().read(m_iStream);
+		m_headersRead = false;
+		return mzHeader().read(*m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readRichHeader(
+			std::size_t offset,
+			std::size_t size,
+			bool ignoreInvalidKey)
+	{
+		int result = readRichHeader(*m_iStream, offset, size, ignoreInvalidKey);
+		recordPartResult(PELIB_READ_RICH_HEADER, result);
+		return result;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readRichHeader(
+			std::istream& stream,
 			std::size_t offset,
 			std::size_t size,
 			bool ignoreInvalidKey)
 	{
-		return richHeader().read(m_iStream, offset, size, ignoreInvalidKey);
+		return m_richheader.read(stream, offset, size, ignoreInvalidKey);
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readCoffSymbolTable()
+	{
+		return readPart(PELIB_READ_COFF_SYMBOL_TABLE, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readCoffSymbolTable(std::istream& stream)
 	{
 		if (peHeader().getPointerToSymbolTable()
 				&& peHeader().getNumberOfSymbols())
 		{
-			return coffSymTab().read(
-					m_iStream,
+			return m_coffsymtab.read(
+					stream,
 					static_cast<unsigned int>(peHeader().getPointerToSymbolTable()),
 					peHeader().getNumberOfSymbols() * PELIB_IMAGE_SIZEOF_COFF_SYMBOL);
 		}
@@ -577,46 +831,72 @@ namespace PeLib
 
 	template<int bits>
 	int PeFileT<bits>::readExportDirectory()
+	{
+		return readPart(PELIB_READ_EXPORTS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readExportDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 1
 			&& peHeader().getIddExportRva())
 		{
-			return expDir().read(m_iStream, peHeader());
+			return m_expdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readImportDirectory()
+	{
+		return readPart(PELIB_READ_IMPORTS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readImportDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 2
 			&& peHeader().getIddImportRva())
 		{
-			return impDir().read(m_iStream, peHeader());
+			return m_impdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readResourceDirectory()
+	{
+		return readPart(PELIB_READ_RESOURCES, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readResourceDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 3
 			&& peHeader().getIddResourceRva())
 		{
-			return resDir().read(m_iStream, peHeader());
+			// The data of the resources are read from the source of the file when they are needed
+			m_resdir.setDataSource(m_source);
+			return m_resdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readSecurityDirectory()
+	{
+		return readPart(PELIB_READ_SECURITY, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readSecurityDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 5
 			&& peHeader().getIddSecurityRva()
 			&& peHeader().getIddSecuritySize())
 		{
-			return securityDir().read(
-					m_iStream,
+			return m_secdir.read(
+					stream,
 					peHeader().getIddSecurityRva(),
 					peHeader().getIddSecuritySize());
 		}
@@ -625,81 +905,496 @@ namespace PeLib
 
 	template<int bits>
 	int PeFileT<bits>::readRelocationsDirectory()
+	{
+		return readPart(PELIB_READ_RELOCATIONS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readRelocationsDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 6
 			&& peHeader().getIddBaseRelocRva() && peHeader().getIddBaseRelocSize())
 		{
-			return relocDir().read(m_iStream, peHeader());
+			return m_relocs.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readDebugDirectory()
+	{
+		return readPart(PELIB_READ_DEBUG, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readDebugDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 7
 			&& peHeader().getIddDebugRva() && peHeader().getIddDebugSize())
 		{
-			return debugDir().read(m_iStream, peHeader());
+			return m_debugdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readTlsDirectory()
+	{
+		return readPart(PELIB_READ_TLS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readTlsDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 10
 			&& peHeader().getIddTlsRva() && peHeader().getIddTlsSize())
 		{
-			return tlsDir().read(m_iStream, peHeader());
+			return m_tlsdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readBoundImportDirectory()
+	{
+		return readPart(PELIB_READ_BOUND_IMPORTS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readBoundImportDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 12
 			&& peHeader().getIddBoundImportRva() && peHeader().getIddBoundImportSize())
 		{
-			return boundImpDir().read(m_iStream, peHeader());
+			return m_boundimpdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readIatDirectory()
+	{
+		return readPart(PELIB_READ_IAT, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readIatDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 13
 			&& peHeader().getIddIatRva() && peHeader().getIddIatSize())
 		{
-			return iatDir().read(m_iStream, peHeader());
+			return m_iat.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readDelayImportDirectory()
+	{
+		return readPart(PELIB_READ_DELAY_IMPORTS, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readDelayImportDirectory(std::istream& stream)
 	{
 		// Note: Delay imports can have arbitrary size and Windows loader will still load them
 		if (peHeader().calcNumberOfRvaAndSizes() >= 14 && peHeader().getIddDelayImportRva() /* && peHeader().getIddDelayImportSize() */)
 		{
-			return delayImports().read(m_iStream, peHeader());
+			return m_delayimpdir.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
 	template<int bits>
 	int PeFileT<bits>::readComHeaderDirectory()
+	{
+		return readPart(PELIB_READ_COM_HEADER, *m_iStream);
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readComHeaderDirectory(std::istream& stream)
 	{
 		if (peHeader().calcNumberOfRvaAndSizes() >= 15
 			&& peHeader().getIddComHeaderRva() && peHeader().getIddComHeaderSize())
 		{
-			return comDir().read(m_iStream, peHeader());
+			return m_comdesc.read(stream, peHeader());
 		}
 		return ERROR_DIRECTORY_DOES_NOT_EXIST;
 	}
 
+	/**
+	* Works out where the data of every requested part of the file starts and how far it reaches.
+	* Directories are assumed to extend up to the end of the raw data of their section, because
+	* that is where the names, thunks and resource data they refer to usually are.
+	* @param flags Requested parts of the file, combination of PeReadFlags.
+	* @return Requested parts sorted by file offset. Parts with unknown range come last with zero size.
+	**/
+	template<int bits>
+	std::vector<typename PeFileT<bits>::ReadPlanEntry> PeFileT<bits>::buildReadPlan(std::uint32_t flags) const
+	{
+		// Do not read ahead more than this from a single directory
+		const std::uint64_t maxRangeSize = 0x4000000;
+
+		const std::uint64_t unknownOffset = std::numeric_limits<std::uint64_t>::max();
+		const std::uint32_t directoryParts[] =
+		{
+			PELIB_READ_EXPORTS, PELIB_READ_IMPORTS, PELIB_READ_RESOURCES, 0,
+			PELIB_READ_SECURITY, PELIB_READ_RELOCATIONS, PELIB_READ_DEBUG, 0,
+			0, PELIB_READ_TLS, 0, PELIB_READ_BOUND_IMPORTS,
+			PELIB_READ_IAT, PELIB_READ_DELAY_IMPORTS, PELIB_READ_COM_HEADER
+		};
+
+		std::vector<ReadPlanEntry> plan;
+
+		if (flags & PELIB_READ_RICH_HEADER)
+		{
+			std::uint64_t peHeaderOffset = mzHeader().getAddressOfPeHeader();
+			if (peHeaderOffset > PELIB_IMAGE_DOS_HEADER::size())
+				plan.push_back({PELIB_READ_RICH_HEADER, PELIB_IMAGE_DOS_HEADER::size(), peHeaderOffset - PELIB_IMAGE_DOS_HEADER::size()});
+		}
+
+		if (flags & PELIB_READ_COFF_SYMBOL_TABLE)
+		{
+			std::uint64_t symbolTableSize = std::uint64_t(peHeader().getNumberOfSymbols()) * PELIB_IMAGE_SIZEOF_COFF_SYMBOL;
+			if (peHeader().getPointerToSymbolTable() && symbolTableSize)
+				plan.push_back({PELIB_READ_COFF_SYMBOL_TABLE, peHeader().getPointerToSymbolTable(), symbolTableSize});
+			else
+				plan.push_back({PELIB_READ_COFF_SYMBOL_TABLE, unknownOffset, 0});
+		}
+
+		for (std::size_t i = 0; i < sizeof(directoryParts) / sizeof(directoryParts[0]); i++)
+		{
+			if (!(flags & directoryParts[i]))
+				continue;
+
+			ReadPlanEntry entry = {directoryParts[i], unknownOffset, 0};
+			if (i < peHeader().calcNumberOfRvaAndSizes() && peHeader().getImageDataDirectoryRva(i))
+			{
+				dword rva = peHeader().getImageDataDirectoryRva(i);
+				std::uint64_t size = peHeader().getImageDataDirectorySize(i);
+
+				if (directoryParts[i] == PELIB_READ_SECURITY)
+				{
+					// The security directory is the only one which contains a file offset
+					entry.offset = rva;
+					entry.size = size;
+				}
+				else if (peHeader().rvaToOffset(rva) != std::numeric_limits<typename FieldSizes<bits>::VAR4_8>::max())
+				{
+					entry.offset = peHeader().rvaToOffset(rva);
+					entry.size = size;
+
+					word section = peHeader().getSectionWithRva(rva);
+					if (section != std::numeric_limits<word>::max())
+					{
+						std::uint64_t sectionEnd = std::uint64_t(peHeader().getPointerToRawData(section)) + peHeader().getSizeOfRawData(section);
+						if (sectionEnd > entry.offset)
+							entry.size = std::max(entry.size, sectionEnd - entry.offset);
+					}
+				}
+				entry.size = std::min(entry.size, maxRangeSize);
+			}
+			plan.push_back(entry);
+		}
+
+		std::stable_sort(plan.begin(), plan.end(), [](const ReadPlanEntry& a, const ReadPlanEntry& b) { return a.offset < b.offset; });
+		return plan;
+	}
+
+	template<int bits>
+	int PeFileT<bits>::readPart(std::uint32_t part, std::istream& stream)
+	{
+		int result = ERROR_DIRECTORY_DOES_NOT_EXIST;
+		switch (part)
+		{
+			case PELIB_READ_RICH_HEADER:
+				result = readRichHeader(
+						stream,
+						PELIB_IMAGE_DOS_HEADER::size(),
+						mzHeader().getAddressOfPeHeader() - PELIB_IMAGE_DOS_HEADER::size(),
+						false);
+				break;
+			case PELIB_READ_COFF_SYMBOL_TABLE: result = readCoffSymbolTable(stream); break;
+			case PELIB_READ_EXPORTS: result = readExportDirectory(stream); break;
+			case PELIB_READ_IMPORTS: result = readImportDirectory(stream); break;
+			case PELIB_READ_RESOURCES: result = readResourceDirectory(stream); break;
+			case PELIB_READ_SECURITY: result = readSecurityDirectory(stream); break;
+			case PELIB_READ_RELOCATIONS: result = readRelocationsDirectory(stream); break;
+			case PELIB_READ_DEBUG: result = readDebugDirectory(stream); break;
+			case PELIB_READ_TLS: result = readTlsDirectory(stream); break;
+			case PELIB_READ_BOUND_IMPORTS: result = readBoundImportDirectory(stream); break;
+			case PELIB_READ_IAT: result = readIatDirectory(stream); break;
+			case PELIB_READ_DELAY_IMPORTS: result = readDelayImportDirectory(stream); break;
+			case PELIB_READ_COM_HEADER: result = readComHeaderDirectory(stream); break;
+		}
+
+		recordPartResult(part, result);
+		return result;
+	}
+
+	/**
+	* Remembers the result of reading of a part and cancels its deferred reading, if any.
+	* Different parts may be recorded from different threads at once.
+	* @param part One of PeReadFlags.
+	* @param result Result of the read function.
+	**/
+	template<int bits>
+	void PeFileT<bits>::recordPartResult(std::uint32_t part, int result)
+	{
+		m_partResults[partIndex(part)] = result;
+		m_readParts |= part;
+		m_deferredParts &= ~part;
+	}
+
+	/**
+	* @param part One of PeReadFlags.
+	* @return Index of the part in m_partResults.
+	**/
+	template<int bits>
+	std::size_t PeFileT<bits>::partIndex(std::uint32_t part)
+	{
+		std::size_t index = 0;
+		while (part > 1)
+		{
+			part >>= 1;
+			index++;
+		}
+		return index;
+	}
+
+	/**
+	* Reads a part deferred by readLazy, unless it has been read already. Called by the accessor
+	* functions, so it may be called from several threads at once.
+	* @param part One of PeReadFlags.
+	**/
+	template<int bits>
+	void PeFileT<bits>::readDeferredPart(std::uint32_t part) const
+	{
+		if ((m_deferredParts.load(std::memory_order_acquire) & part) == 0)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_deferredMutex);
+		if (m_deferredParts & part)
+		{
+			// The part is read only once and its object is not handed out before that
+			const_cast<PeFileT*>(this)->readPart(part, *m_iStream);
+		}
+	}
+
+	/**
+	* Reads the MZ header and the PE header and defers reading of the requested parts until
+	* they are first accessed through the accessor functions (impDir(), resDir(), ...).
+	* The parts are read from the source of the file, which must stay available. Parts which
+	* were read before are not deferred, parts which are read explicitly before they are
+	* accessed are not read again.
+	* The rich header is searched for between the MZ and PE headers.
+	* @param flags Parts of the file to read on first access, combination of PeReadFlags.
+	* @return Error of the MZ or PE header, if any.
+	**/
+	template<int bits>
+	int PeFileT<bits>::readLazy(std::uint32_t flags)
+	{
+		int result = readHeaders();
+		if (result != ERROR_NONE)
+			return result;
+
+		// Parts which were read already keep their state, including the changes of the caller
+		m_deferredParts |= (flags & PELIB_READ_ALL & ~m_readParts);
+		return ERROR_NONE;
+	}
+
+	/**
+	* @param part One of PeReadFlags.
+	* @return Whether the part was read, is deferred until first access or was not requested.
+	**/
+	template<int bits>
+	PeReadStatus PeFileT<bits>::readStatus(std::uint32_t part) const
+	{
+		if (m_deferredParts & part)
+			return PELIB_READ_STATUS_DEFERRED;
+		else if (m_readParts & part)
+			return PELIB_READ_STATUS_READ;
+		return PELIB_READ_STATUS_NOT_READ;
+	}
+
+	/**
+	* @param part One of PeReadFlags.
+	* @return Result of the last reading of the part, ERROR_NONE if the part was not read.
+	**/
+	template<int bits>
+	int PeFileT<bits>::readResult(std::uint32_t part) const
+	{
+		return (m_readParts & part) ? m_partResults[partIndex(part)] : ERROR_NONE;
+	}
+
+	/**
+	* Makes the file ranges of the planned parts available for reading. Files which are in memory
+	* are read in place, the ranges of other files are read ahead in ascending offset order
+	* with as few sequential reads as possible. At most a few megabytes are read ahead,
+	* the ranges beyond that are read directly from the file when their parts are parsed.
+	* @param plan Planned parts of the file.
+	* @param streamSource Receives the source over the input stream if it has to be created.
+	* @param prefetchSource Receives the source with the prefetched ranges if it has to be created.
+	* @return Source the planned parts are read from. It remains valid as long as the two sources.
+	**/
+	template<int bits>
+	const ByteSource* PeFileT<bits>::prepareReadSource(
+			const std::vector<ReadPlanEntry>& plan,
+			std::unique_ptr<ByteSource>& streamSource,
+			std::unique_ptr<PrefetchByteSource>& prefetchSource)
+	{
+		// Ranges closer to each other than this are read at once
+		const std::uint64_t maxPrefetchGap = 0x10000;
+		// Do not read ahead more than this from a single file, the rest is read when it is parsed
+		const std::uint64_t maxPrefetchSize = 0x400000;
+
+		const ByteSource* source = getContiguousByteSource(*m_iStream);
+		if (source != nullptr)
+			return source;
+
+		source = m_source.get();
+		if (source == nullptr)
+		{
+			streamSource.reset(new StreamByteSource(*m_iStream));
+			source = streamSource.get();
+		}
+
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+		for (const auto& entry : plan)
+		{
+			if (entry.size)
+				ranges.emplace_back(entry.offset, entry.size);
+		}
+
+		prefetchSource.reset(new PrefetchByteSource(*source));
+		prefetchSource->prefetch(ranges, maxPrefetchGap, maxPrefetchSize);
+		return prefetchSource.get();
+	}
+
+	template<int bits>
+	int PeFileT<bits>::combinePartResults(const std::vector<int>& results)
+	{
+		for (int result : results)
+		{
+			if (result != ERROR_NONE && result != ERROR_DIRECTORY_DOES_NOT_EXIST && result != ERROR_COFF_SYMBOL_TABLE_DOES_NOT_EXIST)
+				return result;
+		}
+		return ERROR_NONE;
+	}
+
+	/**
+	* Reads the MZ header, the PE header and the requested parts of the file. The parts are read
+	* in ascending order of their file offsets and, if the file is not in memory, all their
+	* file ranges are read ahead first with as few sequential reads as possible. The resulting
+	* objects are the same as if the individual read functions were called.
+	* The rich header is searched for between the MZ and PE headers.
+	* @param flags Parts of the file to read, combination of PeReadFlags.
+	* @return Error of the MZ or PE header if any, otherwise the first error returned by reading
+	*         of the requested parts, not counting the parts which do not exist.
+	**/
+	template<int bits>
+	int PeFileT<bits>::readAll(std::uint32_t flags)
+	{
+		int result = readHeaders();
+		if (result != ERROR_NONE)
+			return result;
+
+		std::vector<ReadPlanEntry> plan = buildReadPlan(flags);
+
+		std::unique_ptr<ByteSource> streamSource;
+		std::unique_ptr<PrefetchByteSource> prefetchSource;
+		ByteSourceStream stream(*prepareReadSource(plan, streamSource, prefetchSource));
+
+		std::vector<int> results;
+		for (const auto& entry : plan)
+		{
+			results.push_back(readPart(entry.part, stream));
+		}
+
+		return combinePartResults(results);
+	}
+
+	/**
+	* Reads the MZ header, the PE header and the requested parts of the file like readAll(flags),
+	* but the parts are parsed concurrently. The headers are read on the calling thread, then
+	* the file ranges of the parts are made available in memory and shared by all the tasks,
+	* each of which reads through its own stream. The calling thread takes part in the parsing,
+	* so the call finishes even if the executor runs its tasks late or on the calling thread.
+	* @param flags Parts of the file to read, combination of PeReadFlags.
+	* @param executor Thread pool the parsing tasks are submitted to.
+	* @return The same as readAll(flags).
+	**/
+	template<int bits>
+	int PeFileT<bits>::readAll(std::uint32_t flags, TaskExecutor& executor)
+	{
+		int result = readHeaders();
+		if (result != ERROR_NONE)
+			return result;
+
+		// Tasks may outlive this call, the state they share is released by the last of them
+		auto state = std::make_shared<ParallelReadState>();
+		state->file = this;
+		state->plan = buildReadPlan(flags);
+		state->results.resize(state->plan.size(), ERROR_NONE);
+		state->nextPart = 0;
+		state->finishedParts = 0;
+
+		std::unique_ptr<ByteSource> streamSource;
+		std::unique_ptr<PrefetchByteSource> prefetchSource;
+		state->source = prepareReadSource(state->plan, streamSource, prefetchSource);
+
+		// The subtrees of the resource directory are read on the same executor
+		TaskExecutor* resDirExecutor = m_resdir.getTaskExecutor();
+		m_resdir.setTaskExecutor(&executor);
+
+		for (std::size_t i = 1; i < state->plan.size(); i++)
+		{
+			executor.execute([state]() { readClaimedParts(*state); });
+		}
+		readClaimedParts(*state);
+
+		// Wait for the parts which are still being read by the other tasks
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->finished.wait(lock, [&state]() { return state->finishedParts == state->plan.size(); });
+		}
+
+		m_resdir.setTaskExecutor(resDirExecutor);
+		return combinePartResults(state->results);
+	}
+
+	/**
+	* Claims the planned parts one by one and reads them through a stream of its own. Once all
+	* the parts are claimed, neither the file nor the source are touched anymore, as they
+	* may not exist by then.
+	* @param state Shared state of the parallel readAll.
+	**/
+	template<int bits>
+	void PeFileT<bits>::readClaimedParts(ParallelReadState& state)
+	{
+		std::unique_ptr<ByteSourceStream> stream;
+
+		for (std::size_t i = state.nextPart++; i < state.plan.size(); i = state.nextPart++)
+		{
+			if (!stream)
+				stream.reset(new ByteSourceStream(*state.source));
+
+			// The part must be counted as finished even if it fails, otherwise readAll waits forever
+			try
+			{
+				state.results[i] = state.file->readPart(state.plan[i].part, *stream);
+			}
+			catch (...)
+			{
+				state.results[i] = ERROR_INVALID_FILE;
+			}
+
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (++state.finishedParts == state.plan.size())
+				state.finished.notify_all();
+		}
+	}
+
 	template<int bits>
 	LoaderError PeFileT<bits>::checkEntryPointErrors() const
 	{
@@ -708,7 +1403,7 @@ namespace PeLib
 		std::uint64_t entryPointCode[2];
 
 		// No point of reading entry point that is beyond the file size
-		std::uint64_t ulFileSize = fileSize(m_iStream);
+		std::uint64_t ulFileSize = fileSize(*m_iStream);
 		if (uiOffset > ulFileSize)
 		{
 			return LDR_ERROR_ENTRY_POINT_OUT_OF_IMAGE;
@@ -721,8 +1416,8 @@ namespace PeLib
 			if ((uiOffset + sizeof(entryPointCode)) < ulFileSize)
 			{
 				// Read the entry point code
-				m_iStream.seekg(uiOffset, std::ios::beg);
-				m_iStream.read((char *)entryPointCode, sizeof(entryPointCode));
+				m_iStream->seekg(uiOffset, std::ios::beg);
+				m_iStream->read((char *)entryPointCode, sizeof(entryPointCode));
 
 				// Zeroed instructions at entry point map either to "add [eax], al" (i386) or "add [rax], al" (AMD64).
 				// Neither of these instructions makes sense on the entry point. We check 16 bytes of the entry point,
@@ -738,12 +1433,17 @@ namespace PeLib
 	}
 
 	// Returns an error code indicating loader problem. We check every part of the PE file
-	// for possible loader problem. If anything wrong was found, we report it
+	// for possible loader problem. If anything wrong was found, we report it.
+	// Parts deferred by readLazy which can report a loader problem are read first.
 	template<int bits>
 	LoaderError PeFileT<bits>::loaderError() const
 	{
 		LoaderError ldrError;
 
+		readDeferredPart(PELIB_READ_COFF_SYMBOL_TABLE);
+		readDeferredPart(PELIB_READ_IMPORTS);
+		readDeferredPart(PELIB_READ_RESOURCES);
+
 		// Was there a problem in the DOS header?
 		ldrError = mzHeader().loaderError();
 		if (ldrError != LDR_ERROR_NONE)
@@ -755,17 +1455,17 @@ namespace PeLib
 			return ldrError;
 
 		// Check the loader error
-		ldrError = coffSymTab().loaderError();
+		ldrError = m_coffsymtab.loaderError();
 		if (ldrError != LDR_ERROR_NONE)
 			return ldrError;
 
 		// Check errors in import directory
-		ldrError = impDir().loaderError();
+		ldrError = m_impdir.loaderError();
 		if (ldrError != LDR_ERROR_NONE)
 			return ldrError;
 
 		// Check errors in resource directory
-		ldrError = resDir().loaderError();
+		ldrError = m_resdir.loaderError();
 		if (ldrError != LDR_ERROR_NONE)
 			return ldrError;
 
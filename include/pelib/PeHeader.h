@@ -53,13 +53,24 @@ namespace PeLib
 		  LoaderError m_ldrError;
 		  unsigned long m_checksumFileOffset; ///< File offset of checksum field in optional PE header
 		  unsigned long m_secDirFileOffset; ///< File offset of security data directory
+		  IntervalIndex m_rvaIndex; ///< Answers getSectionWithRva.
+		  IntervalIndex m_offsetIndex; ///< Answers getSectionWithOffset.
+		  IntervalIndex m_validRvaIndex; ///< Answers the section part of isValidRva.
+		  bool m_sectionIndexValid; ///< False if sections were modified since the indexes were built.
 
 		  void setLoaderError(LoaderError ldrError);
 
+		  /// Rebuilds the section lookup indexes from the current section headers.
+		  void rebuildSectionIndex();
+		  /// Marks the section lookup indexes as stale, lookups fall back to scanning the sections.
+		  void invalidateSectionIndex();
+		  /// Converts an RVA to a file offset once the section containing it is known.
+		  typename FieldSizes<x>::VAR4_8 rvaToOffsetInSection(typename FieldSizes<x>::VAR4_8 dwRva, word uiSecnr) const;
+
 		public:
 		  typedef typename FieldSizes<x>::VAR4_8 VAR4_8;
 
-		  PeHeaderT() : m_uiOffset(0), m_checksumFileOffset(0), m_secDirFileOffset(0), m_ldrError(LDR_ERROR_NONE)
+		  PeHeaderT() : m_uiOffset(0), m_checksumFileOffset(0), m_secDirFileOffset(0), m_ldrError(LDR_ERROR_NONE), m_sectionIndexValid(false)
 		  {
 		  }
 
@@ -135,6 +146,8 @@ namespace PeLib
 
 		  /// Converts a relative virtual address to a file offset.
 		  VAR4_8 rvaToOffset(VAR4_8 dwRva) const; // EXPORT
+		  /// Converts an array of relative virtual addresses to file offsets.
+		  void rvaToOffsets(const VAR4_8* pRvas, std::size_t uiCount, VAR4_8* pOffsets, bool* pValid = nullptr) const; // EXPORT
 		  VAR4_8 rvaToOffsetSpeculative(VAR4_8 dwRva) const; // EXPORT
 
 		  /// Converts a relative virtual address to a virtual address.
@@ -543,6 +556,7 @@ namespace PeLib
 		setVirtualAddress(uiSecnr, dwRva);
 		setCharacteristics(uiSecnr, PELIB_IMAGE_SCN_MEM_WRITE | PELIB_IMAGE_SCN_MEM_READ | PELIB_IMAGE_SCN_CNT_INITIALIZED_DATA | PELIB_IMAGE_SCN_CNT_CODE);
 
+		rebuildSectionIndex();
 		return ERROR_NONE;
 	}
 
@@ -602,6 +616,7 @@ namespace PeLib
 		setVirtualSize(uiSectionnr + 1, originalSize - dwSplitOffset);
 		setCharacteristics(uiSectionnr + 1, PELIB_IMAGE_SCN_MEM_WRITE | PELIB_IMAGE_SCN_MEM_READ | PELIB_IMAGE_SCN_CNT_INITIALIZED_DATA | PELIB_IMAGE_SCN_CNT_CODE);
 
+		rebuildSectionIndex();
 		return ERROR_NONE;
 	}
 
@@ -625,6 +640,7 @@ namespace PeLib
 		}
 
 		m_vIsh.erase(m_vIsh.begin() + uiSectionnr);
+		rebuildSectionIndex();
 		return ERROR_NONE;
 	}
 
@@ -772,6 +788,7 @@ namespace PeLib
 		ishLastSection->SizeOfRawData = uiRawDataSize;
 		ishLastSection->VirtualSize = ishLastSection->SizeOfRawData;
 
+		rebuildSectionIndex();
 		setSizeOfImage(calcSizeOfImage());
 	}
 
@@ -789,6 +806,8 @@ namespace PeLib
 
 		if (!dwOffset) return std::numeric_limits<word>::max();
 
+		if (m_sectionIndexValid) return m_offsetIndex.find(dwOffset);
+
 		for (word i=0;i<calcNumberOfSections();i++)
 		{
 			// Explicity exclude sections with raw pointer = 0.
@@ -812,6 +831,8 @@ namespace PeLib
 		//                  An example for such a file is dbeng6.exe (made by Sybase).
 		//                  In this file each and every section has a VSize of 0 but it still runs.
 
+		if (m_sectionIndexValid) return m_rvaIndex.find(dwRva);
+
 		word actIndex = 0;
 		bool detected = false;
 
@@ -895,6 +916,8 @@ namespace PeLib
 
 		dwSizeOfImage = alignOffset(dwSizeOfImage, getSectionAlignment());
 		setSizeOfImage(dwSizeOfImage);
+
+		rebuildSectionIndex();
 	}
 
 	template<int x>
@@ -1038,7 +1061,7 @@ namespace PeLib
 		std::vector<PELIB_IMAGE_SECTION_HEADER> vIshdCurr;
 		bool bRawDataBeyondEOF = false;
 
-		std::vector<unsigned char> ishBuffer(PELIB_IMAGE_SECTION_HEADER::size());
+		std::vector<unsigned char> ishBuffer;
 		PELIB_IMAGE_SECTION_HEADER ishCurr;
 		std::uint64_t ulFileSize = fileSize(inStream_w);
 
@@ -1054,9 +1077,9 @@ namespace PeLib
 
 			// Clear error bits, because reading from symbol table might have failed.
 			inStream_w.clear();
-			inStream_w.seekg(uiOffset, std::ios::beg);
-			inStream_w.read(reinterpret_cast<char*>(ishBuffer.data()), ishBuffer.size());
-			InputBuffer ibBuffer(ishBuffer);
+			std::size_t uiHeaderSize = PELIB_IMAGE_SECTION_HEADER::size();
+			const unsigned char* ishData = readStreamRange(inStream_w, uiOffset, uiHeaderSize, ishBuffer);
+			InputBuffer ibBuffer(ishData, static_cast<unsigned long>(uiHeaderSize));
 
 			ibBuffer.read(reinterpret_cast<char*>(ishCurr.Name), 8);
 			// get name from string table
@@ -1235,6 +1258,65 @@ namespace PeLib
 		}
 	}
 
+	/**
+	* Builds the lookup indexes used by getSectionWithRva, getSectionWithOffset and isValidRva.
+	* The intervals and the ranks mirror the linear scans exactly, including the overflow of
+	* 32-bit section bounds, which makes such sections unreachable.
+	**/
+	template<int x>
+	void PeHeaderT<x>::rebuildSectionIndex()
+	{
+		const word numberOfSections = calcNumberOfSections();
+		std::vector<IntervalIndex::Interval> rvaIntervals, offsetIntervals, validRvaIntervals;
+		rvaIntervals.reserve(numberOfSections);
+		offsetIntervals.reserve(numberOfSections);
+		validRvaIntervals.reserve(numberOfSections);
+
+		// getSectionWithRva prefers the highest VirtualAddress, then the smallest size, then the lowest index.
+		std::vector<word> rvaOrder(numberOfSections);
+		std::iota(rvaOrder.begin(), rvaOrder.end(), 0);
+		auto sizeOf = [this](word i) { return std::max(getVirtualSize(i), getSizeOfRawData(i)); };
+		std::stable_sort(rvaOrder.begin(), rvaOrder.end(), [&](word i1, word i2) {
+			if (getVirtualAddress(i1) != getVirtualAddress(i2))
+				return getVirtualAddress(i1) > getVirtualAddress(i2);
+			return sizeOf(i1) < sizeOf(i2);
+		});
+
+		for (std::size_t rank = 0; rank < rvaOrder.size(); ++rank)
+		{
+			word i = rvaOrder[rank];
+			dword begin = getVirtualAddress(i);
+			dword end = begin + sizeOf(i);
+			rvaIntervals.push_back({begin, end, rank, i});
+		}
+
+		for (word i = 0; i < numberOfSections; ++i)
+		{
+			// Sections with raw pointer = 0 only exist in memory.
+			dword rawptr = getPointerToRawData(i);
+			if (rawptr)
+			{
+				dword end = rawptr + getSizeOfRawData(i);
+				offsetIntervals.push_back({rawptr, end, i, i});
+			}
+
+			dword sizeOfSection = getVirtualSize(i) ? getVirtualSize(i) : getSizeOfRawData(i);
+			dword end = getVirtualAddress(i) + AlignToSize(sizeOfSection, getSectionAlignment());
+			validRvaIntervals.push_back({getVirtualAddress(i), end, i, i});
+		}
+
+		m_rvaIndex.build(rvaIntervals);
+		m_offsetIndex.build(offsetIntervals);
+		m_validRvaIndex.build(validRvaIntervals);
+		m_sectionIndexValid = true;
+	}
+
+	template<int x>
+	void PeHeaderT<x>::invalidateSectionIndex()
+	{
+		m_sectionIndexValid = false;
+	}
+
 	/**
 	* Reads the PE header from a file Note that this function does not verify if a file is actually a MZ file.
 	* For this purpose see #PeLib::PeHeaderT<x>::isValid. The only check this function makes is a check to see if
@@ -1266,12 +1348,12 @@ namespace PeLib
 		if((std::uint64_t)ntHeaderOffset + header.size() > fileSize(inStream_w))
 			setLoaderError(LDR_ERROR_NTHEADER_OUT_OF_FILE);
 
-		std::vector<unsigned char> vBuffer(header.size());
-
-		inStream_w.seekg(ntHeaderOffset, std::ios::beg);
-		inStream_w.read(reinterpret_cast<char*>(vBuffer.data()), static_cast<std::streamsize>(vBuffer.size()));
+		std::vector<unsigned char> vBuffer;
+		// Fields beyond the end of the file are read as zero
+		std::size_t uiHeaderSize = header.size();
+		const unsigned char* headerData = readStreamRange(inStream_w, ntHeaderOffset, uiHeaderSize, vBuffer);
 
-		InputBuffer ibBuffer(vBuffer);
+		InputBuffer ibBuffer(headerData, static_cast<unsigned long>(uiHeaderSize));
 
 		readHeader(ibBuffer, header);
 
@@ -1359,6 +1441,7 @@ namespace PeLib
 		m_vIsh = readSections(inStream_w, secHdrOff, header);
 
 		std::swap(m_inthHeader, header);
+		rebuildSectionIndex();
 
 		return ERROR_NONE;
 	}
@@ -1462,6 +1545,9 @@ namespace PeLib
 		if (rva < getFileAlignment())
 			return true;
 
+		if (m_sectionIndexValid)
+			return m_validRvaIndex.find(rva) != IntervalIndex::NOT_FOUND;
+
 		for (word i = 0; i < calcNumberOfSections(); ++i)
 		{
 			// Sample 91DE52AB3F94A6372088DD843485414BA2B3734BDF58C4DE40DF3B50B4301C57:
@@ -1498,8 +1584,12 @@ namespace PeLib
 		// XXX: Not correct
 		if (dwRva < 0x1000) return dwRva;
 
-		PeLib::word uiSecnr = getSectionWithRva(dwRva);
+		return rvaToOffsetInSection(dwRva, getSectionWithRva(dwRva));
+	}
 
+	template<int x>
+	typename FieldSizes<x>::VAR4_8 PeHeaderT<x>::rvaToOffsetInSection(VAR4_8 dwRva, word uiSecnr) const
+	{
 		if (uiSecnr == 0xFFFF || dwRva > getVirtualAddress(uiSecnr) + getSizeOfRawData(uiSecnr))
 		{
 			return std::numeric_limits<VAR4_8>::max();
@@ -1513,6 +1603,37 @@ namespace PeLib
 		return getPointerToRawData(uiSecnr) + (dwRva - getVirtualAddress(uiSecnr));
 	}
 
+	/**
+	* Converts an array of relative virtual offsets to file offsets. Each conversion gives the same
+	* result as #PeLib::PeHeaderT<x>::rvaToOffset, but consecutive RVAs which fall into the same
+	* section (sorted thunks, name pointers, ...) share a single section lookup.
+	* @param pRvas Relative virtual offsets to convert.
+	* @param uiCount Number of RVAs.
+	* @param pOffsets Receives the file offsets, std::numeric_limits<VAR4_8>::max() for invalid RVAs.
+	* @param pValid If not null, receives for every RVA whether it could be converted.
+	**/
+	template<int x>
+	void PeHeaderT<x>::rvaToOffsets(const VAR4_8* pRvas, std::size_t uiCount, VAR4_8* pOffsets, bool* pValid) const
+	{
+		std::size_t segmentHint = std::numeric_limits<std::size_t>::max();
+
+		for (std::size_t i = 0; i < uiCount; ++i)
+		{
+			VAR4_8 dwRva = pRvas[i];
+
+			// XXX: Not correct, kept in sync with rvaToOffset
+			if (dwRva < 0x1000)
+				pOffsets[i] = dwRva;
+			else if (m_sectionIndexValid)
+				pOffsets[i] = rvaToOffsetInSection(dwRva, m_rvaIndex.find(dwRva, segmentHint));
+			else
+				pOffsets[i] = rvaToOffsetInSection(dwRva, getSectionWithRva(dwRva));
+
+			if (pValid)
+				pValid[i] = (pOffsets[i] != std::numeric_limits<VAR4_8>::max());
+		}
+	}
+
 	template<int x>
 	typename FieldSizes<x>::VAR4_8 PeHeaderT<x>::rvaToOffsetSpeculative(VAR4_8 dwRva) const
 	{
@@ -2706,6 +2827,7 @@ namespace PeLib
 	void PeHeaderT<x>::setSectionAlignment(dword dwValue)
 	{
 		m_inthHeader.OptionalHeader.SectionAlignment = dwValue;
+		invalidateSectionIndex();
 	}
 
 	/**
@@ -3102,6 +3224,7 @@ namespace PeLib
 	void PeHeaderT<x>::setVirtualSize(word wSectionnr, dword dwValue)
 	{
 		m_vIsh[wSectionnr].VirtualSize = dwValue;
+		invalidateSectionIndex();
 	}
 
 	/**
@@ -3113,6 +3236,7 @@ namespace PeLib
 	void PeHeaderT<x>::setVirtualAddress(word wSectionnr, dword dwValue)
 	{
 		m_vIsh[wSectionnr].VirtualAddress = dwValue;
+		invalidateSectionIndex();
 	}
 
 	/**
@@ -3124,6 +3248,7 @@ namespace PeLib
 	void PeHeaderT<x>::setSizeOfRawData(word wSectionnr, dword dwValue)
 	{
 		m_vIsh[wSectionnr].SizeOfRawData = dwValue;
+		invalidateSectionIndex();
 	}
 
 	/**
@@ -3135,6 +3260,7 @@ namespace PeLib
 	void PeHeaderT<x>::setPointerToRawData(word wSectionnr, dword dwValue)
 	{
 		m_vIsh[wSectionnr].PointerToRawData = dwValue;
+		invalidateSectionIndex();
 	}
 
 	/**
@@ -15,6 +15,7 @@
 
 #include <numeric>
 #include <limits>
+#include <memory>
 #include <unordered_map>
 
 #ifdef _MSC_VER						// Reduces number of warnings under MS Visual Studio from ~100000 to zero
@@ -24,6 +25,8 @@
 
 #include "pelib/OutputBuffer.h"
 #include "pelib/InputBuffer.h"
+#include "pelib/ByteSource.h"
+#include "pelib/StringPool.h"
 
 //get rid of duplicate windows.h definitions
 #ifdef ERROR_NONE
@@ -44,7 +47,8 @@ namespace PeLib
 		ERROR_ENTRY_NOT_FOUND = -7,
 		ERROR_DUPLICATE_ENTRY = -8,
 		ERROR_DIRECTORY_DOES_NOT_EXIST = -9,
-		ERROR_COFF_SYMBOL_TABLE_DOES_NOT_EXIST = -10
+		ERROR_COFF_SYMBOL_TABLE_DOES_NOT_EXIST = -10,
+		ERROR_FORWARDER_CYCLE = -11
 	};
 
 	enum LoaderError
@@ -100,6 +104,9 @@ namespace PeLib
 		LDR_ERROR_ENTRY_POINT_OUT_OF_IMAGE,         // The entry point is out of the image
 		LDR_ERROR_ENTRY_POINT_ZEROED,               // The entry point is zeroed
 
+		// Errors from resource parser, added later
+		LDR_ERROR_RSRC_LIMIT_EXCEEDED,              // Resource tree exceeds the limits of depth, number of elements or size
+
 		LDR_ERROR_MAX
 
 	};
@@ -210,11 +217,16 @@ namespace PeLib
 
 	const dword PELIB_IMAGE_NT_SIGNATURE = 0x00004550;
 
+	const dword PELIB_VS_FFI_SIGNATURE = 0xFEEF04BD;
+
 	const dword PELIB_MM_SIZE_OF_LARGEST_IMAGE = 0x77000000;
 
 	const dword PELIB_MAX_IMPORT_DLLS        = 0x100;           // Maximum number of imported DLLs we consider OK
 	const dword PELIB_MAX_IMPORTED_FUNCTIONS = 0x1000;          // Maximum number of exported functions (per DLL) that we support
 	const dword PELIB_MAX_EXPORTED_FUNCTIONS = 0x1000;          // Maximum number of exported functions that we support
+	const dword PELIB_MAX_RESOURCE_DEPTH     = 0x20;            // Maximum depth of resource nodes we read by default
+	const dword PELIB_MAX_RESOURCE_ELEMENTS  = 0x40000;         // Maximum number of resource nodes and leaves we read by default
+	const dword PELIB_MAX_RESOURCE_BYTES     = 0x4000000;       // Maximum size of resource headers, entries and names we read by default
 
 	template<int bits>
 	struct PELIB_IMAGE_ORDINAL_FLAGS;
@@ -977,16 +989,29 @@ namespace PeLib
 		dword addrofname;
 		word ordinal;
 		std::string funcname;
+		/// Name of the function if it was interned in a StringPool, funcname is then empty.
+		PooledString pooledFuncname;
 
 		PELIB_EXP_FUNC_INFORMATION();
 
+		/// Returns the name of the function, funcname unless it is empty and the name is pooled.
+		const char* getFuncname() const
+		{
+			return funcname.empty() ? pooledFuncname.c_str() : funcname.c_str();
+		}
+		/// Returns the length of the name returned by getFuncname.
+		std::size_t getFuncnameSize() const
+		{
+			return funcname.empty() ? pooledFuncname.size() : funcname.size();
+		}
+
 		bool equal(const std::string strFunctionName) const;
 		inline unsigned int size() const
 		{
 			unsigned int uiSize = 4;
 			if (addroffunc) uiSize += 2;// + 4;
-			if (!funcname.empty())
-				uiSize = (unsigned int)(uiSize + 4 + funcname.size() + 1);
+			if (getFuncnameSize())
+				uiSize = (unsigned int)(uiSize + 4 + getFuncnameSize() + 1);
 			return uiSize;
 		}
 	};
@@ -1018,7 +1043,10 @@ namespace PeLib
 	struct PELIB_IMG_RES_DIR_ENTRY
 	{
 		PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY irde;
+		/// Name with only the low byte of every character.
 		std::string wstrName;
+		/// Name as read from the file, empty if the name was set as std::string.
+		std::u16string utf16Name;
 
 		bool operator<(const PELIB_IMG_RES_DIR_ENTRY& first) const;
 
@@ -1068,6 +1096,10 @@ namespace PeLib
 	};
 
 	bool isEqualNc(const std::string& s1, const std::string& s2);
+	/// Returns the string in upper case, strings which are equal by isEqualNc have equal upper case forms.
+	std::string toUpperCase(const std::string& s);
+	/// Appends UTF-16 characters to a string in UTF-8, unpaired surrogates become U+FFFD.
+	void utf16ToUtf8(const char16_t* data, std::size_t uiLength, std::string& result);
 	// Used for parsing a file's import table. It combines the function name, the hint
 	// and the IMAGE_THUNK_DATA of an imported function.
 	template<int bits>
@@ -1105,11 +1137,19 @@ namespace PeLib
 		PELIB_VAR_SIZE<bits> address;
 		word hint;
 		std::string fname;
+		/// Name of the function if it was interned in a StringPool, fname is then empty.
+		PooledString pooledFname;
 
 		PELIB_DELAY_IMPORT() : hint(0)
 		{
 
 		}
+
+		/// Returns the name of the function, fname unless it is empty and the name is pooled.
+		const char* getFname() const
+		{
+			return fname.empty() ? pooledFname.c_str() : fname.c_str();
+		}
 	};
 
 	// Used to store a file's import table. Every struct of this sort
@@ -1161,6 +1201,28 @@ namespace PeLib
 		std::vector<byte> vData;
 	};
 
+	/// Equivalent to VS_FIXEDFILEINFO from the Win32 API, the fixed part of the version information.
+	struct PELIB_VS_FIXEDFILEINFO
+	{
+		dword Signature;
+		dword StrucVersion;
+		dword FileVersionMS;
+		dword FileVersionLS;
+		dword ProductVersionMS;
+		dword ProductVersionLS;
+		dword FileFlagsMask;
+		dword FileFlags;
+		dword FileOS;
+		dword FileType;
+		dword FileSubtype;
+		dword FileDateMS;
+		dword FileDateLS;
+
+		static inline unsigned int size() {return 52;}
+
+		PELIB_VS_FIXEDFILEINFO();
+	};
+
 	struct IMG_BASE_RELOC
 	{
 		PELIB_IMAGE_BASE_RELOCATION ibrRelocation;
@@ -1227,6 +1289,39 @@ namespace PeLib
 		static unsigned int size(){return 40;}
 	};
 
+	/**
+	* Sorted lookup structure that answers "which interval covers this address" in O(log n).
+	* Intervals may overlap; among the intervals covering an address, the one with the lowest
+	* rank wins. The address space is split into elementary segments at interval boundaries
+	* and the winner of every segment is precomputed.
+	**/
+	class IntervalIndex
+	{
+		public:
+		  /// Value returned by find() if no interval covers the address.
+		  static const word NOT_FOUND = 0xFFFF;
+
+		  struct Interval
+		  {
+			  std::uint64_t begin; ///< First address of the interval.
+			  std::uint64_t end;   ///< Address after the last address of the interval.
+			  std::size_t rank;    ///< Lower rank wins among overlapping intervals.
+			  word value;          ///< Value returned for addresses in the interval.
+		  };
+
+		  /// Builds the index from a list of intervals. Empty intervals are ignored.
+		  void build(const std::vector<Interval>& intervals);
+		  /// Returns the value of the winning interval covering the address.
+		  word find(std::uint64_t address) const;
+		  /// Same as find(address), reuses the segment found by the previous call if it still matches.
+		  word find(std::uint64_t address, std::size_t& segmentHint) const;
+		  void clear();
+
+		private:
+		  std::vector<std::uint64_t> m_boundaries; ///< Sorted starts of the elementary segments.
+		  std::vector<word> m_values;              ///< Winner of each segment.
+	};
+
 	std::uint32_t BytesToPages(std::uint32_t ByteSize);
 	std::uint32_t AlignToSize(std::uint32_t ByteSize, std::uint32_t AlignSize);
 
@@ -1253,6 +1348,7 @@ namespace PeLib
 	/// Opens a PE file.
 	PeFile* openPeFile(const std::string& strFilename);
 	PeFile* openPeFile(std::istream& stream);
+	PeFile* openPeFile(std::unique_ptr<ByteSource> source);
 
   /*  enum MzHeader_Field {e_magic, e_cblp, e_cp, e_crlc, e_cparhdr, e_minalloc, e_maxalloc,
 						e_ss, e_sp, e_csum, e_ip, e_cs, e_lfarlc, e_ovno, e_res, e_oemid,
@@ -1320,6 +1416,8 @@ namespace PeLib
 			dword Attributes;
 			dword NameRva;
 			std::string Name;
+			/// Name of the imported DLL if it was interned in a StringPool, Name is then empty.
+			PooledString PooledName;
 			dword ModuleHandleRva;
 			dword DelayImportAddressTableRva;
 			dword DelayImportNameTableRva;
@@ -1346,6 +1444,7 @@ namespace PeLib
 				Attributes = 0;
 				NameRva = 0;
 				Name.clear();
+				PooledName = PooledString();
 				ModuleHandleRva = 0;
 				DelayImportAddressTableRva = 0;
 				DelayImportNameTableRva = 0;
@@ -1365,6 +1464,12 @@ namespace PeLib
 				}
 			}
 
+			/// Returns the name of the imported DLL, Name unless it is empty and the name is pooled.
+			const char* getName() const
+			{
+				return Name.empty() ? PooledName.c_str() : Name.c_str();
+			}
+
 			auto ordinalNumbersAreValid() const
 			{
 				return hasOrdinalNumbers;
@@ -0,0 +1,87 @@
+/**
+ * @file PeScanner.h
+ * @brief Parallel scanning of many PE files.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef PESCANNER_H
+#define PESCANNER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pelib/PeFile.h"
+#include "pelib/WorkStealingPool.h"
+
+namespace PeLib
+{
+	/**
+	 * Summary of a scanned file, its header fields and the sizes of its directories.
+	 * Fields of the parts which were not read are zero.
+	 */
+	struct PeScanSummary
+	{
+		std::string filename;
+		unsigned int fileType = PEFILE_UNKNOWN; ///< PEFILE32, PEFILE64 or PEFILE_UNKNOWN.
+		int result = ERROR_NONE; ///< Result of PeFile::readAll.
+		LoaderError loaderError = LDR_ERROR_NONE;
+
+		word machine = 0;
+		word numberOfSections = 0;
+		dword timeDateStamp = 0;
+		word characteristics = 0;
+		dword addressOfEntryPoint = 0;
+		std::uint64_t imageBase = 0;
+		dword sizeOfImage = 0;
+		word subsystem = 0;
+		word dllCharacteristics = 0;
+
+		bool hasRichHeader = false;
+		bool hasComHeader = false;
+		std::size_t importedFiles = 0;
+		std::size_t importedFunctions = 0;
+		std::size_t exportedFunctions = 0;
+		std::size_t resourceTypes = 0;
+		std::size_t resources = 0;
+		std::size_t relocations = 0;
+		std::size_t debugEntries = 0;
+		std::size_t delayImportedFiles = 0;
+		std::size_t certificates = 0;
+		std::size_t coffSymbols = 0;
+	};
+
+	/**
+	 * Settings of a PeScanner.
+	 */
+	struct PeScanOptions
+	{
+		std::size_t threads = 0; ///< Number of threads, as many as there are cores if zero.
+		std::uint32_t readFlags = PELIB_READ_ALL; ///< Parts of the files to read, combination of PeReadFlags.
+		bool orderedOutput = true; ///< Report the files in the order they were given.
+		std::size_t maxFilesInFlight = 0; ///< Files being parsed or waiting to be reported, four per thread if zero.
+		bool parallelDirectories = false; ///< Also parse the directories of every file in parallel.
+	};
+
+	/**
+	 * Parses a list of files on a work-stealing thread pool and reports a summary of
+	 * every file. The number of files in memory at once is bounded, so the memory usage
+	 * does not grow with the length of the list.
+	 */
+	class PeScanner
+	{
+		private:
+		  PeScanOptions m_options;
+		  WorkStealingPool m_pool;
+
+		public:
+		  explicit PeScanner(const PeScanOptions& options = PeScanOptions());
+
+		  /// Parses a single file on the calling thread and returns its summary.
+		  PeScanSummary scanFile(const std::string& strFilename);
+		  /// Parses the files and passes their summaries to the callback on the calling thread.
+		  void scan(const std::vector<std::string>& vFilenames, const std::function<void(const PeScanSummary&)>& callback);
+	};
+}
+
+#endif
@@ -13,15 +13,23 @@
 #ifndef RESOURCEDIRECTORY_H
 #define RESOURCEDIRECTORY_H
 
-#include <set>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
+#include "pelib/ByteSource.h"
 #include "pelib/PeLibInc.h"
 #include "pelib/PeHeader.h"
+#include "pelib/TaskExecutor.h"
 
 namespace PeLib
 {
 	class ResourceElement;
 	class ResourceDirectory;
+	struct ResourceReadProgress;
+	struct ResourceReadBudget;
 	template <int bits> class ResourceDirectoryT;
 
 	/// The class ResourceChild is used to store information about a resource node.
@@ -67,6 +75,8 @@ namespace PeLib
 
 		  /// Returns the name of the node.
 		  std::string getName() const; // EXPORT
+		  /// Returns the name of the node in UTF-8.
+		  std::string getNameUtf8() const; // EXPORT
 		  /// Returns the Name value of the node.
 		  dword getOffsetToName() const; // EXPORT
 		  /// Returns the OffsetToData value of the node.
@@ -88,6 +98,10 @@ namespace PeLib
 		  ResourceChild(const ResourceChild& rhs);
 		  /// Makes a deep copy of a ResourceChild object.
 		  ResourceChild& operator=(const ResourceChild& rhs);
+		  /// Takes over the node of another ResourceChild object.
+		  ResourceChild(ResourceChild&& rhs) noexcept;
+		  /// Takes over the node of another ResourceChild object.
+		  ResourceChild& operator=(ResourceChild&& rhs) noexcept;
 		  /// Deletes a ResourceChild object.
 		  ~ResourceChild();
 	};
@@ -131,15 +145,26 @@ namespace PeLib
 	{
 		friend class ResourceChild;
 		friend class ResourceDirectory;
+		friend class ResourceNode;
 		template <typename T> friend struct fixNumberOfEntries;
 		template <int bits> friend class ResourceDirectoryT;
 
 		private:
-		  /// The resource data.
+		  /// The resource data, unless they are left in m_source.
 		  std::vector<byte> m_data;
+		  /// Source the resource data are read from on demand, nullptr if they are in m_data.
+		  /// The leaf shares the ownership of the source, so copies of the leaf outlive the file.
+		  std::shared_ptr<const ByteSource> m_source;
+		  /// File offset of the resource data in m_source.
+		  std::uint64_t m_dataOffset;
+		  /// Size of the resource data in m_source.
+		  std::size_t m_dataSize;
 		  /// PeLib equivalent of the Win32 structure IMAGE_RESOURCE_DATA_ENTRY
 		  PELIB_IMAGE_RESOURCE_DATA_ENTRY entry;
 
+		  /// Reads the leaf from a stream of ulStreamSize bytes.
+		  int readEntry(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiOffset, unsigned int uiRva, unsigned int uiFileSize, std::uint64_t ulStreamSize, ResourceDirectory* resDir);
+
 		protected:
 		  int read(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiOffset, unsigned int uiRva, unsigned int uiFileSize, unsigned int uiSizeOfImage, ResourceDirectory* resDir);
 		  /// Writes the next resource leaf into the OutputBuffer.
@@ -158,6 +183,14 @@ namespace PeLib
 
 		  /// Returns the resource data of this resource leaf.
 		  std::vector<byte> getData() const; // EXPORT
+		  /// Returns a view of the resource data of this resource leaf, without copying them if possible.
+		  ByteSpan getDataSpan(std::vector<byte>& vBuffer) const; // EXPORT
+		  /// Returns the number of bytes of the resource data which are present in the file.
+		  std::size_t getDataSize() const; // EXPORT
+		  /// Returns whether the resource data are read from the file on demand.
+		  bool isDataDeferred() const; // EXPORT
+		  /// Copies the resource data into the leaf, so that it no longer needs the file.
+		  void loadData(); // EXPORT
 		  /// Sets the resource data of this resource leaf.
 		  void setData(const std::vector<byte>& vData); // EXPORT
 
@@ -197,8 +230,13 @@ namespace PeLib
 		/// The node's header. Equivalent to IMAGE_RESOURCE_DIRECTORY from the Win32 API.
 		PELIB_IMAGE_RESOURCE_DIRECTORY header;
 
+		/// Reads the header of the node from a stream of ulStreamSize bytes and appends its entries to vEntries.
+		int readHeader(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiOffset, unsigned int uiRva, std::uint64_t ulStreamSize, unsigned int uiSizeOfImage, ResourceDirectory* resDir, std::vector<unsigned char>& vEntries);
+		/// Reads the children of the node listed in vEntries and the whole tree below them.
+		int readChildren(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiRva, unsigned int uiFileSize, std::uint64_t ulStreamSize, unsigned int uiSizeOfImage, ResourceDirectory* resDir, std::vector<unsigned char>& vEntries, ResourceReadProgress& progress);
+
 		protected:
-		  /// Reads the next resource node.
+		  /// Reads the next resource node and all nodes below it.
 		  int read(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiOffset, unsigned int uiRva, unsigned int uiFileSize, unsigned int uiSizeOfImage, ResourceDirectory* resDir);
 		  /// Writes the next resource node into the OutputBuffer.
 		  void rebuild(OutputBuffer&, unsigned int uiOffset, unsigned int uiRva, const std::string&) const;
@@ -312,6 +350,29 @@ namespace PeLib
 		}
 	};
 
+	/**
+	 * Limits of the work done when reading a resource tree. Once one of them is reached, reading
+	 * stops, the tree read so far is kept and the loader error is LDR_ERROR_RSRC_LIMIT_EXCEEDED.
+	 */
+	struct ResourceReadLimits
+	{
+		unsigned int maxDepth = PELIB_MAX_RESOURCE_DEPTH; ///< Levels of nodes below the root node.
+		std::size_t maxElements = PELIB_MAX_RESOURCE_ELEMENTS; ///< Nodes and leaves, including the root node.
+		std::uint64_t maxBytes = PELIB_MAX_RESOURCE_BYTES; ///< Bytes of node headers, entries, names and leaf entries.
+	};
+
+	/**
+	 * Work done so far by reading a resource tree, which the limits of the resource directory apply to.
+	 */
+	struct ResourceReadProgress
+	{
+		std::size_t elements = 0; ///< Nodes and leaves read.
+		std::uint64_t bytes = 0; ///< Bytes of node headers, entries, names and leaf entries read.
+		bool stopped = false; ///< Reading stopped early because of a limit or a cycle at the first node.
+		std::vector<std::size_t>* checkedOffsets = nullptr; ///< Receives the offsets tested for cycles, if set.
+		ResourceReadBudget* budget = nullptr; ///< Work and nodes shared with the subtrees read in parallel, if any.
+	};
+
 	/// Class that represents the resource directory of a PE file.
 	/**
 	* The class ResourceDirectory represents the resource directory of a PE file. This class is fundamentally
@@ -341,18 +402,81 @@ namespace PeLib
 	**/
 	class ResourceDirectory
 	{
+		private:
+		  /// Index of the resource types and of the resources of every type, built on the first lookup.
+		  struct ResourceIndex
+		  {
+			  /// IDs and names of the children of a node -> lowest index of a child with that ID or name.
+			  struct Level
+			  {
+				  /// Node whose children are indexed.
+				  const ResourceNode* node = nullptr;
+				  std::unordered_map<dword, unsigned int> byId;
+				  std::unordered_map<std::string, unsigned int> byName;
+			  };
+
+			  bool valid = false;
+			  /// Children of the root node.
+			  Level types;
+			  /// Children of every child of the root node, empty for a child which is not a node.
+			  std::vector<Level> resources;
+		  };
+
+		  /// Mutex which keeps the directory copyable, every copy has its own one.
+		  struct ResourceIndexMutex
+		  {
+			  std::mutex mutex;
+
+			  ResourceIndexMutex() {}
+			  ResourceIndexMutex(const ResourceIndexMutex&) {}
+			  ResourceIndexMutex& operator=(const ResourceIndexMutex&) { return *this; }
+		  };
+
+		  mutable ResourceIndex m_index;
+		  mutable ResourceIndexMutex m_indexMutex;
+
+		  /// Returns the index of the resources, builds it if necessary.
+		  const ResourceIndex& resourceIndex() const;
+		  /// Returns the index of the child of a node with the given ID, -1 if there is none.
+		  static int findChild(const ResourceNode& node, const ResourceIndex::Level* level, dword dwId);
+		  /// Returns the index of the child of a node with the given name, -1 if there is none.
+		  static int findChild(const ResourceNode& node, const ResourceIndex::Level* level, const std::string& strName);
+		  /// Returns the index of a resource type and the index of a resource of that type, -1 if there is none.
+		  template<typename S, typename T>
+		  std::pair<int, int> findResourceT(S restypeid, T resid) const;
+		  /// Returns the node of the resource type at the index, nullptr if the type has no node.
+		  const ResourceNode* getResourceTypeNode(int iResTypeIndex) const;
+		  /// Appends the leaves of all resources of a resource type.
+		  static void collectLeaves(const ResourceNode* typeNode, std::vector<const ResourceLeaf*>& vLeaves);
+
+		  /// Subtree of the root node read by a parallel read.
+		  struct ParallelSubtree;
+		  /// State of a parallel read of the subtrees of the root node.
+		  struct ParallelRead;
+		  /// Reads subtrees of a parallel read until no unclaimed subtree is left.
+		  static void readClaimedSubtrees(ParallelRead& state);
+
 		protected:
 		  /// Start offset of directory in file.
 		  unsigned int m_readOffset;
 		  /// The root node of the resource directory.
 		  ResourceNode m_rnRoot;
 		  /// Detection of invalid structure of nodes in directory.
-		  std::set<std::size_t> m_resourceNodeOffsets;
+		  std::unordered_set<std::size_t> m_resourceNodeOffsets;
+		  /// Limits of the work done when reading the resource tree.
+		  ResourceReadLimits m_readLimits;
+		  /// Thread pool the subtrees of the root node are read on, nullptr to read them on the calling thread.
+		  TaskExecutor* m_executor;
 		  /// Stores RVAs which are occupied by this export directory.
 		  std::vector<std::pair<unsigned int, unsigned int>> m_occupiedAddresses;
+		  /// Source which read leaves the data of the leaves in, nullptr to copy them into the leaves.
+		  std::shared_ptr<const ByteSource> m_dataSource;
 		  /// Error detected by the import table parser
 		  LoaderError m_ldrError;
 
+		  /// Reads the resource tree, the subtrees of the root node in parallel if there is an executor.
+		  int readTree(std::istream& inStream, unsigned int uiRsrcOffset, unsigned int uiRva, unsigned int uiFileSize, unsigned int uiSizeOfImage);
+
 		  // Prepare for some crazy syntax below to make Digital Mars happy.
 
 		  /// Retrieves an iterator to a specified resource child.
@@ -363,6 +487,16 @@ namespace PeLib
 		  template<typename S, typename T>
 		  std::vector<ResourceChild>::iterator locateResourceT(S restypeid, T resid);
 
+		  /// Retrieves the node of a resource, which holds the resource in all its languages.
+		  template<typename S, typename T>
+		  const ResourceNode* findResourceNodeT(S restypeid, T resid) const;
+		  /// Retrieves the leaf of a resource in a language.
+		  template<typename S, typename T>
+		  const ResourceLeaf* getResourceLeafT(S restypeid, T resid, dword dwLanguage) const;
+
+		  /// Drops the index of the resources after the tree was modified.
+		  void invalidateIndex();
+
 		  /// Adds a new resource.
 		  template<typename S, typename T>
 		  int addResourceT(S restypeid, T resid, ResourceChild& rc);
@@ -401,6 +535,7 @@ namespace PeLib
 		  /// Destructor
 		  virtual ~ResourceDirectory() = default;
 
+		  /// Returns the root node, whose subtree the caller may modify.
 		  ResourceNode* getRoot();
 		  const ResourceNode* getRoot() const;
 
@@ -408,6 +543,21 @@ namespace PeLib
 		  LoaderError loaderError() const;
 		  void setLoaderError(LoaderError ldrError);
 
+		  /// Sets the source which the data of the leaves are read from on demand.
+		  void setDataSource(std::shared_ptr<const ByteSource> source);
+		  /// Returns the source which the data of the leaves are read from on demand.
+		  const std::shared_ptr<const ByteSource>& getDataSource() const;
+		  /// Sets the limits of the work done when reading the resource tree.
+		  void setReadLimits(const ResourceReadLimits& limits);
+		  /// Returns the limits of the work done when reading the resource tree.
+		  const ResourceReadLimits& getReadLimits() const;
+		  /// Sets the thread pool which the subtrees of the root node are read on.
+		  void setTaskExecutor(TaskExecutor* executor);
+		  /// Returns the thread pool which the subtrees of the root node are read on.
+		  TaskExecutor* getTaskExecutor() const;
+		  /// Copies the data of all the leaves into the tree, so that it no longer needs the data source.
+		  void loadData();
+
 		  /// Corrects a erroneous resource directory.
 		  void makeValid();
 		  /// Rebuilds the resource directory.
@@ -486,6 +636,20 @@ namespace PeLib
 		  /// Returns the data of a certain resource.
 		  void getResourceDataByIndex(unsigned int uiResTypeIndex, unsigned int uiResIndex, std::vector<byte>& data) const;
 
+		  /// Returns the leaf of a certain resource in a certain language.
+		  const ResourceLeaf* getResourceLeaf(dword dwResTypeId, dword dwResId, dword dwLanguage) const;
+		  /// Returns the leaf of a certain resource in a certain language.
+		  const ResourceLeaf* getResourceLeaf(dword dwResTypeId, const std::string& strResName, dword dwLanguage) const;
+		  /// Returns the leaf of a certain resource in a certain language.
+		  const ResourceLeaf* getResourceLeaf(const std::string& strResTypeName, dword dwResId, dword dwLanguage) const;
+		  /// Returns the leaf of a certain resource in a certain language.
+		  const ResourceLeaf* getResourceLeaf(const std::string& strResTypeName, const std::string& strResName, dword dwLanguage) const;
+
+		  /// Returns the leaves of all resources of a certain resource type in all languages.
+		  std::vector<const ResourceLeaf*> getResourceLeaves(dword dwResTypeId) const;
+		  /// Returns the leaves of all resources of a certain resource type in all languages.
+		  std::vector<const ResourceLeaf*> getResourceLeaves(const std::string& strResTypeName) const;
+
 		  /// Sets the data of a certain resource.
 		  void setResourceData(dword dwResTypeId, dword dwResId, std::vector<byte>& data);
 		  /// Sets the data of a certain resource.
@@ -548,8 +712,36 @@ namespace PeLib
 	};
 
 	/**
-	* Looks through the entire resource tree and returns a const_iterator to the resource specified
-	* by the parameters.
+	* Looks the resource specified by the parameters up in the index of the resources. Callers
+	* may have modified the tree through the nodes since the index was built, so the index is
+	* only used for the nodes it was built for and every position found in it is checked.
+	* @param restypeid Identifier of the resource type (either ID or name).
+	* @param resid Identifier of the resource (either ID or name).
+	* @return Index of the resource type among the children of the root node and index of the
+	* resource among the children of the resource type node, -1 for the ones which do not exist.
+	**/
+	template<typename S, typename T>
+	std::pair<int, int> ResourceDirectory::findResourceT(S restypeid, T resid) const
+	{
+		const ResourceIndex& index = resourceIndex();
+		int iResTypeIndex = findChild(m_rnRoot, &index.types, restypeid);
+		const ResourceNode* typeNode = getResourceTypeNode(iResTypeIndex);
+		if (!typeNode)
+		{
+			return std::make_pair(iResTypeIndex, -1);
+		}
+
+		const ResourceIndex::Level* level = nullptr;
+		if (static_cast<std::size_t>(iResTypeIndex) < index.resources.size() && index.resources[iResTypeIndex].node == typeNode)
+		{
+			level = &index.resources[iResTypeIndex];
+		}
+
+		return std::make_pair(iResTypeIndex, findChild(*typeNode, level, resid));
+	}
+
+	/**
+	* Looks the resource specified by the parameters up and returns a const_iterator to it.
 	* @param restypeid Identifier of the resource type (either ID or name).
 	* @param resid Identifier of the resource (either ID or name).
 	* @return A const_iterator to the specified resource.
@@ -557,33 +749,23 @@ namespace PeLib
 	template<typename S, typename T>
 	std::vector<ResourceChild>::const_iterator ResourceDirectory::locateResourceT(S restypeid, T resid) const
 	{
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& res) { return res.hasEqual(restypeid); }
-		);
-		if (Iter == m_rnRoot.children.end())
+		std::pair<int, int> position = findResourceT(restypeid, resid);
+		const ResourceNode* currNode = getResourceTypeNode(position.first);
+		if (!currNode)
 		{
-			return Iter;
+			return m_rnRoot.children.end();
 		}
 
-		ResourceNode* currNode = static_cast<ResourceNode*>(Iter->child);
-		auto ResIter = std::find_if(
-				currNode->children.begin(),
-				currNode->children.end(),
-				[&](const auto& res) { return res.hasEqual(resid); }
-		);
-		if (ResIter == currNode->children.end())
+		if (position.second == -1)
 		{
-			return ResIter;
+			return currNode->children.end();
 		}
 
-		return ResIter;
+		return currNode->children.begin() + position.second;
 	}
 
 	/**
-	* Looks through the entire resource tree and returns an iterator to the resource specified
-	* by the parameters.
+	* Looks the resource specified by the parameters up and returns an iterator to it.
 	* @param restypeid Identifier of the resource type (either ID or name).
 	* @param resid Identifier of the resource (either ID or name).
 	* @return An iterator to the specified resource.
@@ -591,28 +773,73 @@ namespace PeLib
 	template<typename S, typename T>
 	std::vector<ResourceChild>::iterator ResourceDirectory::locateResourceT(S restypeid, T resid)
 	{
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& res) { return res.hasEqual(restypeid); }
-		);
-		if (Iter == m_rnRoot.children.end())
+		std::pair<int, int> position = findResourceT(restypeid, resid);
+		if (!getResourceTypeNode(position.first))
 		{
-			return Iter;
+			return m_rnRoot.children.end();
 		}
 
-		ResourceNode* currNode = static_cast<ResourceNode*>(Iter->child);
-		auto ResIter = std::find_if(
-				currNode->children.begin(),
-				currNode->children.end(),
-				[&](const auto& res) { return res.hasEqual(resid); }
-		);
-		if (ResIter == currNode->children.end())
+		ResourceNode* currNode = static_cast<ResourceNode*>(m_rnRoot.children[position.first].child);
+		if (position.second == -1)
+		{
+			return currNode->children.end();
+		}
+
+		return currNode->children.begin() + position.second;
+	}
+
+	/**
+	* Looks the resource specified by the parameters up and returns the node which holds the
+	* resource in all its languages.
+	* @param restypeid Identifier of the resource type (either ID or name).
+	* @param resid Identifier of the resource (either ID or name).
+	* @return The node of the resource, nullptr if there is no such resource.
+	**/
+	template<typename S, typename T>
+	const ResourceNode* ResourceDirectory::findResourceNodeT(S restypeid, T resid) const
+	{
+		std::pair<int, int> position = findResourceT(restypeid, resid);
+		if (position.second == -1)
+		{
+			return nullptr;
+		}
+
+		const ResourceNode* currNode = getResourceTypeNode(position.first);
+		const ResourceElement* resNode = currNode->children[position.second].child;
+		if (!resNode || resNode->isLeaf())
 		{
-			return ResIter;
+			return nullptr;
 		}
 
-		return ResIter;
+		return static_cast<const ResourceNode*>(resNode);
+	}
+
+	/**
+	* Returns the leaf of a resource in a language. The resource type and the resource are
+	* looked up in the index of the resources, the few languages of the resource are searched.
+	* @param restypeid Identifier of the resource type (either ID or name).
+	* @param resid Identifier of the resource (either ID or name).
+	* @param dwLanguage ID of the language.
+	* @return The leaf of the resource, nullptr if there is no such resource.
+	**/
+	template<typename S, typename T>
+	const ResourceLeaf* ResourceDirectory::getResourceLeafT(S restypeid, T resid, dword dwLanguage) const
+	{
+		const ResourceNode* resNode = findResourceNodeT(restypeid, resid);
+		if (!resNode)
+		{
+			return nullptr;
+		}
+
+		for (const auto& rc : resNode->children)
+		{
+			if (rc.equalId(dwLanguage) && rc.child && rc.child->isLeaf())
+			{
+				return static_cast<const ResourceLeaf*>(rc.child);
+			}
+		}
+
+		return nullptr;
 	}
 
 	/**
@@ -653,6 +880,7 @@ namespace PeLib
 		ResourceNode* currNode2 = static_cast<ResourceNode*>(rc.child);
 		currNode2->children.push_back(rlnew);
 		currNode->children.push_back(rc);
+		invalidateIndex();
 
 		fixNumberOfEntries<T>::fix(currNode);
 		fixNumberOfEntries<T>::fix(currNode2);
@@ -692,6 +920,7 @@ namespace PeLib
 		}
 
 		currNode->children.erase(ResIter);
+		invalidateIndex();
 
 		fixNumberOfEntries<T>::fix(currNode);
 
@@ -707,10 +936,14 @@ namespace PeLib
 	template<typename S, typename T>
 	int ResourceDirectory::getResourceDataT(S restypeid, T resid, std::vector<byte>& data) const
 	{
-		std::vector<ResourceChild>::const_iterator ResIter = locateResourceT(restypeid, resid);
-		ResourceNode* currNode = static_cast<ResourceNode*>(ResIter->child);
-		ResourceLeaf* currLeaf = static_cast<ResourceLeaf*>(currNode->children[0].child);
-		data.assign(currLeaf->m_data.begin(), currLeaf->m_data.end());
+		const ResourceNode* currNode = findResourceNodeT(restypeid, resid);
+		if (!currNode || currNode->children.empty() || !currNode->children[0].child || !currNode->children[0].child->isLeaf())
+		{
+			return ERROR_ENTRY_NOT_FOUND;
+		}
+
+		const ResourceLeaf* currLeaf = static_cast<const ResourceLeaf*>(currNode->children[0].child);
+		data = currLeaf->getData();
 
 		return ERROR_NONE;
 	}
@@ -724,10 +957,15 @@ namespace PeLib
 	template<typename S, typename T>
 	int ResourceDirectory::setResourceDataT(S restypeid, T resid, std::vector<byte>& data)
 	{
-		std::vector<ResourceChild>::iterator ResIter = locateResourceT(restypeid, resid);
-		ResourceNode* currNode = static_cast<ResourceNode*>(ResIter->child);
+		// The node belongs to this directory, so it may be modified
+		ResourceNode* currNode = const_cast<ResourceNode*>(findResourceNodeT(restypeid, resid));
+		if (!currNode || currNode->children.empty() || !currNode->children[0].child || !currNode->children[0].child->isLeaf())
+		{
+			return ERROR_ENTRY_NOT_FOUND;
+		}
+
 		ResourceLeaf* currLeaf = static_cast<ResourceLeaf*>(currNode->children[0].child);
-		currLeaf->m_data.assign(data.begin(), data.end());
+		currLeaf->setData(data);
 
 		return ERROR_NONE;
 	}
@@ -757,6 +995,7 @@ namespace PeLib
 	{
 		std::vector<ResourceChild>::iterator ResIter = locateResourceT(restypeid, resid);
 		ResIter->entry.irde.Name = dwNewResId;
+		invalidateIndex();
 		return ERROR_NONE;
 	}
 
@@ -784,7 +1023,8 @@ namespace PeLib
 	int ResourceDirectory::setResourceNameT(S restypeid, T resid, std::string strNewResName)
 	{
 		std::vector<ResourceChild>::iterator ResIter = locateResourceT(restypeid, resid);
-		ResIter->entry.wstrName = strNewResName;
+		ResIter->setName(strNewResName);
+		invalidateIndex();
 
 		return ERROR_NONE;
 	}
@@ -813,6 +1053,7 @@ namespace PeLib
 
 		m_resourceNodeOffsets.clear();
 		m_readOffset = uiOffset;
+		invalidateIndex();
 		if (!uiOffset)
 		{
 			return ERROR_INVALID_FILE;
@@ -833,7 +1074,7 @@ namespace PeLib
 
 		inStream_w.seekg(uiOffset, std::ios::beg);
 
-		return m_rnRoot.read(inStream_w, uiOffset, 0, uiResDirRva, ulFileSize, peHeader.getSizeOfImage(), this);
+		return readTree(inStream_w, uiOffset, uiResDirRva, ulFileSize, peHeader.getSizeOfImage());
 	}
 }
 
@@ -0,0 +1,119 @@
+/**
+ * @file StringPool.h
+ * @brief Thread-safe pool of interned strings shared by the parsed files.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PeLib
+{
+	class StringPool;
+
+	/**
+	 * Handle of a string interned in a StringPool. It is a single pointer to the characters in
+	 * the arena of the pool, which are preceded by their number and followed by a zero, so it
+	 * costs 8 bytes and no allocation of its own. It is valid as long as the pool.
+	 */
+	class PooledString
+	{
+		friend class StringPool;
+
+		private:
+		  const char* m_data = nullptr; ///< Characters in the arena, nullptr for an empty string.
+
+		  explicit PooledString(const char* data) : m_data(data) {}
+
+		public:
+		  PooledString() = default;
+
+		  const char* c_str() const { return m_data ? m_data : ""; }
+		  const char* data() const { return c_str(); }
+		  std::size_t size() const
+		  {
+			  std::uint32_t uiSize = 0;
+			  if (m_data) std::memcpy(&uiSize, m_data - sizeof(uiSize), sizeof(uiSize));
+			  return uiSize;
+		  }
+		  std::size_t length() const { return size(); }
+		  bool empty() const { return m_data == nullptr; }
+		  /// Returns a copy of the string.
+		  std::string str() const { return std::string(c_str(), size()); }
+	};
+
+	inline bool operator==(const PooledString& lhs, const PooledString& rhs)
+	{
+		return lhs.size() == rhs.size() && std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+	}
+
+	inline bool operator!=(const PooledString& lhs, const PooledString& rhs) { return !(lhs == rhs); }
+
+	/**
+	 * Stores every distinct string only once, no matter how many times and from how many threads
+	 * it is interned. The strings are copied into blocks of memory owned by the pool, where they
+	 * never move and live as long as the pool, so the pool must outlive all the objects which
+	 * were parsed with it.
+	 */
+	class StringPool
+	{
+		private:
+		  static const std::size_t NUMBER_OF_SHARDS = 16;
+		  /// Size of the blocks of the arena. Strings larger than a quarter of it get a block of their own.
+		  static const std::size_t BLOCK_SIZE = 0x10000;
+
+		  /// Contents of a string with its precomputed hash.
+		  struct Key
+		  {
+			  const char* data;
+			  std::size_t size;
+			  std::size_t hash;
+
+			  bool operator==(const Key& other) const;
+		  };
+
+		  struct KeyHash
+		  {
+			  std::size_t operator()(const Key& key) const { return key.hash; }
+		  };
+
+		  /// Part of the pool with its own lock, so that threads interning different strings rarely wait for each other.
+		  struct Shard
+		  {
+			  mutable std::mutex mutex;
+			  std::vector<std::unique_ptr<char[]>> blocks; ///< Arena of the interned strings, the last block is being filled.
+			  std::vector<std::unique_ptr<char[]>> largeBlocks; ///< Strings which got a block of their own.
+			  std::size_t used = BLOCK_SIZE; ///< Number of bytes used in the last block.
+			  std::unordered_map<Key, const char*, KeyHash> index; ///< Keys point into the arena.
+
+			  char* allocate(std::size_t size);
+		  };
+
+		  Shard m_shards[NUMBER_OF_SHARDS];
+
+		  static std::size_t hashString(const char* data, std::size_t size);
+
+		public:
+		  StringPool() = default;
+		  StringPool(const StringPool&) = delete;
+		  StringPool& operator=(const StringPool&) = delete;
+
+		  /// Returns the pooled copy of the string, adding it to the pool if it is not there yet.
+		  PooledString intern(const char* data, std::size_t size);
+		  /// Returns the pooled copy of the string, adding it to the pool if it is not there yet.
+		  PooledString intern(const std::string& value);
+		  /// Returns the number of distinct strings in the pool.
+		  std::size_t size() const;
+	};
+}
+
+#endif
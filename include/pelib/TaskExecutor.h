@@ -0,0 +1,28 @@
+/**
+ * @file TaskExecutor.h
+ * @brief Interface to a thread pool which the parsers can run their tasks on.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef TASKEXECUTOR_H
+#define TASKEXECUTOR_H
+
+#include <functional>
+
+namespace PeLib
+{
+	/**
+	* Interface to a thread pool of the caller, which PeFile::readAll can use to parse
+	* the directories of a file in parallel.
+	**/
+	class TaskExecutor
+	{
+		public:
+		  virtual ~TaskExecutor() {}
+
+		  /// Runs the task, possibly asynchronously on another thread.
+		  virtual void execute(std::function<void()> task) = 0;
+	};
+}
+
+#endif
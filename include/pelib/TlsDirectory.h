@@ -90,9 +90,7 @@ namespace PeLib
 			return ERROR_INVALID_FILE;
 		}
 
-		std::vector<byte> vTlsDirectory(buffer, buffer + buffersize);
-
-		InputBuffer ibBuffer(vTlsDirectory);
+		InputBuffer ibBuffer(buffer, buffersize);
 		read(ibBuffer);
 		return ERROR_NONE;
 	}
@@ -0,0 +1,158 @@
+/**
+ * @file VersionInfo.h
+ * @brief Views of the version information (VS_VERSIONINFO) in the data of a resource.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef VERSION_INFO_H
+#define VERSION_INFO_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "pelib/ByteSource.h"
+#include "pelib/ResourceDirectory.h"
+
+namespace PeLib
+{
+	/**
+	 * View of a string of UTF-16LE characters which is not terminated, e.g. a key or a value
+	 * of the version information. Views are valid as long as the data they point into.
+	 */
+	class Utf16View
+	{
+		private:
+		  const unsigned char* m_data;
+		  std::size_t m_length;
+
+		public:
+		  Utf16View() : m_data(nullptr), m_length(0) {}
+		  Utf16View(const unsigned char* data, std::size_t length) : m_data(data), m_length(length) {}
+
+		  /// Returns the number of characters.
+		  std::size_t length() const { return m_length; }
+		  /// Indicates if the string has no characters.
+		  bool empty() const { return m_length == 0; }
+		  /// Returns a character.
+		  char16_t operator[](std::size_t pos) const { return static_cast<char16_t>(m_data[2 * pos] | (m_data[2 * pos + 1] << 8)); }
+
+		  /// Compares the string to a string of ASCII characters.
+		  bool equals(const char* ascii) const;
+		  /// Compares the string to a string of ASCII characters, ignoring the case of ASCII letters.
+		  bool equalsNc(const char* ascii) const;
+		  /// Appends the string in UTF-8.
+		  void appendUtf8(std::string& result) const;
+		  /// Returns the string in UTF-8.
+		  std::string toUtf8() const;
+	};
+
+	/**
+	 * Language and code page of a table of version strings.
+	 */
+	struct VersionTranslation
+	{
+		word language = 0;
+		word codePage = 0;
+	};
+
+	/**
+	 * View of a block of the version information. VS_VERSIONINFO, StringFileInfo, StringTable,
+	 * String, VarFileInfo and Var all consist of a length, a key, a value and child blocks.
+	 * A block which is not valid marks the end of its siblings.
+	 */
+	class VersionBlock
+	{
+		private:
+		  const unsigned char* m_base; ///< Start of the version information, the blocks are aligned relative to it.
+		  const unsigned char* m_data; ///< Start of the block.
+		  const unsigned char* m_end; ///< End of the parent block.
+		  std::size_t m_size; ///< Size of the block, limited by the parent block.
+		  word m_valueLength;
+		  word m_type;
+		  Utf16View m_key;
+		  ByteSpan m_value;
+		  std::size_t m_childrenOffset; ///< Offset of the first child block in the block.
+
+		  std::size_t alignedOffset(std::size_t offset) const;
+
+		public:
+		  /// Creates a view which is not valid.
+		  VersionBlock();
+		  /// Creates a view of the block at data, which must not extend beyond end.
+		  VersionBlock(const unsigned char* base, const unsigned char* data, const unsigned char* end);
+
+		  /// Indicates if the view refers to a block.
+		  bool isValid() const;
+		  /// Returns the whole block, including its header and its child blocks.
+		  ByteSpan getData() const;
+		  /// Returns the wValueLength value of the block.
+		  word getValueLength() const;
+		  /// Returns the wType value of the block, 1 for text and 0 for binary data.
+		  word getType() const;
+		  /// Returns the key of the block.
+		  Utf16View getKey() const;
+		  /// Returns the value of the block.
+		  ByteSpan getValue() const;
+		  /// Returns the value of the block as text, without the terminating characters.
+		  Utf16View getTextValue() const;
+
+		  /// Returns the first child block.
+		  VersionBlock getFirstChild() const;
+		  /// Returns the next block of the parent block.
+		  VersionBlock getNextSibling() const;
+		  /// Returns the first child block with a given key.
+		  VersionBlock findChild(const char* key) const;
+	};
+
+	/**
+	 * Version information of a file, the data of its RT_VERSION resource. The data are parsed in
+	 * place, so the fixed file info, the translations and the strings are read without copying
+	 * them or allocating memory. The data must outlive the version information and its views.
+	 */
+	class VersionInfo
+	{
+		private:
+		  ByteSpan m_data;
+		  VersionBlock m_root;
+		  PELIB_VS_FIXEDFILEINFO m_fixedFileInfo;
+		  bool m_hasFixedFileInfo;
+		  ByteSpan m_translations; ///< Value of the Translation block of VarFileInfo.
+
+		public:
+		  VersionInfo();
+
+		  /// Parses the version information in the data of a resource.
+		  int parse(ByteSpan data);
+		  /// Parses the version information of the first RT_VERSION resource of a resource directory.
+		  int read(const ResourceDirectory& resDir, std::vector<byte>& vBuffer);
+
+		  /// Returns the VS_VERSIONINFO block.
+		  const VersionBlock& getRoot() const;
+		  /// Indicates if the version information has a valid fixed file info.
+		  bool hasFixedFileInfo() const;
+		  /// Returns the fixed file info, zeroed if there is none.
+		  const PELIB_VS_FIXEDFILEINFO& getFixedFileInfo() const;
+
+		  /// Returns the number of translations in VarFileInfo.
+		  std::size_t getNumberOfTranslations() const;
+		  /// Returns a translation in VarFileInfo.
+		  VersionTranslation getTranslation(std::size_t uiIndex) const;
+
+		  /// Returns the StringFileInfo block, whose children are the string tables.
+		  VersionBlock getStringFileInfo() const;
+		  /// Returns the VarFileInfo block.
+		  VersionBlock getVarFileInfo() const;
+		  /// Returns the string table of a translation.
+		  VersionBlock getStringTable(VersionTranslation translation) const;
+		  /// Finds a string in the string tables, those of the first table take precedence.
+		  bool getString(const char* key, Utf16View& value) const;
+		  /// Finds a string in the string table of a translation.
+		  bool getString(VersionTranslation translation, const char* key, Utf16View& value) const;
+
+		  /// Reads the translation from the key of a string table, e.g. "040904B0".
+		  static bool parseTranslation(const Utf16View& key, VersionTranslation& translation);
+	};
+}
+
+#endif
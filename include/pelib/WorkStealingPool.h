@@ -0,0 +1,71 @@
+/**
+ * @file WorkStealingPool.h
+ * @brief Thread pool with per-thread task queues and work stealing.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pelib/TaskExecutor.h"
+
+namespace PeLib
+{
+	/**
+	 * Thread pool in which every thread has its own queue of tasks. Tasks submitted from
+	 * a thread of the pool go to the queue of that thread and are run newest first, so
+	 * nested tasks stay on the thread which created them while their data is still hot.
+	 * Tasks from other threads are spread over the queues. A thread which runs out of
+	 * work steals the oldest task of another thread.
+	 */
+	class WorkStealingPool : public TaskExecutor
+	{
+		private:
+		  struct Worker
+		  {
+			  std::mutex mutex;
+			  std::deque<std::function<void()>> tasks;
+		  };
+
+		  std::vector<std::unique_ptr<Worker>> m_workers;
+		  std::vector<std::thread> m_threads;
+		  std::atomic<std::size_t> m_nextWorker; ///< Queue for the next task from outside the pool.
+
+		  std::mutex m_mutex;
+		  std::condition_variable m_wakeUp; ///< Signalled when a task is queued or the pool stops.
+		  std::condition_variable m_idle; ///< Signalled when the last pending task finishes.
+		  std::size_t m_queuedTasks; ///< Tasks waiting in the queues.
+		  std::size_t m_pendingTasks; ///< Tasks waiting in the queues or running.
+		  bool m_stop;
+
+		  bool popTask(std::size_t uiWorker, std::function<void()>& task);
+		  void run(std::size_t uiWorker);
+
+		public:
+		  /// Starts the given number of threads, as many as there are cores if it is zero.
+		  explicit WorkStealingPool(std::size_t uiThreads = 0);
+		  /// Runs the remaining tasks and stops the threads.
+		  ~WorkStealingPool() override;
+
+		  WorkStealingPool(const WorkStealingPool&) = delete;
+		  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		  /// Queues the task for one of the threads of the pool. Exceptions thrown by the task are ignored.
+		  void execute(std::function<void()> task) override;
+		  /// Blocks until all the queued tasks finish. Must not be called from a task of the pool.
+		  void wait();
+		  /// Returns the number of threads of the pool.
+		  std::size_t size() const;
+	};
+}
+
+#endif
@@ -150,10 +150,9 @@ namespace PeLib
 
 	int BoundImportDirectory::read(unsigned char* pcBuffer, unsigned int uiSize)
 	{
-		std::vector<unsigned char> vBimpDir(pcBuffer, pcBuffer + uiSize);
-		InputBuffer inpBuffer(vBimpDir);
+		InputBuffer inpBuffer(pcBuffer, uiSize);
 
-		return read(inpBuffer, vBimpDir.data(), uiSize);
+		return read(inpBuffer, pcBuffer, uiSize);
 	}
 
 	unsigned int BoundImportDirectory::totalModules() const
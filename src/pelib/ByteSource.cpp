@@ -0,0 +1,567 @@
+/**
+ * @file ByteSource.cpp
+ * @brief Abstract random-access input for PE files and its backends.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "pelib/ByteSource.h"
+#include "pelib/PeLibAux.h"
+
+namespace PeLib
+{
+// -------------------------------------------------- ByteSource -------------------------------------------
+
+	ByteSource::~ByteSource()
+	{
+	}
+
+	const unsigned char* ByteSource::data() const
+	{
+		return nullptr;
+	}
+
+	bool ByteSource::contains(std::uint64_t ulOffset, std::uint64_t ulLength) const
+	{
+		std::uint64_t ulSize = size();
+		return ulOffset <= ulSize && ulLength <= ulSize - ulOffset;
+	}
+
+	/**
+	* Makes uiSize bytes at offset ulOffset available in memory. If the source is contiguous
+	* and the range lies within it, the returned pointer points straight into the source.
+	* Otherwise the range is read into vBuffer and bytes beyond the end of the source are zero.
+	* @param ulOffset Offset of the range.
+	* @param uiSize Size of the range.
+	* @param vBuffer Buffer used when the range has to be copied.
+	* @return Pointer to the contents of the range.
+	**/
+	const unsigned char* ByteSource::readRange(std::uint64_t ulOffset, std::size_t uiSize, std::vector<unsigned char>& vBuffer) const
+	{
+		if (data() != nullptr && contains(ulOffset, uiSize))
+			return data() + ulOffset;
+
+		vBuffer.assign(uiSize, 0);
+		read(ulOffset, vBuffer.data(), uiSize);
+		return vBuffer.data();
+	}
+
+// -------------------------------------------------- MemoryByteSource -------------------------------------------
+
+	MemoryByteSource::MemoryByteSource(const unsigned char* data, std::size_t size) : m_data(data), m_size(data ? size : 0)
+	{
+	}
+
+	MemoryByteSource::MemoryByteSource(const std::vector<unsigned char>& vBuffer) : m_data(vBuffer.data()), m_size(vBuffer.size())
+	{
+	}
+
+	std::uint64_t MemoryByteSource::size() const
+	{
+		return m_size;
+	}
+
+	std::size_t MemoryByteSource::read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const
+	{
+		if (ulOffset >= m_size)
+			return 0;
+
+		std::size_t ulCopied = static_cast<std::size_t>(std::min<std::uint64_t>(ulLength, m_size - ulOffset));
+		std::memcpy(lpBuffer, m_data + ulOffset, ulCopied);
+		return ulCopied;
+	}
+
+	const unsigned char* MemoryByteSource::data() const
+	{
+		return m_data;
+	}
+
+// -------------------------------------------------- MappedFileByteSource -------------------------------------------
+
+#ifdef _WIN32
+	MappedFileByteSource::MappedFileByteSource(const std::string& strFilename) :
+			m_data(nullptr), m_size(0), m_isOpen(false), m_hFile(INVALID_HANDLE_VALUE), m_hMapping(nullptr)
+	{
+		m_hFile = CreateFileA(strFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return;
+
+		m_isOpen = true;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart == 0)
+			return;
+
+		m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_hMapping == nullptr)
+			return;
+
+		m_data = static_cast<const unsigned char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_data != nullptr)
+			m_size = static_cast<std::size_t>(fileSize.QuadPart);
+	}
+
+	MappedFileByteSource::~MappedFileByteSource()
+	{
+		if (m_data != nullptr)
+			UnmapViewOfFile(m_data);
+		if (m_hMapping != nullptr)
+			CloseHandle(m_hMapping);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+	}
+#else
+	MappedFileByteSource::MappedFileByteSource(const std::string& strFilename) : m_data(nullptr), m_size(0), m_isOpen(false)
+	{
+		int fd = ::open(strFilename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+
+		m_isOpen = true;
+
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void* mapping = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping != MAP_FAILED)
+			{
+				m_data = static_cast<const unsigned char*>(mapping);
+				m_size = static_cast<std::size_t>(st.st_size);
+			}
+		}
+
+		// The mapping stays valid after the descriptor is closed.
+		::close(fd);
+	}
+
+	MappedFileByteSource::~MappedFileByteSource()
+	{
+		if (m_data != nullptr)
+			::munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+#endif
+
+	bool MappedFileByteSource::isOpen() const
+	{
+		return m_isOpen;
+	}
+
+	std::uint64_t MappedFileByteSource::size() const
+	{
+		return m_size;
+	}
+
+	std::size_t MappedFileByteSource::read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const
+	{
+		if (ulOffset >= m_size)
+			return 0;
+
+		std::size_t ulCopied = static_cast<std::size_t>(std::min<std::uint64_t>(ulLength, m_size - ulOffset));
+		std::memcpy(lpBuffer, m_data + ulOffset, ulCopied);
+		return ulCopied;
+	}
+
+	const unsigned char* MappedFileByteSource::data() const
+	{
+		return m_data;
+	}
+
+// -------------------------------------------------- FileDescriptorByteSource -------------------------------------------
+
+	FileDescriptorByteSource::FileDescriptorByteSource(int fd, bool ownsDescriptor) : m_fd(fd), m_ownsDescriptor(ownsDescriptor), m_size(0)
+	{
+#ifdef _WIN32
+		struct _stati64 st;
+		if (m_fd >= 0 && _fstati64(m_fd, &st) == 0)
+			m_size = static_cast<std::uint64_t>(st.st_size);
+#else
+		struct stat st;
+		if (m_fd >= 0 && ::fstat(m_fd, &st) == 0)
+			m_size = static_cast<std::uint64_t>(st.st_size);
+#endif
+	}
+
+	FileDescriptorByteSource::~FileDescriptorByteSource()
+	{
+		if (m_ownsDescriptor && m_fd >= 0)
+		{
+#ifdef _WIN32
+			_close(m_fd);
+#else
+			::close(m_fd);
+#endif
+		}
+	}
+
+	std::uint64_t FileDescriptorByteSource::size() const
+	{
+		return m_size;
+	}
+
+	std::size_t FileDescriptorByteSource::read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const
+	{
+		if (ulOffset >= m_size)
+			return 0;
+
+		ulLength = static_cast<std::size_t>(std::min<std::uint64_t>(ulLength, m_size - ulOffset));
+
+		std::size_t ulCopied = 0;
+		while (ulCopied < ulLength)
+		{
+#ifdef _WIN32
+			// There is no positional read for CRT descriptors on Windows.
+			if (_lseeki64(m_fd, ulOffset + ulCopied, SEEK_SET) < 0)
+				break;
+			int iRead = _read(m_fd, static_cast<char*>(lpBuffer) + ulCopied, static_cast<unsigned int>(std::min<std::size_t>(ulLength - ulCopied, INT_MAX)));
+#else
+			ssize_t iRead = ::pread(m_fd, static_cast<char*>(lpBuffer) + ulCopied, ulLength - ulCopied, static_cast<off_t>(ulOffset + ulCopied));
+#endif
+			if (iRead <= 0)
+				break;
+			ulCopied += static_cast<std::size_t>(iRead);
+		}
+
+		return ulCopied;
+	}
+
+// -------------------------------------------------- StreamByteSource -------------------------------------------
+
+	StreamByteSource::StreamByteSource(std::istream& stream) : m_stream(stream), m_size(fileSize(stream))
+	{
+	}
+
+	std::uint64_t StreamByteSource::size() const
+	{
+		return m_size;
+	}
+
+	std::size_t StreamByteSource::read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const
+	{
+		if (ulOffset >= m_size)
+			return 0;
+
+		IStreamWrapper stream_w(m_stream);
+		stream_w.clear();
+		stream_w.seekg(ulOffset, std::ios::beg);
+		stream_w.read(static_cast<char*>(lpBuffer), static_cast<std::streamsize>(std::min<std::uint64_t>(ulLength, m_size - ulOffset)));
+		return static_cast<std::size_t>(stream_w.gcount());
+	}
+
+// -------------------------------------------------- PrefetchByteSource -------------------------------------------
+
+	PrefetchByteSource::PrefetchByteSource(const ByteSource& source) : m_source(source)
+	{
+	}
+
+	/**
+	* Reads the given ranges of the underlying source into memory. Previously prefetched
+	* ranges are dropped. Empty ranges and parts of ranges beyond the end of the source are ignored.
+	* @param vRanges Ranges to read, as pairs of offset and length, in any order.
+	* @param ulMaxGap Ranges separated by at most this many bytes are merged into a single read.
+	* @param ulMaxSize Maximum number of bytes read ahead in total. The ranges with the lowest
+	*        offsets are read ahead first, whatever exceeds the limit is read from the underlying
+	*        source when it is accessed.
+	**/
+	void PrefetchByteSource::prefetch(std::vector<std::pair<std::uint64_t, std::uint64_t>> vRanges, std::uint64_t ulMaxGap, std::uint64_t ulMaxSize)
+	{
+		const std::uint64_t ulSize = m_source.size();
+
+		// Turn the ranges into sorted (begin, end) pairs within the source
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> vBounds;
+		for (const auto& range : vRanges)
+		{
+			if (range.first >= ulSize || range.second == 0)
+				continue;
+
+			vBounds.emplace_back(range.first, range.first + std::min(range.second, ulSize - range.first));
+		}
+		std::sort(vBounds.begin(), vBounds.end());
+
+		m_extents.clear();
+		std::uint64_t ulBudget = ulMaxSize;
+		for (std::size_t i = 0; i < vBounds.size() && ulBudget != 0;)
+		{
+			std::uint64_t ulBegin = vBounds[i].first;
+			std::uint64_t ulEnd = vBounds[i].second;
+			for (++i; i < vBounds.size() && vBounds[i].first - std::min(vBounds[i].first, ulEnd) <= ulMaxGap; ++i)
+				ulEnd = std::max(ulEnd, vBounds[i].second);
+
+			ulEnd = std::min(ulEnd, ulBegin + ulBudget);
+			ulBudget -= ulEnd - ulBegin;
+
+			Extent extent;
+			extent.offset = ulBegin;
+			extent.data.resize(static_cast<std::size_t>(ulEnd - ulBegin));
+			extent.data.resize(m_source.read(ulBegin, extent.data.data(), extent.data.size()));
+			if (!extent.data.empty())
+				m_extents.push_back(std::move(extent));
+		}
+	}
+
+	std::uint64_t PrefetchByteSource::size() const
+	{
+		return m_source.size();
+	}
+
+	std::size_t PrefetchByteSource::read(std::uint64_t ulOffset, void* lpBuffer, std::size_t ulLength) const
+	{
+		unsigned char* pBuffer = static_cast<unsigned char*>(lpBuffer);
+		std::size_t ulCopied = 0;
+
+		// First extent which starts after the offset, the one before it may contain the offset
+		auto it = std::upper_bound(m_extents.begin(), m_extents.end(), ulOffset,
+				[](std::uint64_t ulValue, const Extent& extent) { return ulValue < extent.offset; });
+
+		while (ulCopied < ulLength)
+		{
+			std::uint64_t ulPosition = ulOffset + ulCopied;
+			std::size_t ulChunk = ulLength - ulCopied;
+
+			if (it != m_extents.begin() && ulPosition - (it - 1)->offset < (it - 1)->data.size())
+			{
+				// Served from the prefetched extent
+				const Extent& extent = *(it - 1);
+				std::size_t ulStart = static_cast<std::size_t>(ulPosition - extent.offset);
+				ulChunk = std::min(ulChunk, extent.data.size() - ulStart);
+				std::memcpy(pBuffer + ulCopied, extent.data.data() + ulStart, ulChunk);
+				ulCopied += ulChunk;
+				continue;
+			}
+
+			// Read the gap up to the next extent from the underlying source
+			if (it != m_extents.end())
+				ulChunk = static_cast<std::size_t>(std::min<std::uint64_t>(ulChunk, it->offset - ulPosition));
+
+			std::size_t ulRead = 0;
+			if (ulChunk)
+			{
+				std::lock_guard<std::mutex> lock(m_sourceMutex);
+				ulRead = m_source.read(ulPosition, pBuffer + ulCopied, ulChunk);
+			}
+			ulCopied += ulRead;
+			if (ulRead != ulChunk || it == m_extents.end())
+				break;
+			++it;
+		}
+
+		return ulCopied;
+	}
+
+// -------------------------------------------------- ByteSourceStreamBuf -------------------------------------------
+
+	/// Size of the read window used for sources which are not contiguous in memory.
+	const std::size_t BYTE_SOURCE_WINDOW_SIZE = 0x1000;
+
+	ByteSourceStreamBuf::ByteSourceStreamBuf(const ByteSource& source) : m_source(source), m_windowOffset(0)
+	{
+		if (m_source.data() == nullptr)
+		{
+			m_window.resize(BYTE_SOURCE_WINDOW_SIZE);
+		}
+
+		seekTo(0);
+	}
+
+	/**
+	* Returns the byte source the buffer reads from.
+	**/
+	const ByteSource& ByteSourceStreamBuf::source() const
+	{
+		return m_source;
+	}
+
+	/**
+	* Returns the file offset of the current read position.
+	**/
+	std::uint64_t ByteSourceStreamBuf::position() const
+	{
+		return m_windowOffset + static_cast<std::uint64_t>(gptr() - eback());
+	}
+
+	/**
+	* Moves the read position. Like file buffers, this allows positions past the end
+	* of the source, subsequent reads simply fail.
+	**/
+	ByteSourceStreamBuf::pos_type ByteSourceStreamBuf::seekTo(std::uint64_t ulPosition)
+	{
+		const unsigned char* data = m_source.data();
+		if (data != nullptr)
+		{
+			char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+			char* end = begin + m_source.size();
+
+			if (ulPosition <= m_source.size())
+			{
+				m_windowOffset = 0;
+				setg(begin, begin + ulPosition, end);
+			}
+			else
+			{
+				m_windowOffset = ulPosition;
+				setg(end, end, end);
+			}
+		}
+		else
+		{
+			// Drop the window, underflow() refills it from the new position.
+			m_windowOffset = ulPosition;
+			setg(m_window.data(), m_window.data(), m_window.data());
+		}
+
+		return pos_type(static_cast<off_type>(ulPosition));
+	}
+
+	ByteSourceStreamBuf::int_type ByteSourceStreamBuf::underflow()
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+
+		if (m_source.data() != nullptr)
+			return traits_type::eof();
+
+		std::uint64_t ulPosition = position();
+		std::size_t ulRead = m_source.read(ulPosition, m_window.data(), m_window.size());
+		if (ulRead == 0)
+			return traits_type::eof();
+
+		m_windowOffset = ulPosition;
+		setg(m_window.data(), m_window.data(), m_window.data() + ulRead);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	std::streamsize ByteSourceStreamBuf::xsgetn(char_type* s, std::streamsize n)
+	{
+		if (n <= 0)
+			return 0;
+
+		std::streamsize available = egptr() - gptr();
+		std::streamsize copied = std::min(n, available);
+		if (copied > 0)
+		{
+			std::memcpy(s, gptr(), static_cast<std::size_t>(copied));
+			setg(eback(), gptr() + copied, egptr());
+		}
+
+		// Contiguous sources have the whole remainder in the get area already.
+		if (copied == n || m_source.data() != nullptr)
+			return copied;
+
+		// Large reads bypass the window and go straight to the source.
+		std::uint64_t ulPosition = position();
+		std::size_t ulRead = m_source.read(ulPosition, s + copied, static_cast<std::size_t>(n - copied));
+		seekTo(ulPosition + ulRead);
+		return copied + static_cast<std::streamsize>(ulRead);
+	}
+
+	std::streamsize ByteSourceStreamBuf::showmanyc()
+	{
+		std::uint64_t ulPosition = position();
+		std::uint64_t ulSize = m_source.size();
+		return ulPosition < ulSize ? static_cast<std::streamsize>(ulSize - ulPosition) : -1;
+	}
+
+	ByteSourceStreamBuf::pos_type ByteSourceStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		if (!(which & std::ios_base::in))
+			return pos_type(off_type(-1));
+
+		off_type base;
+		if (dir == std::ios_base::beg)
+			base = 0;
+		else if (dir == std::ios_base::cur)
+			base = static_cast<off_type>(position());
+		else
+			base = static_cast<off_type>(m_source.size());
+
+		if (off < 0 && -off > base)
+			return pos_type(off_type(-1));
+
+		return seekTo(static_cast<std::uint64_t>(base + off));
+	}
+
+	ByteSourceStreamBuf::pos_type ByteSourceStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which)
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+// -------------------------------------------------- ByteSourceStream -------------------------------------------
+
+	ByteSourceStream::ByteSourceStream(const ByteSource& source) : std::istream(nullptr), m_streamBuf(source)
+	{
+		rdbuf(&m_streamBuf);
+	}
+
+// -------------------------------------------------- Helpers -------------------------------------------
+
+	/**
+	* Returns the byte source of a stream created over a ByteSource, provided the source
+	* keeps its contents contiguous in memory.
+	* @param stream Input stream.
+	* @return The byte source or nullptr.
+	**/
+	const ByteSource* getContiguousByteSource(std::istream& stream)
+	{
+		auto* streamBuf = dynamic_cast<ByteSourceStreamBuf*>(stream.rdbuf());
+		if (streamBuf == nullptr || streamBuf->source().data() == nullptr)
+			return nullptr;
+
+		return &streamBuf->source();
+	}
+
+	/**
+	* Makes uiSize bytes at file offset ulOffset available in memory. If the stream reads
+	* from a contiguous byte source and the range lies within it, the returned pointer points
+	* straight into the source. Otherwise the range is read into vBuffer. A range which reaches
+	* beyond the end of the stream is cut at the end of the stream first, so that no more
+	* memory is allocated than the stream can fill, and uiSize is lowered to the bytes left.
+	* In both cases the stream is left positioned as if the range was read from it.
+	* @param stream Input stream.
+	* @param ulOffset File offset of the range.
+	* @param uiSize Size of the range. Receives the number of bytes which are available.
+	* @param vBuffer Buffer used when the range has to be copied.
+	* @return Pointer to the contents of the range.
+	**/
+	const unsigned char* readStreamRange(std::istream& stream, std::uint64_t ulOffset, std::size_t& uiSize, std::vector<unsigned char>& vBuffer)
+	{
+		const ByteSource* source = getContiguousByteSource(stream);
+		if (source != nullptr && source->contains(ulOffset, uiSize))
+		{
+			stream.seekg(ulOffset + uiSize, std::ios::beg);
+			return source->data() + ulOffset;
+		}
+
+		stream.seekg(0, std::ios::end);
+		const std::streamoff streamSize = stream.tellg();
+		const std::uint64_t ulStreamSize = streamSize > 0 ? static_cast<std::uint64_t>(streamSize) : 0;
+		const std::uint64_t ulRemaining = ulOffset < ulStreamSize ? ulStreamSize - ulOffset : 0;
+		const bool bCut = uiSize > ulRemaining;
+		if (bCut)
+		{
+			uiSize = static_cast<std::size_t>(ulRemaining);
+		}
+
+		vBuffer.assign(uiSize, 0);
+		stream.seekg(ulOffset, std::ios::beg);
+		stream.read(reinterpret_cast<char*>(vBuffer.data()), static_cast<std::streamsize>(uiSize));
+
+		// The stream ends up in the same state as after reading past its end
+		if (bCut)
+		{
+			stream.setstate(std::ios::eofbit | std::ios::failbit);
+		}
+		return vBuffer.data();
+	}
+}
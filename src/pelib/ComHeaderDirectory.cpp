@@ -49,9 +49,7 @@ namespace PeLib
 			return ERROR_INVALID_FILE;
 		}
 
-		std::vector<byte> vComDescDirectory(buffer, buffer + buffersize);
-
-		InputBuffer ibBuffer(vComDescDirectory);
+		InputBuffer ibBuffer(buffer, buffersize);
 		read(ibBuffer);
 		return ERROR_NONE;
 	}
@@ -58,9 +58,7 @@ namespace PeLib
 		// XXX: Note, debug data is not read at all. This might or might not change
 		//      in the future.
 
-		std::vector<byte> vDebugDirectory(buffer, buffer + buffersize);
-
-		InputBuffer ibBuffer(vDebugDirectory);
+		InputBuffer ibBuffer(buffer, buffersize);
 
 		std::vector<PELIB_IMG_DEBUG_DIRECTORY> currDebugInfo = read(ibBuffer, 0, buffersize);
 
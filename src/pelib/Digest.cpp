@@ -0,0 +1,268 @@
+/**
+ * @file Digest.cpp
+ * @brief MD5 and SHA-256 message digests.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "pelib/Digest.h"
+
+namespace PeLib
+{
+	namespace
+	{
+		inline std::uint32_t rotateLeft(std::uint32_t value, unsigned int bits)
+		{
+			return (value << bits) | (value >> (32 - bits));
+		}
+
+		inline std::uint32_t rotateRight(std::uint32_t value, unsigned int bits)
+		{
+			return (value >> bits) | (value << (32 - bits));
+		}
+
+		/**
+		* Feeds the data to the block buffer of a digest and transforms every complete block.
+		* @param transform Transformation of a block of the digest.
+		* @param block Block buffer of the digest.
+		* @param length Number of bytes hashed so far, updated.
+		* @param data Data to hash.
+		* @param size Size of the data.
+		**/
+		template<typename Transform>
+		void updateBlocks(Transform transform, unsigned char* block, std::uint64_t& length, const void* data, std::size_t size)
+		{
+			const unsigned char* input = static_cast<const unsigned char*>(data);
+			std::size_t used = static_cast<std::size_t>(length % 64);
+			length += size;
+
+			if (used != 0)
+			{
+				std::size_t fill = std::min<std::size_t>(64 - used, size);
+				std::memcpy(block + used, input, fill);
+				input += fill;
+				size -= fill;
+				if (used + fill < 64)
+					return;
+				transform(block);
+			}
+
+			for (; size >= 64; input += 64, size -= 64)
+				transform(input);
+
+			std::memcpy(block, input, size);
+		}
+
+		const std::uint32_t md5Sines[64] =
+		{
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+		};
+
+		const unsigned int md5Shifts[64] =
+		{
+			7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+			5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+			4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+			6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+		};
+
+		const std::uint32_t sha256Constants[64] =
+		{
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+		};
+	}
+
+// -------------------------------------------------- Md5 -------------------------------------------
+
+	Md5::Md5() : m_length(0)
+	{
+		m_state[0] = 0x67452301;
+		m_state[1] = 0xefcdab89;
+		m_state[2] = 0x98badcfe;
+		m_state[3] = 0x10325476;
+	}
+
+	void Md5::transform(const unsigned char* block)
+	{
+		std::uint32_t words[16];
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			words[i] = static_cast<std::uint32_t>(block[4 * i])
+				| (static_cast<std::uint32_t>(block[4 * i + 1]) << 8)
+				| (static_cast<std::uint32_t>(block[4 * i + 2]) << 16)
+				| (static_cast<std::uint32_t>(block[4 * i + 3]) << 24);
+		}
+
+		std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		for (unsigned int i = 0; i < 64; i++)
+		{
+			std::uint32_t f;
+			unsigned int g;
+			if (i < 16)
+			{
+				f = (b & c) | (~b & d);
+				g = i;
+			}
+			else if (i < 32)
+			{
+				f = (d & b) | (~d & c);
+				g = (5 * i + 1) % 16;
+			}
+			else if (i < 48)
+			{
+				f = b ^ c ^ d;
+				g = (3 * i + 5) % 16;
+			}
+			else
+			{
+				f = c ^ (b | ~d);
+				g = (7 * i) % 16;
+			}
+
+			std::uint32_t temp = d;
+			d = c;
+			c = b;
+			b = b + rotateLeft(a + f + md5Sines[i] + words[g], md5Shifts[i]);
+			a = temp;
+		}
+
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+	}
+
+	void Md5::update(const void* data, std::size_t size)
+	{
+		updateBlocks([this](const unsigned char* block) { transform(block); }, m_block, m_length, data, size);
+	}
+
+	Md5::Digest Md5::digest()
+	{
+		std::uint64_t bitLength = m_length * 8;
+
+		unsigned char padding[72] = { 0x80 };
+		std::size_t paddingSize = ((m_length % 64) < 56 ? 56 : 120) - (m_length % 64);
+		for (unsigned int i = 0; i < 8; i++)
+			padding[paddingSize + i] = static_cast<unsigned char>(bitLength >> (8 * i));
+		update(padding, paddingSize + 8);
+
+		Digest result;
+		for (unsigned int i = 0; i < DIGEST_SIZE; i++)
+			result[i] = static_cast<unsigned char>(m_state[i / 4] >> (8 * (i % 4)));
+		return result;
+	}
+
+// -------------------------------------------------- Sha256 -------------------------------------------
+
+	Sha256::Sha256() : m_length(0)
+	{
+		m_state[0] = 0x6a09e667;
+		m_state[1] = 0xbb67ae85;
+		m_state[2] = 0x3c6ef372;
+		m_state[3] = 0xa54ff53a;
+		m_state[4] = 0x510e527f;
+		m_state[5] = 0x9b05688c;
+		m_state[6] = 0x1f83d9ab;
+		m_state[7] = 0x5be0cd19;
+	}
+
+	void Sha256::transform(const unsigned char* block)
+	{
+		std::uint32_t words[64];
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			words[i] = (static_cast<std::uint32_t>(block[4 * i]) << 24)
+				| (static_cast<std::uint32_t>(block[4 * i + 1]) << 16)
+				| (static_cast<std::uint32_t>(block[4 * i + 2]) << 8)
+				| static_cast<std::uint32_t>(block[4 * i + 3]);
+		}
+
+		for (unsigned int i = 16; i < 64; i++)
+		{
+			std::uint32_t s0 = rotateRight(words[i - 15], 7) ^ rotateRight(words[i - 15], 18) ^ (words[i - 15] >> 3);
+			std::uint32_t s1 = rotateRight(words[i - 2], 17) ^ rotateRight(words[i - 2], 19) ^ (words[i - 2] >> 10);
+			words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+		}
+
+		std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		std::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+		for (unsigned int i = 0; i < 64; i++)
+		{
+			std::uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+			std::uint32_t choice = (e & f) ^ (~e & g);
+			std::uint32_t temp1 = h + s1 + choice + sha256Constants[i] + words[i];
+			std::uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+			std::uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+			std::uint32_t temp2 = s0 + majority;
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + temp1;
+			d = c;
+			c = b;
+			b = a;
+			a = temp1 + temp2;
+		}
+
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+		m_state[4] += e;
+		m_state[5] += f;
+		m_state[6] += g;
+		m_state[7] += h;
+	}
+
+	void Sha256::update(const void* data, std::size_t size)
+	{
+		updateBlocks([this](const unsigned char* block) { transform(block); }, m_block, m_length, data, size);
+	}
+
+	Sha256::Digest Sha256::digest()
+	{
+		std::uint64_t bitLength = m_length * 8;
+
+		unsigned char padding[72] = { 0x80 };
+		std::size_t paddingSize = ((m_length % 64) < 56 ? 56 : 120) - (m_length % 64);
+		for (unsigned int i = 0; i < 8; i++)
+			padding[paddingSize + i] = static_cast<unsigned char>(bitLength >> (56 - 8 * i));
+		update(padding, paddingSize + 8);
+
+		Digest result;
+		for (unsigned int i = 0; i < DIGEST_SIZE; i++)
+			result[i] = static_cast<unsigned char>(m_state[i / 4] >> (24 - 8 * (i % 4)));
+		return result;
+	}
+
+	std::string toHexString(const unsigned char* data, std::size_t size)
+	{
+		static const char digits[] = "0123456789abcdef";
+
+		std::string result(2 * size, '0');
+		for (std::size_t i = 0; i < size; i++)
+		{
+			result[2 * i] = digits[data[i] >> 4];
+			result[2 * i + 1] = digits[data[i] & 0x0F];
+		}
+		return result;
+	}
+}
@@ -0,0 +1,488 @@
+/**
+ * @file ExportCache.cpp
+ * @brief Cache of the export tables of DLLs for resolving forwarders and binding imports.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <set>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#if defined(_WIN32) && !defined(S_ISREG)
+#define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+
+#include "pelib/ExportCache.h"
+
+namespace PeLib
+{
+	namespace
+	{
+		/// Forwarder strings are "DLL.Function", so they are as long as the names of both at most.
+		const std::size_t FORWARDER_MAX_LENGTH = IMPORT_LIBRARY_MAX_LENGTH + 1 + IMPORT_SYMBOL_MAX_LENGTH;
+	}
+
+// -------------------------------------------------- ExportTable -------------------------------------------
+
+	/**
+	* @param strFilename Name of the file.
+	* @return ERROR_NONE if the file has exports, ERROR_OPENING_FILE if it cannot be opened, or an error of the export directory.
+	**/
+	int ExportTable::read(const std::string& strFilename)
+	{
+		std::unique_ptr<MappedFileByteSource> mapped(new MappedFileByteSource(strFilename));
+		if (!mapped->isOpen())
+		{
+			return ERROR_OPENING_FILE;
+		}
+
+		const ByteSource& source = *mapped;
+		std::unique_ptr<PeFile> file(openPeFile(std::unique_ptr<ByteSource>(std::move(mapped))));
+		if (!file)
+		{
+			return ERROR_INVALID_FILE;
+		}
+
+		if (file->getBits() == 64) return read(static_cast<PeFile64&>(*file), source);
+		else return read(static_cast<PeFile32&>(*file), source);
+	}
+
+	/**
+	* Reads the exports of a file and the forwarder strings of the forwarded functions.
+	* @param file File with the MZ and PE headers already read.
+	* @param source Contents of the file.
+	* @return ERROR_NONE if the file has exports, an error of the export directory otherwise.
+	**/
+	template<int bits>
+	int ExportTable::read(PeFileT<bits>& file, const ByteSource& source)
+	{
+		int result = file.readExportDirectory();
+		if (result != ERROR_NONE)
+		{
+			return result;
+		}
+
+		const ExportDirectory& expDir = file.expDir();
+		const PeHeaderT<bits>& peHeader = file.peHeader();
+		dword dwDirRva = peHeader.getIddExportRva();
+		std::uint64_t ulDirEnd = static_cast<std::uint64_t>(dwDirRva) + peHeader.getIddExportSize();
+
+		m_name = expDir.getNameString();
+		m_base = expDir.getBase();
+		m_functions.assign(expDir.calcNumberOfFunctions(), Function());
+		m_names.clear();
+		m_sortedNames.clear();
+
+		std::vector<unsigned char> vBuffer;
+		for (unsigned int i = 0; i < m_functions.size(); i++)
+		{
+			Function& function = m_functions[i];
+			function.rva = expDir.getAddressOfFunction(i);
+
+			// Functions whose RVA points into the export directory are forwarded
+			if (function.rva >= dwDirRva && function.rva < ulDirEnd)
+			{
+				std::size_t uiMaxLength = static_cast<std::size_t>(std::min<std::uint64_t>(ulDirEnd - function.rva, FORWARDER_MAX_LENGTH));
+				const unsigned char* data = source.readRange(peHeader.rvaToOffset(function.rva), uiMaxLength, vBuffer);
+				function.forwarded = true;
+				function.forwarder.assign(reinterpret_cast<const char*>(data), std::find(data, data + uiMaxLength, 0) - data);
+			}
+		}
+
+		// The names are taken from the name table itself, as the functions keep one name each
+		// and a function with aliases has several. The reader checked that the table is in the file.
+		std::size_t uiNumberOfNames = expDir.getNumberOfNames();
+		std::vector<unsigned char> vNames, vOrdinals;
+		const unsigned char* names = source.readRange(peHeader.rvaToOffset(expDir.getAddressOfNames()), uiNumberOfNames * sizeof(dword), vNames);
+		const unsigned char* ordinals = source.readRange(peHeader.rvaToOffset(expDir.getAddressOfNameOrdinals()), uiNumberOfNames * sizeof(word), vOrdinals);
+
+		typedef typename FieldSizes<bits>::VAR4_8 VAR4_8;
+		std::vector<VAR4_8> vNameRvas(uiNumberOfNames), vNameOffsets(uiNumberOfNames);
+		for (std::size_t i = 0; i < uiNumberOfNames; i++)
+		{
+			dword dwNameRva;
+			std::memcpy(&dwNameRva, names + i * sizeof(dwNameRva), sizeof(dwNameRva));
+			vNameRvas[i] = dwNameRva;
+		}
+		peHeader.rvaToOffsets(vNameRvas.data(), uiNumberOfNames, vNameOffsets.data());
+
+		// Every entry is kept, even one with an invalid ordinal, so that hints index this array
+		m_names.reserve(uiNumberOfNames);
+		for (std::size_t i = 0; i < uiNumberOfNames; i++)
+		{
+			word wOrdinal;
+			std::memcpy(&wOrdinal, ordinals + i * sizeof(wOrdinal), sizeof(wOrdinal));
+			const unsigned char* name = source.readRange(vNameOffsets[i], IMPORT_SYMBOL_MAX_LENGTH, vBuffer);
+			m_names.emplace_back(std::string(reinterpret_cast<const char*>(name), std::find(name, name + IMPORT_SYMBOL_MAX_LENGTH, 0) - name), wOrdinal);
+		}
+
+		// The loader binary searches the table, which only works if it is sorted
+		auto lessName = [this](unsigned int a, unsigned int b) { return m_names[a].first < m_names[b].first; };
+		m_sortedNames.resize(m_names.size());
+		for (unsigned int i = 0; i < m_sortedNames.size(); i++)
+		{
+			m_sortedNames[i] = i;
+		}
+		if (std::is_sorted(m_sortedNames.begin(), m_sortedNames.end(), lessName))
+		{
+			m_sortedNames.clear();
+		}
+		else
+		{
+			std::stable_sort(m_sortedNames.begin(), m_sortedNames.end(), lessName);
+		}
+		return ERROR_NONE;
+	}
+
+	const std::string& ExportTable::getName() const
+	{
+		return m_name;
+	}
+
+	dword ExportTable::getBase() const
+	{
+		return m_base;
+	}
+
+	std::size_t ExportTable::getNumberOfFunctions() const
+	{
+		return m_functions.size();
+	}
+
+	/**
+	* Like the loader, a function whose RVA is 0 is treated as missing, such entries fill the
+	* gaps between the ordinals which are exported.
+	* @param dwOrdinal Ordinal of the function.
+	* @return Index of the function, -1 if there is no function with the ordinal.
+	**/
+	int ExportTable::getFunctionIndex(dword dwOrdinal) const
+	{
+		dword dwIndex = dwOrdinal - m_base;
+		if (dwOrdinal < m_base || dwIndex >= m_functions.size() || m_functions[dwIndex].rva == 0)
+		{
+			return -1;
+		}
+		return static_cast<int>(dwIndex);
+	}
+
+	/**
+	* Looks a function up like the loader does: the hint is tried as the index into the
+	* name table first and the names are binary searched if the name there differs.
+	* Names are compared case-sensitively.
+	* @param strFuncname Name of the function.
+	* @param iHint Hint of the import, -1 if there is none.
+	* @return Index of the function, -1 if there is no function with the name.
+	**/
+	int ExportTable::getFunctionIndex(const std::string& strFuncname, int iHint) const
+	{
+		// Position in the name table -> index of the function, whose ordinal may be invalid
+		auto functionIndex = [this](std::size_t uiPosition)
+		{
+			unsigned int index = m_names[uiPosition].second;
+			return (index < m_functions.size()) ? static_cast<int>(index) : -1;
+		};
+
+		if (iHint >= 0 && static_cast<std::size_t>(iHint) < m_names.size() && m_names[iHint].first == strFuncname)
+		{
+			return functionIndex(iHint);
+		}
+
+		if (m_sortedNames.empty())
+		{
+			auto Iter = std::lower_bound(m_names.begin(), m_names.end(), strFuncname,
+				[](const std::pair<std::string, unsigned int>& name, const std::string& value) { return name.first < value; });
+			return (Iter != m_names.end() && Iter->first == strFuncname) ? functionIndex(Iter - m_names.begin()) : -1;
+		}
+
+		auto Iter = std::lower_bound(m_sortedNames.begin(), m_sortedNames.end(), strFuncname,
+			[this](unsigned int uiPosition, const std::string& value) { return m_names[uiPosition].first < value; });
+		return (Iter != m_sortedNames.end() && m_names[*Iter].first == strFuncname) ? functionIndex(*Iter) : -1;
+	}
+
+	dword ExportTable::getFunctionRva(std::size_t index) const
+	{
+		return m_functions[index].rva;
+	}
+
+	bool ExportTable::isForwarded(std::size_t index) const
+	{
+		return m_functions[index].forwarded;
+	}
+
+	const std::string& ExportTable::getForwarder(std::size_t index) const
+	{
+		return m_functions[index].forwarder;
+	}
+
+// -------------------------------------------------- ExportCache -------------------------------------------
+
+	bool ExportCache::FileIdentity::operator==(const FileIdentity& other) const
+	{
+		return size == other.size && modificationTime == other.modificationTime;
+	}
+
+	/**
+	* @param strDirectory Directory with the DLLs.
+	**/
+	ExportCache::ExportCache(const std::string& strDirectory) : m_directory(strDirectory)
+	{
+		if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\')
+		{
+			m_directory += '/';
+		}
+	}
+
+	/**
+	* Finds a DLL in the directory. Like the loader, the name is matched case-insensitively
+	* and the extension .dll is tried as well, as forwarders name DLLs without it. The names
+	* come from the scanned files, so names which could lead out of the directory are rejected.
+	* @param strDllName Name of the DLL.
+	* @return Path of the file, empty if there is no such file.
+	**/
+	std::string ExportCache::findFile(const std::string& strDllName)
+	{
+		if (strDllName.empty() || strDllName.find_first_of("/\\") != std::string::npos || strDllName.find("..") != std::string::npos)
+		{
+			return std::string();
+		}
+
+		std::vector<std::string> vCandidates(1, strDllName);
+		if (strDllName.size() < 4 || toUpperCase(strDllName.substr(strDllName.size() - 4)) != ".DLL")
+		{
+			vCandidates.push_back(strDllName + ".dll");
+		}
+
+		FileIdentity identity;
+		for (const auto& strCandidate : vCandidates)
+		{
+			if (getFileIdentity(m_directory + strCandidate, identity))
+			{
+				return m_directory + strCandidate;
+			}
+		}
+
+#ifndef _WIN32
+		// The names of the files in the directory are listed again only once the directory
+		// changes, so files added later are found too. A listing made in the second the
+		// directory was modified may miss a file added later in that second, so it is not kept.
+		const char* szDirectory = m_directory.empty() ? "." : m_directory.c_str();
+		struct stat st;
+		std::int64_t directoryTime = (::stat(szDirectory, &st) == 0) ? static_cast<std::int64_t>(st.st_mtime) : -1;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_listingTime == 0 || directoryTime != m_directoryTime || m_listingTime <= m_directoryTime)
+		{
+			m_fileNames.clear();
+			m_directoryTime = directoryTime;
+			m_listingTime = static_cast<std::int64_t>(std::time(nullptr));
+			if (DIR* dir = ::opendir(szDirectory))
+			{
+				while (const dirent* entry = ::readdir(dir))
+				{
+					m_fileNames.emplace(toUpperCase(entry->d_name), entry->d_name);
+				}
+				::closedir(dir);
+			}
+		}
+
+		for (const auto& strCandidate : vCandidates)
+		{
+			auto Iter = m_fileNames.find(toUpperCase(strCandidate));
+			if (Iter != m_fileNames.end())
+			{
+				return m_directory + Iter->second;
+			}
+		}
+#endif
+
+		return std::string();
+	}
+
+	/**
+	* @param strPath Path of the file.
+	* @param identity Receives the size and the modification time of the file.
+	* @return False if the file does not exist or is not a regular file.
+	**/
+	bool ExportCache::getFileIdentity(const std::string& strPath, FileIdentity& identity)
+	{
+		struct stat st;
+		if (::stat(strPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			return false;
+		}
+
+		identity.size = static_cast<std::uint64_t>(st.st_size);
+		identity.modificationTime = static_cast<std::int64_t>(st.st_mtime);
+		return true;
+	}
+
+	/**
+	* Returns the exports of a DLL. The file is parsed only if it is not in the cache yet or it
+	* changed since it was parsed. Files without valid exports are cached as well.
+	* @param strDllName Name of the DLL, matched case-insensitively.
+	* @return Exports of the DLL, nullptr if there is no such file or it has no valid exports.
+	**/
+	std::shared_ptr<const ExportTable> ExportCache::getExportTable(const std::string& strDllName)
+	{
+		std::string strPath = findFile(strDllName);
+		FileIdentity identity;
+		if (strPath.empty() || !getFileIdentity(strPath, identity))
+		{
+			return nullptr;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto Iter = m_tables.find(strPath);
+			if (Iter != m_tables.end() && Iter->second.identity == identity)
+			{
+				return Iter->second.table;
+			}
+		}
+
+		// Parse without holding the lock, so that other files can be looked up meanwhile
+		std::shared_ptr<ExportTable> table = std::make_shared<ExportTable>();
+		if (table->read(strPath) != ERROR_NONE)
+		{
+			table.reset();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry& entry = m_tables[strPath];
+		entry.identity = identity;
+		entry.table = table;
+		return entry.table;
+	}
+
+	/**
+	* @param strDllName Name of the DLL.
+	* @param tables Tables looked at by the current resolution.
+	* @return Exports of the DLL, nullptr if there is no such file or it has no valid exports.
+	**/
+	const ExportTable* ExportCache::getExportTable(const std::string& strDllName, TableSnapshot& tables)
+	{
+		std::string strUpperName = toUpperCase(strDllName);
+		auto Iter = tables.find(strUpperName);
+		if (Iter == tables.end())
+		{
+			Iter = tables.emplace(strUpperName, getExportTable(strDllName)).first;
+		}
+
+		return Iter->second.get();
+	}
+
+	/**
+	* @param strDllName Name of the DLL.
+	* @param strFuncname Name of the function.
+	* @param iHint Hint of the import, -1 if there is none.
+	* @return Function which implements the export.
+	**/
+	ResolvedExport ExportCache::resolve(const std::string& strDllName, const std::string& strFuncname, int iHint)
+	{
+		TableSnapshot tables;
+		return resolveExport(strDllName, false, strFuncname, 0, iHint, tables);
+	}
+
+	/**
+	* @param strDllName Name of the DLL.
+	* @param dwOrdinal Ordinal of the function.
+	* @return Function which implements the export.
+	**/
+	ResolvedExport ExportCache::resolve(const std::string& strDllName, dword dwOrdinal)
+	{
+		TableSnapshot tables;
+		return resolveExport(strDllName, true, std::string(), dwOrdinal, -1, tables);
+	}
+
+	/**
+	* Follows the chain of forwarders of an export. A forwarder which was already followed
+	* ends the resolution with ERROR_FORWARDER_CYCLE, as does a chain longer than MAX_FORWARDS.
+	* @param strDllName Name of the DLL.
+	* @param bByOrdinal Whether the function is identified by the ordinal or by the name.
+	* @param strFuncname Name of the function.
+	* @param dwOrdinal Ordinal of the function.
+	* @param iHint Hint of the import, -1 if there is none.
+	* @param tables Tables looked at by the current resolution.
+	* @return Function which implements the export.
+	**/
+	ResolvedExport ExportCache::resolveExport(std::string strDllName, bool bByOrdinal, std::string strFuncname, dword dwOrdinal, int iHint, TableSnapshot& tables)
+	{
+		ResolvedExport resolved;
+		std::set<std::pair<const ExportTable*, int>> visited;
+
+		while (true)
+		{
+			resolved.dllName = strDllName;
+			const ExportTable* table = getExportTable(strDllName, tables);
+			if (table == nullptr)
+			{
+				resolved.result = ERROR_OPENING_FILE;
+				return resolved;
+			}
+
+			int index = bByOrdinal ? table->getFunctionIndex(dwOrdinal) : table->getFunctionIndex(strFuncname, iHint);
+			if (index < 0)
+			{
+				resolved.result = ERROR_ENTRY_NOT_FOUND;
+				return resolved;
+			}
+
+			if (!table->isForwarded(index))
+			{
+				resolved.result = ERROR_NONE;
+				resolved.ordinal = table->getBase() + index;
+				resolved.rva = table->getFunctionRva(index);
+				return resolved;
+			}
+
+			if (!visited.emplace(table, index).second || resolved.forwards >= MAX_FORWARDS)
+			{
+				resolved.result = ERROR_FORWARDER_CYCLE;
+				return resolved;
+			}
+
+			// "DLL.Function" or "DLL.#Ordinal", the name of the DLL may contain dots itself
+			const std::string& strForwarder = table->getForwarder(index);
+			std::size_t uiDot = strForwarder.rfind('.');
+			if (uiDot == std::string::npos || uiDot == 0 || uiDot + 1 == strForwarder.size())
+			{
+				resolved.result = ERROR_ENTRY_NOT_FOUND;
+				return resolved;
+			}
+
+			strDllName = strForwarder.substr(0, uiDot);
+			bByOrdinal = strForwarder[uiDot + 1] == '#';
+			if (bByOrdinal)
+			{
+				dwOrdinal = static_cast<dword>(std::strtoul(strForwarder.c_str() + uiDot + 2, nullptr, 10));
+			}
+			else
+			{
+				strFuncname = strForwarder.substr(uiDot + 1);
+			}
+			iHint = -1;
+			resolved.forwards++;
+		}
+	}
+
+	void ExportCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tables.clear();
+		m_fileNames.clear();
+		m_listingTime = 0;
+	}
+
+	std::size_t ExportCache::size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_tables.size();
+	}
+}
@@ -10,11 +10,42 @@
 * of PeLib.
 */
 
+#include <cctype>
+
 #include "pelib/PeLibInc.h"
 #include "pelib/ExportDirectory.h"
 
 namespace PeLib
 {
+	namespace
+	{
+		/// Compares two names like isEqualNc, but also orders them.
+		int compareNc(const char* s1, std::size_t uiSize1, const char* s2, std::size_t uiSize2)
+		{
+			std::size_t uiLength = std::min(uiSize1, uiSize2);
+			for (std::size_t i = 0; i < uiLength; i++)
+			{
+				int c1 = std::toupper(static_cast<unsigned char>(s1[i]));
+				int c2 = std::toupper(static_cast<unsigned char>(s2[i]));
+				if (c1 != c2)
+					return c1 < c2 ? -1 : 1;
+			}
+
+			return (uiSize1 == uiSize2) ? 0 : (uiSize1 < uiSize2 ? -1 : 1);
+		}
+
+		/// Compares the name of an exported function with a name like isEqualNc, but also orders them.
+		int compareNc(const PELIB_EXP_FUNC_INFORMATION& efi, const std::string& strName)
+		{
+			return compareNc(efi.getFuncname(), efi.getFuncnameSize(), strName.data(), strName.size());
+		}
+
+		int compareNc(const PELIB_EXP_FUNC_INFORMATION& efi1, const PELIB_EXP_FUNC_INFORMATION& efi2)
+		{
+			return compareNc(efi1.getFuncname(), efi1.getFuncnameSize(), efi2.getFuncname(), efi2.getFuncnameSize());
+		}
+	}
+
 	/**
 	* @param strFuncname Name of the function.
 	* @param dwFuncAddr RVA of the function.
@@ -25,16 +56,19 @@ namespace PeLib
 		efiCurr.funcname = strFuncname;
 		efiCurr.addroffunc = dwFuncAddr;
 		m_ied.functions.push_back(efiCurr);
+		invalidateNameIndex();
 	}
 
 	void ExportDirectory::removeFunction(unsigned int index)
 	{
 		m_ied.functions.erase(m_ied.functions.begin() + index);
+		invalidateNameIndex();
 	}
 
 	void ExportDirectory::clear()
 	{
 		m_ied.functions.clear();
+		invalidateNameIndex();
 	}
 
 	unsigned int ExportDirectory::calcNumberOfFunctions() const
@@ -43,25 +77,165 @@ namespace PeLib
 	}
 
 	/**
-	* Identifies an exported function through it's name.
+	* Returns the index of the function names. The name table of a file is sorted, so as
+	* long as the functions were not modified since they were read, the index is the name
+	* table itself and it is binary searched. Otherwise, or if the names are not sorted
+	* case-insensitively, the names are hashed.
+	* @return Index of the function names.
+	**/
+	const ExportDirectory::NameIndex& ExportDirectory::nameIndex() const
+	{
+		std::lock_guard<std::mutex> lock(m_nameIndexMutex.mutex);
+		if (m_nameIndex.valid)
+		{
+			return m_nameIndex;
+		}
+
+		std::vector<unsigned int>& vByName = m_nameIndex.byName;
+		vByName.clear();
+		m_nameIndex.hashed.clear();
+		m_nameIndex.unnamed = -1;
+		for (unsigned int i = 0; i < m_ied.functions.size(); i++)
+		{
+			if (m_ied.functions[i].getFuncnameSize())
+			{
+				if (m_nameOrder.empty()) vByName.push_back(i);
+			}
+			else if (m_nameIndex.unnamed == -1)
+			{
+				m_nameIndex.unnamed = static_cast<int>(i);
+			}
+		}
+
+		if (!m_nameOrder.empty())
+		{
+			vByName = m_nameOrder;
+		}
+
+		m_nameIndex.sorted = std::is_sorted(vByName.begin(), vByName.end(), [this](unsigned int i, unsigned int j)
+				{ return compareNc(m_ied.functions[i], m_ied.functions[j]) < 0; });
+		if (!m_nameIndex.sorted)
+		{
+			for (unsigned int i : vByName)
+			{
+				auto inserted = m_nameIndex.hashed.emplace(toUpperCase(m_ied.functions[i].getFuncname()), i);
+				if (!inserted.second && i < inserted.first->second) inserted.first->second = i;
+			}
+			vByName.clear();
+		}
+
+		m_nameIndex.valid = true;
+		return m_nameIndex;
+	}
+
+	/**
+	* Drops the index of the function names and the order of the name table, the index
+	* is built again by the next lookup.
+	**/
+	void ExportDirectory::invalidateNameIndex()
+	{
+		std::lock_guard<std::mutex> lock(m_nameIndexMutex.mutex);
+		m_nameIndex = NameIndex();
+		m_nameOrder.clear();
+	}
+
+	/**
+	* Identifies an exported function through it's name. The name is compared case-insensitively.
 	* @param strFunctionName Name of the function
-	* @return Number which identifies the functions.
+	* @return Number which identifies the functions, the lowest one if more functions have the name.
 	**/
 	int ExportDirectory::getFunctionIndex(const std::string& strFunctionName) const
 	{
+		const NameIndex& index = nameIndex();
+		if (strFunctionName.empty())
+		{
+			return index.unnamed;
+		}
+
+		if (!index.sorted)
+		{
+			auto Iter = index.hashed.find(toUpperCase(strFunctionName));
+			return (Iter != index.hashed.end()) ? static_cast<int>(Iter->second) : -1;
+		}
+
+		auto Iter = std::lower_bound(index.byName.begin(), index.byName.end(), strFunctionName, [this](unsigned int i, const std::string& strName)
+				{ return compareNc(m_ied.functions[i], strName) < 0; });
+
+		// Equal names are next to each other
+		int result = -1;
+		for (; Iter != index.byName.end() && compareNc(m_ied.functions[*Iter], strFunctionName) == 0; ++Iter)
+		{
+			if (result == -1 || *Iter < static_cast<unsigned int>(result)) result = static_cast<int>(*Iter);
+		}
+
+//		throw Exceptions::InvalidName(ExportDirectoryId, __LINE__);
+		return result;
+	}
+
+	/**
+	* Identifies an exported function through it's ordinal. The functions read from a file
+	* are ordered by their ordinals, so they are found without a search.
+	* @param wOrdinal Ordinal of the function.
+	* @return Number which identifies the function, -1 if there is no function with the ordinal.
+	**/
+	int ExportDirectory::getFunctionIndexByOrdinal(word wOrdinal) const
+	{
+		dword dwIndex = wOrdinal - m_ied.ied.Base;
+		if (dwIndex < m_ied.functions.size() && m_ied.functions[dwIndex].ordinal == wOrdinal)
+		{
+			return static_cast<int>(dwIndex);
+		}
+
 		auto Iter = std::find_if(
 				m_ied.functions.begin(),
 				m_ied.functions.end(),
-				[&](const auto& i) { return i.equal(strFunctionName); }
+				[&](const auto& i) { return i.ordinal == wOrdinal; }
 		);
 
-		if (Iter == m_ied.functions.end())
+		return (Iter != m_ied.functions.end()) ? static_cast<int>(std::distance(m_ied.functions.begin(), Iter)) : -1;
+	}
+
+	/**
+	* Makes a zero terminated name available in memory. If the source is contiguous, the
+	* returned pointer points straight into it, otherwise the name is read into vBuffer.
+	* @param source Contents of the file.
+	* @param ulOffset File offset of the name.
+	* @param vBuffer Buffer used when the name has to be copied.
+	* @param uiLength Receives the length of the name without the terminator.
+	* @return Pointer to the name, nullptr if the file ends before the terminator.
+	**/
+	const char* ExportDirectory::readName(const ByteSource& source, std::uint64_t ulOffset, std::vector<unsigned char>& vBuffer, std::size_t& uiLength)
+	{
+		if (ulOffset >= source.size())
+			return nullptr;
+
+		if (const unsigned char* data = source.data())
 		{
-//			throw Exceptions::InvalidName(ExportDirectoryId, __LINE__);
-			return -1;
+			const unsigned char* name = data + ulOffset;
+			const void* end = std::memchr(name, 0, static_cast<std::size_t>(source.size() - ulOffset));
+			if (end == nullptr)
+				return nullptr;
+
+			uiLength = static_cast<const unsigned char*>(end) - name;
+			return reinterpret_cast<const char*>(name);
 		}
 
-		return static_cast<int>(std::distance(m_ied.functions.begin(), Iter));
+		const std::size_t uiChunkSize = 256;
+		vBuffer.clear();
+		while (true)
+		{
+			std::size_t uiUsed = vBuffer.size();
+			vBuffer.resize(uiUsed + uiChunkSize);
+			std::size_t uiRead = source.read(ulOffset + uiUsed, vBuffer.data() + uiUsed, uiChunkSize);
+			const void* end = std::memchr(vBuffer.data() + uiUsed, 0, uiRead);
+			if (end != nullptr)
+			{
+				uiLength = static_cast<const unsigned char*>(end) - vBuffer.data();
+				return reinterpret_cast<const char*>(vBuffer.data());
+			}
+			if (uiRead < uiChunkSize)
+				return nullptr;
+		}
 	}
 
 	/**
@@ -80,10 +254,10 @@ namespace PeLib
 
 		for (unsigned int i=0;i<m_ied.functions.size();i++)
 		{
-			uiSizeNames += (m_ied.functions[i].funcname.empty()) ? 0 : static_cast<unsigned int>(m_ied.functions[i].funcname.size()) + 1;
+			uiSizeNames += (m_ied.functions[i].getFuncnameSize() == 0) ? 0 : static_cast<unsigned int>(m_ied.functions[i].getFuncnameSize()) + 1;
 			uiSizeAddrFuncs += sizeof(m_ied.functions[i].addroffunc);
-			uiSizeAddrNames += (m_ied.functions[i].funcname.empty()) ? 0 : sizeof(m_ied.functions[i].addrofname);
-			uiSizeOrdinals += (m_ied.functions[i].funcname.empty()) ? 0 : sizeof(m_ied.functions[i].ordinal);
+			uiSizeAddrNames += (m_ied.functions[i].getFuncnameSize() == 0) ? 0 : sizeof(m_ied.functions[i].addrofname);
+			uiSizeOrdinals += (m_ied.functions[i].getFuncnameSize() == 0) ? 0 : sizeof(m_ied.functions[i].ordinal);
 		}
 
 		unsigned int uiFilenameSize = static_cast<unsigned int>(m_ied.name.size()) + 1;
@@ -113,16 +287,16 @@ namespace PeLib
 
 		for (unsigned int i=0;i<m_ied.functions.size();i++)
 		{
-			if (!m_ied.functions[i].funcname.empty())
+			if (m_ied.functions[i].getFuncnameSize())
 			{
 				obBuffer << ulFuncCounter;
-				ulFuncCounter += static_cast<unsigned int>(m_ied.functions[i].funcname.size()) + 1;
+				ulFuncCounter += static_cast<unsigned int>(m_ied.functions[i].getFuncnameSize()) + 1;
 			}
 		}
 
 		for (unsigned int i=0;i<m_ied.functions.size();i++)
 		{
-			if (!m_ied.functions[i].funcname.empty())
+			if (m_ied.functions[i].getFuncnameSize())
 			{
 				obBuffer <<  m_ied.functions[i].ordinal;
 			}
@@ -130,7 +304,7 @@ namespace PeLib
 
 		for (unsigned int i=0;i<m_ied.functions.size();i++)
 		{
-			if (m_ied.functions[i].funcname.empty() && m_ied.functions[i].addroffunc)
+			if (m_ied.functions[i].getFuncnameSize() == 0 && m_ied.functions[i].addroffunc)
 			{
 				obBuffer <<  m_ied.functions[i].ordinal;
 			}
@@ -140,9 +314,9 @@ namespace PeLib
 
 		for (unsigned int i=0;i<m_ied.functions.size();i++)
 		{
-			if (!m_ied.functions[i].funcname.empty())
+			if (m_ied.functions[i].getFuncnameSize())
 			{
-				obBuffer.add(m_ied.functions[i].funcname.c_str(), static_cast<unsigned int>(m_ied.functions[i].funcname.size()) + 1);
+				obBuffer.add(m_ied.functions[i].getFuncname(), static_cast<unsigned int>(m_ied.functions[i].getFuncnameSize()) + 1);
 			}
 		}
 	}
@@ -213,7 +387,7 @@ namespace PeLib
 	**/
 	std::string ExportDirectory::getFunctionName(std::size_t dwIndex) const
 	{
-		return m_ied.functions[dwIndex].funcname;
+		return m_ied.functions[dwIndex].getFuncname();
 	}
 
 	/**
@@ -250,6 +424,8 @@ namespace PeLib
 	void ExportDirectory::setFunctionName(std::size_t dwIndex, const std::string& strName)
 	{
 		m_ied.functions[dwIndex].funcname = strName;
+		m_ied.functions[dwIndex].pooledFuncname = PooledString();
+		invalidateNameIndex();
 	}
 
 	/**
@@ -471,4 +647,20 @@ namespace PeLib
 	{
 		return m_occupiedAddresses;
 	}
+
+	/**
+	* Names read while a pool is set are interned in it, so that equal names of all the files
+	* read with the same pool share their storage. They are then kept in
+	* PELIB_EXP_FUNC_INFORMATION::pooledFuncname instead of funcname.
+	* @param pool Pool to intern the names in, or nullptr to let every name own its storage.
+	**/
+	void ExportDirectory::setStringPool(StringPool* pool)
+	{
+		m_stringPool = pool;
+	}
+
+	StringPool* ExportDirectory::getStringPool() const
+	{
+		return m_stringPool;
+	}
 }
@@ -38,8 +38,7 @@ namespace PeLib
 
 	int IatDirectory::read(unsigned char* buffer, unsigned int buffersize)
 	{
-		std::vector<byte> vBuffer(buffer, buffer + buffersize);
-		InputBuffer inpBuffer(vBuffer);
+		InputBuffer inpBuffer(buffer, buffersize);
 		return read(inpBuffer, 0, buffersize);
 	}
 
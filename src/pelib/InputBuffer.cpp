@@ -14,34 +14,47 @@
 
 namespace PeLib
 {
-	InputBuffer::InputBuffer(std::vector<unsigned char>& vBuffer) : m_vBuffer(vBuffer), ulIndex(0)
+	InputBuffer::InputBuffer(std::vector<unsigned char>& vBuffer) :
+			m_data(vBuffer.data()), m_size(static_cast<unsigned long>(vBuffer.size())), m_pvBuffer(&vBuffer), ulIndex(0)
+	{
+	}
+
+	InputBuffer::InputBuffer(const unsigned char* data, unsigned long size) :
+			m_data(data), m_size(data ? size : 0), m_pvBuffer(nullptr), ulIndex(0)
 	{
 	}
 
 	const unsigned char* InputBuffer::data() const
 	{
-		return m_vBuffer.data();
+		return m_data;
 	}
 
 	unsigned long InputBuffer::size()
 	{
-		return static_cast<unsigned long>(m_vBuffer.size());
+		return m_size;
+	}
+
+	unsigned long InputBuffer::remaining() const
+	{
+		return ulIndex < m_size ? m_size - ulIndex : 0;
 	}
 
 	void InputBuffer::read(char* lpBuffer, unsigned long ulSize)
 	{
-		if (ulIndex >= m_vBuffer.size())
+		if (ulIndex >= m_size)
 			return;
 
-		ulSize = (unsigned long)(ulIndex + ulSize > m_vBuffer.size() ? m_vBuffer.size() - ulIndex : ulSize);
+		ulSize = (ulSize > m_size - ulIndex) ? m_size - ulIndex : ulSize;
 
-		std::copy(m_vBuffer.data() + ulIndex, m_vBuffer.data() + ulIndex + ulSize, lpBuffer);
+		std::memcpy(lpBuffer, m_data + ulIndex, ulSize);
 		ulIndex += ulSize;
 	}
 
 	void InputBuffer::reset()
 	{
-		m_vBuffer.clear();
+		if (m_pvBuffer)
+			m_pvBuffer->clear();
+		m_size = 0;
 	}
 
 	void InputBuffer::set(unsigned long ulIndex2)
@@ -61,8 +74,17 @@ namespace PeLib
 
 	void InputBuffer::setBuffer(std::vector<unsigned char>& vBuffer)
 	{
-		m_vBuffer = vBuffer;
+		m_data = vBuffer.data();
+		m_size = static_cast<unsigned long>(vBuffer.size());
+		m_pvBuffer = &vBuffer;
 		ulIndex = 0;
 	}
-}
 
+	void InputBuffer::setBuffer(const unsigned char* data, unsigned long size)
+	{
+		m_data = data;
+		m_size = data ? size : 0;
+		m_pvBuffer = nullptr;
+		ulIndex = 0;
+	}
+}
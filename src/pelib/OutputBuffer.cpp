@@ -31,7 +31,7 @@ namespace PeLib
 
 	void OutputBuffer::add(const char* lpBuffer, unsigned long ulSize)
 	{
-		std::copy(lpBuffer, lpBuffer + ulSize, std::back_inserter(m_vBuffer));
+		m_vBuffer.insert(m_vBuffer.end(), lpBuffer, lpBuffer + ulSize);
 	}
 
 	void OutputBuffer::reset()
@@ -43,4 +43,9 @@ namespace PeLib
 	{
 		m_vBuffer.resize(uiSize);
 	}
+
+	void OutputBuffer::reserve(unsigned long ulSize)
+	{
+		m_vBuffer.reserve(ulSize);
+	}
 }
@@ -30,6 +30,10 @@ namespace PeLib
 	{
 	}
 
+	PeFile32::PeFile32(std::unique_ptr<ByteSource> source, const std::string& strFilename) : PeFileT<32>(std::move(source), strFilename)
+	{
+	}
+
 	PeFile64::PeFile64() : PeFileT<64>()
 	{
 	}
@@ -42,6 +46,10 @@ namespace PeLib
 	{
 	}
 
+	PeFile64::PeFile64(std::unique_ptr<ByteSource> source, const std::string& strFilename) : PeFileT<64>(std::move(source), strFilename)
+	{
+	}
+
 	/**
 	* @return A reference to the file's MZ header.
 	**/
@@ -62,31 +70,37 @@ namespace PeLib
 
 	const RichHeader& PeFile::richHeader() const
 	{
+		readDeferredPart(PELIB_READ_RICH_HEADER);
 		return m_richheader;
 	}
 
 	RichHeader& PeFile::richHeader()
 	{
+		readDeferredPart(PELIB_READ_RICH_HEADER);
 		return m_richheader;
 	}
 
 	const CoffSymbolTable& PeFile::coffSymTab() const
 	{
+		readDeferredPart(PELIB_READ_COFF_SYMBOL_TABLE);
 		return m_coffsymtab;
 	}
 
 	CoffSymbolTable& PeFile::coffSymTab()
 	{
+		readDeferredPart(PELIB_READ_COFF_SYMBOL_TABLE);
 		return m_coffsymtab;
 	}
 
 	const SecurityDirectory& PeFile::securityDir() const
 	{
+		readDeferredPart(PELIB_READ_SECURITY);
 		return m_secdir;
 	}
 
 	SecurityDirectory& PeFile::securityDir()
 	{
+		readDeferredPart(PELIB_READ_SECURITY);
 		return m_secdir;
 	}
 }
@@ -10,12 +10,19 @@
 * of PeLib.
 */
 
+#include <memory>
+#include <set>
 #include <vector>
 
 #ifdef _MSC_VER
   #include <ctype.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define PELIB_HAVE_SSE2
+#endif
+
 #include "pelib/PeLibInc.h"
 #include "pelib/PeLibAux.h"
 #include "pelib/PeFile.h"
@@ -77,6 +84,9 @@ namespace PeLib
 		// Entry point error detection
 		{"LDR_ERROR_ENTRY_POINT_OUT_OF_IMAGE",     "The position of the entry point is out of the image" },
 		{"LDR_ERROR_ENTRY_POINT_ZEROED",           "The entry point is zeroed; probably damaged file" },
+
+		// Resource directory detected errors, added later
+		{"LDR_ERROR_RSRC_LIMIT_EXCEEDED",          "Resource tree exceeds the limits of depth, number of elements or size" },
 	};
 
 	PELIB_IMAGE_FILE_MACHINE_ITERATOR::PELIB_IMAGE_FILE_MACHINE_ITERATOR()
@@ -119,6 +129,84 @@ namespace PeLib
 		return !StringTableName.empty();
 	}
 
+	const word IntervalIndex::NOT_FOUND;
+
+	void IntervalIndex::build(const std::vector<Interval>& intervals)
+	{
+		clear();
+
+		// Every interval produces an event at its begin and at its end. The events are swept
+		// in address order while the set of intervals covering the current segment is maintained.
+		std::vector<std::pair<std::uint64_t, std::size_t>> events;
+		events.reserve(intervals.size() * 2);
+		for (std::size_t i = 0; i < intervals.size(); ++i)
+		{
+			if (intervals[i].begin >= intervals[i].end)
+				continue;
+
+			events.emplace_back(intervals[i].begin, i);
+			events.emplace_back(intervals[i].end, i);
+		}
+
+		std::sort(events.begin(), events.end());
+
+		std::set<std::pair<std::size_t, std::size_t>> active;
+		for (std::size_t i = 0; i < events.size(); )
+		{
+			std::uint64_t address = events[i].first;
+			for (; i < events.size() && events[i].first == address; ++i)
+			{
+				const Interval& interval = intervals[events[i].second];
+				auto key = std::make_pair(interval.rank, events[i].second);
+				if (interval.begin == address)
+					active.insert(key);
+				else
+					active.erase(key);
+			}
+
+			word value = active.empty() ? NOT_FOUND : intervals[active.begin()->second].value;
+
+			// Merge with the previous segment if it has the same winner.
+			if (m_values.empty() ? value != NOT_FOUND : value != m_values.back())
+			{
+				m_boundaries.push_back(address);
+				m_values.push_back(value);
+			}
+		}
+	}
+
+	word IntervalIndex::find(std::uint64_t address) const
+	{
+		std::size_t segmentHint = m_boundaries.size();
+		return find(address, segmentHint);
+	}
+
+	word IntervalIndex::find(std::uint64_t address, std::size_t& segmentHint) const
+	{
+		// Runs of sorted or clustered addresses usually stay in the same segment.
+		if (segmentHint < m_boundaries.size() && m_boundaries[segmentHint] <= address
+			&& (segmentHint + 1 == m_boundaries.size() || address < m_boundaries[segmentHint + 1]))
+		{
+			return m_values[segmentHint];
+		}
+
+		auto it = std::upper_bound(m_boundaries.begin(), m_boundaries.end(), address);
+		if (it == m_boundaries.begin())
+		{
+			segmentHint = m_boundaries.size();
+			return NOT_FOUND;
+		}
+
+		segmentHint = (it - m_boundaries.begin()) - 1;
+		return m_values[segmentHint];
+	}
+
+	void IntervalIndex::clear()
+	{
+		m_boundaries.clear();
+		m_values.clear();
+	}
+
 	unsigned int alignOffset(unsigned int uiOffset, unsigned int uiAlignment)
 	{
 		if (!uiAlignment) return uiAlignment;
@@ -190,6 +278,7 @@ namespace PeLib
 		// These errors indicate damaged PE file, but the file is usually loadable anyway
 		return (ldrError == LDR_ERROR_FILE_IS_CUT_LOADABLE ||
 				ldrError == LDR_ERROR_RSRC_OVER_END_OF_IMAGE ||
+				ldrError == LDR_ERROR_RSRC_LIMIT_EXCEEDED ||
 				ldrError == LDR_ERROR_ENTRY_POINT_OUT_OF_IMAGE ||
 				ldrError == LDR_ERROR_ENTRY_POINT_ZEROED);
 	}
@@ -261,21 +350,89 @@ namespace PeLib
 		return size;
 	}
 
-	bool isEqualNc(const std::string& s1, const std::string& s2)
+	std::string toUpperCase(const std::string& s)
 	{
-		std::string t1 = s1;
-		std::string t2 = s2;
+		std::string t = s;
 
 		// No std:: to make VC++ happy
 #ifdef _MSC_VER
-		std::transform(t1.begin(), t1.end(), t1.begin(), [](unsigned char c) { return toupper(c); });
-		std::transform(t2.begin(), t2.end(), t2.begin(), [](unsigned char c) { return toupper(c); });
+		std::transform(t.begin(), t.end(), t.begin(), [](unsigned char c) { return toupper(c); });
 #else
   // Weird syntax to make Borland C++ happy
-		std::transform(t1.begin(), t1.end(), t1.begin(), (int(*)(int))std::toupper);
-		std::transform(t2.begin(), t2.end(), t2.begin(), (int(*)(int))std::toupper);
+		std::transform(t.begin(), t.end(), t.begin(), (int(*)(int))std::toupper);
 #endif
-		return t1 == t2;
+		return t;
+	}
+
+	/**
+	* Converts UTF-16 characters to UTF-8. With SSE2, runs of ASCII characters are
+	* narrowed eight at a time, the rest is encoded one character after another.
+	* @param data Characters in UTF-16.
+	* @param uiLength Number of characters.
+	* @param result String the characters are appended to in UTF-8.
+	**/
+	void utf16ToUtf8(const char16_t* data, std::size_t uiLength, std::string& result)
+	{
+		// A character takes at most three bytes, a surrogate pair takes four bytes for two characters
+		std::size_t uiOut = result.size();
+		result.resize(uiOut + uiLength * 3);
+
+		std::size_t i = 0;
+		while (i < uiLength)
+		{
+#ifdef PELIB_HAVE_SSE2
+			const __m128i nonAsciiMask = _mm_set1_epi16(static_cast<short>(0xFF80));
+			while (i + 8 <= uiLength)
+			{
+				__m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				__m128i isAscii = _mm_cmpeq_epi16(_mm_and_si128(chars, nonAsciiMask), _mm_setzero_si128());
+				if (_mm_movemask_epi8(isAscii) != 0xFFFF)
+					break;
+
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&result[uiOut]), _mm_packus_epi16(chars, chars));
+				uiOut += 8;
+				i += 8;
+			}
+
+			if (i == uiLength)
+				break;
+#endif
+			std::uint32_t c = data[i++];
+			if (c < 0x80)
+			{
+				result[uiOut++] = static_cast<char>(c);
+			}
+			else if (c < 0x800)
+			{
+				result[uiOut++] = static_cast<char>(0xC0 | (c >> 6));
+				result[uiOut++] = static_cast<char>(0x80 | (c & 0x3F));
+			}
+			else if (c >= 0xD800 && c < 0xDC00 && i < uiLength && data[i] >= 0xDC00 && data[i] < 0xE000)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (data[i++] - 0xDC00);
+				result[uiOut++] = static_cast<char>(0xF0 | (c >> 18));
+				result[uiOut++] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+				result[uiOut++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+				result[uiOut++] = static_cast<char>(0x80 | (c & 0x3F));
+			}
+			else
+			{
+				// Unpaired surrogate
+				if (c >= 0xD800 && c < 0xE000)
+					c = 0xFFFD;
+
+				result[uiOut++] = static_cast<char>(0xE0 | (c >> 12));
+				result[uiOut++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+				result[uiOut++] = static_cast<char>(0x80 | (c & 0x3F));
+			}
+		}
+
+		result.resize(uiOut);
+	}
+
+	bool isEqualNc(const std::string& s1, const std::string& s2)
+	{
+		return s1.size() == s2.size() && toUpperCase(s1) == toUpperCase(s2);
 	}
 
 	PELIB_IMAGE_DOS_HEADER::PELIB_IMAGE_DOS_HEADER()
@@ -391,6 +548,23 @@ namespace PeLib
 		Reserved = 0;
 	}
 
+	PELIB_VS_FIXEDFILEINFO::PELIB_VS_FIXEDFILEINFO()
+	{
+		Signature = 0;
+		StrucVersion = 0;
+		FileVersionMS = 0;
+		FileVersionLS = 0;
+		ProductVersionMS = 0;
+		ProductVersionLS = 0;
+		FileFlagsMask = 0;
+		FileFlags = 0;
+		FileOS = 0;
+		FileType = 0;
+		FileSubtype = 0;
+		FileDateMS = 0;
+		FileDateLS = 0;
+	}
+
 	PELIB_IMAGE_DEBUG_DIRECTORY::PELIB_IMAGE_DEBUG_DIRECTORY()
 	{
 		Characteristics = 0;
@@ -414,43 +588,99 @@ namespace PeLib
 
 	bool PELIB_EXP_FUNC_INFORMATION::equal(const std::string strFunctionName) const
 	{
-		return isEqualNc(this->funcname, strFunctionName);
+		return isEqualNc(getFuncname(), strFunctionName);
 	}
 
-	unsigned int getFileType(PeFile32& pef)
+	namespace
 	{
-		// Attempt to read the DOS file header.
-		if (pef.readMzHeader() != ERROR_NONE)
+		/**
+		* Reads the MZ header and determines the type of the file from the machine and the magic
+		* of the optional header. The PE header is not parsed, the fields are read directly.
+		* @param stream Input stream.
+		* @param mzHeader Receives the MZ header of the file.
+		* @return Either PEFILE32, PEFILE64 or PEFILE_UNKNOWN
+		**/
+		unsigned int detectFileType(std::istream& stream, MzHeader& mzHeader)
 		{
-			return PEFILE_UNKNOWN;
-		}
+			// Attempt to read and verify the DOS file header.
+			if (mzHeader.read(stream) != ERROR_NONE || !mzHeader.isValid())
+			{
+				return PEFILE_UNKNOWN;
+			}
 
-		// Verify the DOS header
-		if (!pef.mzHeader().isValid())
-		{
-			return PEFILE_UNKNOWN;
-		}
+			IStreamWrapper stream_w(stream);
+			if (!stream_w)
+			{
+				return PEFILE_UNKNOWN;
+			}
 
-		// Read PE header. Note that at this point, we read the header as if
-		// it was 32-bit PE file.
-		if (pef.readPeHeader() != ERROR_NONE)
-		{
-			return PEFILE_UNKNOWN;
-		}
+			// Machine is the first field of the file header, which follows the NT signature.
+			// Magic is the first field of the optional header, which follows the file header.
+			const std::size_t machineOffset = sizeof(dword);
+			const std::size_t magicOffset = machineOffset + PELIB_IMAGE_FILE_HEADER::size();
+			// Fields beyond the end of the file are read as zero
+			std::vector<unsigned char> vBuffer;
+			std::size_t uiFieldsSize = magicOffset - machineOffset + sizeof(word);
+			const unsigned char* fields = readStreamRange(
+					stream_w,
+					std::uint64_t(mzHeader.getAddressOfPeHeader()) + machineOffset,
+					uiFieldsSize,
+					vBuffer);
+
+			auto readWord = [&](std::size_t offset) -> word
+			{
+				return (offset + sizeof(word) <= uiFieldsSize) ? (fields[offset] | (fields[offset + 1] << 8)) : 0;
+			};
+
+			word machine = readWord(0);
+			word magic = readWord(magicOffset - machineOffset);
 
-		word machine = pef.peHeader().getMachine();
-		word magic = pef.peHeader().getMagic();
+			// jk2012-02-20: make the PEFILE32 be the default return value
+			if ((machine == PELIB_IMAGE_FILE_MACHINE_AMD64
+						|| machine == PELIB_IMAGE_FILE_MACHINE_IA64)
+					&& magic == PELIB_IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+			{
+				return PEFILE64;
+			}
+			else
+			{
+				return PEFILE32;
+			}
+		}
 
-		// jk2012-02-20: make the PEFILE32 be the default return value
-		if ((machine == PELIB_IMAGE_FILE_MACHINE_AMD64
-					|| machine == PELIB_IMAGE_FILE_MACHINE_IA64)
-				&& magic == PELIB_IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+		/**
+		* Creates a PE file object which takes over an already read MZ header and reads the PE header.
+		* @param mzHeader MZ header of the file.
+		* @param args Arguments of the constructor of the PE file object.
+		* @return The PE file object or nullptr if its PE header cannot be read.
+		**/
+		template<typename PeFileType, typename... Args>
+		PeFile* createPeFile(const MzHeader& mzHeader, Args&&... args)
 		{
-			return PEFILE64;
+			std::unique_ptr<PeFileType> file(new PeFileType(std::forward<Args>(args)...));
+			file->mzHeader() = mzHeader;
+			if (file->readPeHeader() != ERROR_NONE)
+			{
+				return nullptr;
+			}
+			return file.release();
 		}
-		else
+
+		template<typename... Args>
+		PeFile* createPeFile(unsigned int type, const MzHeader& mzHeader, Args&&... args)
 		{
-			return PEFILE32;
+			if (type == PEFILE32)
+			{
+				return createPeFile<PeFile32>(mzHeader, std::forward<Args>(args)...);
+			}
+			else if (type == PEFILE64)
+			{
+				return createPeFile<PeFile64>(mzHeader, std::forward<Args>(args)...);
+			}
+			else
+			{
+				return nullptr;
+			}
 		}
 	}
 
@@ -460,8 +690,8 @@ namespace PeLib
 	**/
 	unsigned int getFileType(const std::string strFilename)
 	{
-		PeFile32 pef(strFilename);
-		return getFileType(pef);
+		std::ifstream ifFile(strFilename, std::ifstream::binary);
+		return getFileType(ifFile);
 	}
 
 	/**
@@ -470,50 +700,67 @@ namespace PeLib
 	**/
 	unsigned int getFileType(std::istream& stream)
 	{
-		PeFile32 pef(stream);
-		return getFileType(pef);
+		MzHeader mzHeader;
+		return detectFileType(stream, mzHeader);
 	}
 
 	/**
 	* Opens a PE file. The return type is either PeFile32 or PeFile64 object. If an error occurs the return
-	* value is 0.
+	* value is 0. The file is memory mapped and its MZ and PE headers are already read.
 	* @param strFilename Name of a file.
 	* @return Either a PeFile32 object, a PeFil64 object or 0.
 	**/
 	PeFile* openPeFile(const std::string& strFilename)
 	{
-		unsigned int type = getFileType(strFilename);
-
-		if (type == PEFILE32)
+		std::unique_ptr<MappedFileByteSource> source(new MappedFileByteSource(strFilename));
+		if (!source->isOpen())
 		{
-			return new PeFile32(strFilename);
-		}
-		else if (type == PEFILE64)
-		{
-			return new PeFile64(strFilename);
+			return nullptr;
 		}
-		else
+
+		if (source->size() != 0)
 		{
-			return nullptr;
+			ByteSourceStream stream(*source);
+			MzHeader mzHeader;
+			unsigned int type = detectFileType(stream, mzHeader);
+			return createPeFile(type, mzHeader, std::unique_ptr<ByteSource>(std::move(source)), strFilename);
 		}
+
+		// Files which cannot be mapped are read as a stream
+		std::ifstream ifFile(strFilename, std::ifstream::binary);
+		MzHeader mzHeader;
+		unsigned int type = detectFileType(ifFile, mzHeader);
+		return createPeFile(type, mzHeader, strFilename);
 	}
 
+	/**
+	* Opens a PE file from a stream. The MZ and PE headers of the returned object are already read.
+	* @param stream Input stream, which must outlive the returned object.
+	* @return Either a PeFile32 object, a PeFil64 object or 0.
+	**/
 	PeFile* openPeFile(std::istream& stream)
 	{
-		unsigned int type = getFileType(stream);
+		MzHeader mzHeader;
+		unsigned int type = detectFileType(stream, mzHeader);
+		return createPeFile(type, mzHeader, stream);
+	}
 
-		if (type == PEFILE32)
-		{
-			return new PeFile32(stream);
-		}
-		else if (type == PEFILE64)
-		{
-			return new PeFile64(stream);
-		}
-		else
+	/**
+	* Opens a PE file from a byte source. The MZ and PE headers of the returned object are already read.
+	* @param source Byte source of the file, taken over by the returned object.
+	* @return Either a PeFile32 object, a PeFil64 object or 0.
+	**/
+	PeFile* openPeFile(std::unique_ptr<ByteSource> source)
+	{
+		if (!source)
 		{
 			return nullptr;
 		}
+
+		ByteSourceStream stream(*source);
+		MzHeader mzHeader;
+		unsigned int type = detectFileType(stream, mzHeader);
+		return createPeFile(type, mzHeader, std::move(source));
 	}
 
 	unsigned int PELIB_IMAGE_BOUND_DIRECTORY::size() const
@@ -0,0 +1,198 @@
+/**
+ * @file PeScanner.cpp
+ * @brief Parallel scanning of many PE files.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "pelib/PeScanner.h"
+
+namespace PeLib
+{
+	namespace
+	{
+		/**
+		 * Fills the parts of the summary which depend on the bitness of the file.
+		 */
+		class SummaryVisitor : public PeFileVisitor
+		{
+			private:
+			  PeScanSummary& m_summary;
+
+			  template<int bits>
+			  void fill(PeFileT<bits>& file)
+			  {
+				  const auto& peHeader = file.peHeader();
+				  m_summary.machine = peHeader.getMachine();
+				  m_summary.numberOfSections = peHeader.getNumberOfSections();
+				  m_summary.timeDateStamp = peHeader.getTimeDateStamp();
+				  m_summary.characteristics = peHeader.getCharacteristics();
+				  m_summary.addressOfEntryPoint = peHeader.getAddressOfEntryPoint();
+				  m_summary.imageBase = peHeader.getImageBase();
+				  m_summary.sizeOfImage = peHeader.getSizeOfImage();
+				  m_summary.subsystem = peHeader.getSubsystem();
+				  m_summary.dllCharacteristics = peHeader.getDllCharacteristics();
+
+				  m_summary.hasRichHeader = file.richHeader().isHeaderValid();
+				  m_summary.hasComHeader = peHeader.calcNumberOfRvaAndSizes() > PELIB_IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR
+						  && peHeader.getIddComHeaderRva() != 0;
+
+				  m_summary.importedFiles = file.impDir().getNumberOfFiles(OLDDIR);
+				  for (std::size_t i = 0; i < m_summary.importedFiles; ++i)
+					  m_summary.importedFunctions += file.impDir().getNumberOfFunctions(static_cast<dword>(i), OLDDIR);
+
+				  m_summary.exportedFunctions = file.expDir().calcNumberOfFunctions();
+
+				  m_summary.resourceTypes = file.resDir().getNumberOfResourceTypes();
+				  for (unsigned int i = 0; i < m_summary.resourceTypes; ++i)
+					  m_summary.resources += file.resDir().getNumberOfResourcesByIndex(i);
+
+				  m_summary.relocations = file.relocDir().calcNumberOfRelocations();
+				  m_summary.debugEntries = file.debugDir().calcNumberOfEntries();
+				  m_summary.delayImportedFiles = file.delayImports().getNumberOfFiles();
+				  m_summary.certificates = file.securityDir().calcNumberOfCertificates();
+				  m_summary.coffSymbols = file.coffSymTab().getNumberOfStoredSymbols();
+			  }
+
+			public:
+			  explicit SummaryVisitor(PeScanSummary& summary) : m_summary(summary)
+			  {
+			  }
+
+			  void callback(PeFile32& file) override { fill(file); }
+			  void callback(PeFile64& file) override { fill(file); }
+		};
+	}
+
+	PeScanner::PeScanner(const PeScanOptions& options) : m_options(options), m_pool(options.threads)
+	{
+		if (m_options.maxFilesInFlight == 0)
+			m_options.maxFilesInFlight = 4 * m_pool.size();
+	}
+
+	/**
+	* @param strFilename Name of the file.
+	* @return Summary of the file. Its type is PEFILE_UNKNOWN if it is not a PE file or cannot be opened.
+	**/
+	PeScanSummary PeScanner::scanFile(const std::string& strFilename)
+	{
+		PeScanSummary summary;
+		summary.filename = strFilename;
+
+		std::unique_ptr<PeFile> file(openPeFile(strFilename));
+		if (!file)
+		{
+			summary.result = ERROR_INVALID_FILE;
+			return summary;
+		}
+
+		summary.fileType = file->getBits();
+		summary.result = m_options.parallelDirectories
+				? file->readAll(m_options.readFlags, m_pool)
+				: file->readAll(m_options.readFlags);
+		summary.loaderError = file->loaderError();
+
+		SummaryVisitor visitor(summary);
+		file->visit(visitor);
+		return summary;
+	}
+
+	/**
+	* Parses the files on the thread pool. At most maxFilesInFlight files are parsed or wait
+	* to be reported at once. With ordered output, a file is only started once it is less than
+	* maxFilesInFlight files behind the next one to be reported.
+	* @param vFilenames Names of the files.
+	* @param callback Receives the summaries, one at a time and always on the calling thread.
+	* If it throws, the files which are being parsed are finished first and no more files are started.
+	**/
+	void PeScanner::scan(const std::vector<std::string>& vFilenames, const std::function<void(const PeScanSummary&)>& callback)
+	{
+		std::mutex mutex;
+		std::condition_variable fileDone;
+		std::map<std::size_t, PeScanSummary> done; ///< Finished files which were not reported yet.
+
+		std::size_t nextToStart = 0;
+		std::size_t nextToReport = 0;
+		std::size_t running = 0;
+		std::size_t finished = 0; ///< Files whose tasks do not refer to the locals anymore.
+
+		// The tasks refer to the locals, so they must all be done before the function returns,
+		// also when the callback throws
+		struct TaskDrain
+		{
+			std::mutex& mutex;
+			std::condition_variable& fileDone;
+			const std::size_t& started;
+			const std::size_t& finished;
+
+			~TaskDrain()
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				fileDone.wait(lock, [this]() { return finished == started; });
+			}
+		} drain{mutex, fileDone, nextToStart, finished};
+
+		while (nextToReport < vFilenames.size())
+		{
+			// Keep the pool busy within the memory bound
+			while (nextToStart < vFilenames.size()
+					&& running < m_options.maxFilesInFlight
+					&& (!m_options.orderedOutput || nextToStart < nextToReport + m_options.maxFilesInFlight))
+			{
+				std::size_t index = nextToStart++;
+				++running;
+				m_pool.execute([this, &vFilenames, &mutex, &fileDone, &done, &finished, index]() {
+					PeScanSummary summary;
+					try
+					{
+						summary = scanFile(vFilenames[index]);
+					}
+					catch (...)
+					{
+						// E.g. std::bad_alloc on a hostile file, the file is reported as invalid
+						summary = PeScanSummary();
+						summary.filename = vFilenames[index];
+						summary.result = ERROR_INVALID_FILE;
+					}
+
+					std::lock_guard<std::mutex> lock(mutex);
+					done.emplace(index, std::move(summary));
+					++finished;
+					fileDone.notify_one();
+				});
+			}
+
+			std::vector<PeScanSummary> ready;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				fileDone.wait(lock, [&]() {
+					return m_options.orderedOutput ? done.count(nextToReport) != 0 : !done.empty();
+				});
+
+				if (m_options.orderedOutput)
+				{
+					for (auto it = done.find(nextToReport); it != done.end() && it->first == nextToReport; it = done.erase(it))
+					{
+						ready.push_back(std::move(it->second));
+						++nextToReport;
+					}
+				}
+				else
+				{
+					for (auto& item : done)
+						ready.push_back(std::move(item.second));
+					nextToReport += done.size();
+					done.clear();
+				}
+				running -= ready.size();
+			}
+
+			for (const auto& summary : ready)
+				callback(summary);
+		}
+	}
+}
@@ -60,9 +60,7 @@ namespace PeLib
 	// TODO: Return value is wrong if buffer was too small.
 	int RelocationsDirectory::read(const unsigned char* buffer, unsigned int buffersize)
 	{
-		std::vector<unsigned char> vRelocDirectory(buffer, buffer + buffersize);
-
-		InputBuffer ibBuffer(vRelocDirectory);
+		InputBuffer ibBuffer(buffer, buffersize);
 		read(ibBuffer, buffersize);
 
 		return ERROR_NONE;
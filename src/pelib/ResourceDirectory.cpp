@@ -10,10 +10,65 @@
 * of PeLib.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
 #include "pelib/ResourceDirectory.h"
 
 namespace PeLib
 {
+	namespace
+	{
+		/// Root nodes with more subtrees than this are read on the calling thread. Real files have a few dozen resource types at most.
+		const std::size_t MAX_PARALLEL_SUBTREES = 64;
+
+		/**
+		* Stores the name of a resource from its UTF-16 characters in the file. The legacy
+		* name keeps the low byte of every character, which the loop narrows in bulk.
+		* @param data Characters of the name.
+		* @param len Number of characters.
+		* @param entry Entry which receives the name.
+		**/
+		void decodeResourceName(const unsigned char* data, word len, PELIB_IMG_RES_DIR_ENTRY& entry)
+		{
+			entry.wstrName.resize(len);
+			for (word i = 0; i < len; i++)
+			{
+				entry.wstrName[i] = static_cast<char>(data[2 * i]);
+			}
+
+			entry.utf16Name.resize(len);
+			if (len)
+			{
+				std::memcpy(&entry.utf16Name[0], data, 2 * len);
+			}
+		}
+	}
+
+	/**
+	* Work done and nodes read by all the subtrees of the root node which are read in parallel.
+	* The limits of the resource directory apply to the work of all of them together, and every
+	* node is read by one subtree at most, so a parallel read does no more work than the limits
+	* allow even if the subtrees share their nodes.
+	**/
+	struct ResourceReadBudget
+	{
+		std::atomic<std::size_t> elements{0};
+		std::atomic<std::uint64_t> bytes{0};
+		std::mutex mutex;
+		std::unordered_map<std::size_t, const ResourceDirectory*> claimedNodes; ///< Node offset -> directory of the subtree which read it.
+
+		/// Claims a node for the subtree read into resDir, fails if another subtree claimed it before.
+		bool claimNode(std::size_t nodeOffset, const ResourceDirectory* resDir)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return claimedNodes.emplace(nodeOffset, resDir).first->second == resDir;
+		}
+	};
 
 // -------------------------------------------------- ResourceChild -------------------------------------------
 
@@ -37,10 +92,7 @@ namespace PeLib
 		{
 			ResourceLeaf* oldnode = static_cast<ResourceLeaf*>(rhs.child);
 
-			child = new ResourceLeaf;
-			child->uiElementRva = rhs.child->getElementRva();
-			static_cast<ResourceLeaf*>(child)->m_data = oldnode->m_data;
-			static_cast<ResourceLeaf*>(child)->entry = oldnode->entry;
+			child = new ResourceLeaf(*oldnode);
 		}
 		else
 			child = 0;
@@ -50,6 +102,7 @@ namespace PeLib
 	{
 		if (this != &rhs)
 		{
+			delete child;
 			entry = rhs.entry;
 			if (dynamic_cast<ResourceNode*>(rhs.child))
 			{
@@ -64,10 +117,7 @@ namespace PeLib
 			{
 				ResourceLeaf* oldnode = static_cast<ResourceLeaf*>(rhs.child);
 
-				child = new ResourceLeaf;
-				child->uiElementRva = rhs.child->getElementRva();
-				static_cast<ResourceLeaf*>(child)->m_data = oldnode->m_data;
-				static_cast<ResourceLeaf*>(child)->entry = oldnode->entry;
+				child = new ResourceLeaf(*oldnode);
 			}
 			else
 				child = 0;
@@ -76,6 +126,24 @@ namespace PeLib
 		return *this;
 	}
 
+	ResourceChild::ResourceChild(ResourceChild&& rhs) noexcept : entry(std::move(rhs.entry)), child(rhs.child)
+	{
+		rhs.child = nullptr;
+	}
+
+	ResourceChild& ResourceChild::operator=(ResourceChild&& rhs) noexcept
+	{
+		if (this != &rhs)
+		{
+			delete child;
+			entry = std::move(rhs.entry);
+			child = rhs.child;
+			rhs.child = nullptr;
+		}
+
+		return *this;
+	}
+
 	ResourceChild::~ResourceChild()
 	{
 		delete child;
@@ -215,6 +283,24 @@ namespace PeLib
 		return entry.wstrName;
 	}
 
+	/**
+	 * Returns the name of the node in UTF-8. Names read from the file are converted from
+	 * UTF-16, names set as std::string are returned as they are.
+	 *
+	 * @return Name of the node in UTF-8.
+	 */
+	std::string ResourceChild::getNameUtf8() const
+	{
+		if (entry.utf16Name.empty())
+		{
+			return entry.wstrName;
+		}
+
+		std::string strName;
+		utf16ToUtf8(entry.utf16Name.data(), entry.utf16Name.size(), strName);
+		return strName;
+	}
+
 	/**
 	 * Returns the Name value of the node.
 	 *
@@ -243,6 +329,7 @@ namespace PeLib
 	void ResourceChild::setName(const std::string& strNewName)
 	{
 		entry.wstrName = strNewName;
+		entry.utf16Name.clear();
 	}
 
 	/**
@@ -301,7 +388,8 @@ namespace PeLib
 	}
 
 	/**
-	* Reads the next resource leaf from the input file.
+	* Reads the next resource leaf from the input file. If the resource directory has a data source,
+	* only the location of the resource data is recorded and the data are read when first needed.
 	* @param inStream An input stream.
 	* @param uiRsrcOffset Offset of resource directory in the file.
 	* @param uiOffset Offset of the resource leaf that's to be read.
@@ -319,9 +407,31 @@ namespace PeLib
 			ResourceDirectory* resDir)
 	{
 		IStreamWrapper inStream_w(inStream);
+		return readEntry(inStream_w, uiRsrcOffset, uiOffset, uiRva, uiFileSize, fileSize(inStream_w), resDir);
+	}
 
+	/**
+	* Reads the resource leaf, the size of the stream is passed by the caller so that reading
+	* many leaves does not determine it for every one of them.
+	* @param inStream An input stream.
+	* @param uiRsrcOffset Offset of resource directory in the file.
+	* @param uiOffset Offset of the resource leaf that's to be read.
+	* @param uiRva RVA of the beginning of the resource directory.
+	* @param uiFileSize Size of the input file.
+	* @param ulStreamSize Size of the input stream.
+	* @param resDir Resource directory.
+	**/
+	int ResourceLeaf::readEntry(
+			std::istream& inStream,
+			unsigned int uiRsrcOffset,
+			unsigned int uiOffset,
+			unsigned int uiRva,
+			unsigned int uiFileSize,
+			std::uint64_t ulStreamSize,
+			ResourceDirectory* resDir)
+	{
 		// Invalid leaf.
-		if (uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DATA_ENTRY::size() > fileSize(inStream_w))
+		if (uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DATA_ENTRY::size() > ulStreamSize)
 		{
 			return ERROR_INVALID_FILE;
 		}
@@ -329,8 +439,8 @@ namespace PeLib
 		uiElementRva = uiOffset + uiRva;
 
 		std::vector<unsigned char> vResourceDataEntry(PELIB_IMAGE_RESOURCE_DATA_ENTRY::size());
-		inStream_w.seekg(uiRsrcOffset + uiOffset, std::ios_base::beg);
-		inStream_w.read(reinterpret_cast<char*>(vResourceDataEntry.data()), PELIB_IMAGE_RESOURCE_DATA_ENTRY::size());
+		inStream.seekg(uiRsrcOffset + uiOffset, std::ios_base::beg);
+		inStream.read(reinterpret_cast<char*>(vResourceDataEntry.data()), PELIB_IMAGE_RESOURCE_DATA_ENTRY::size());
 
 		InputBuffer inpBuffer(vResourceDataEntry);
 
@@ -342,6 +452,9 @@ namespace PeLib
 		resDir->addOccupiedAddressRange(uiElementRva, uiElementRva + PELIB_IMAGE_RESOURCE_DATA_ENTRY::size() - 1);
 
 		m_data.clear();
+		m_source.reset();
+		m_dataOffset = 0;
+		m_dataSize = 0;
 
 		unsigned int uiEntrySize = std::min(entry.Size, uiFileSize);
 
@@ -360,10 +473,19 @@ namespace PeLib
 			return ERROR_NONE;
 		}
 
-		m_data.resize(uiEntrySize);
+		if (resDir->getDataSource())
+		{
+			m_source = resDir->getDataSource();
+			m_dataOffset = uiRsrcOffset + (entry.OffsetToData - uiRva);
+			m_dataSize = uiEntrySize;
+		}
+		else
+		{
+			m_data.resize(uiEntrySize);
 
-		inStream_w.seekg(uiRsrcOffset + (entry.OffsetToData - uiRva), std::ios_base::beg);
-		inStream_w.read(reinterpret_cast<char*>(m_data.data()), uiEntrySize);
+			inStream.seekg(uiRsrcOffset + (entry.OffsetToData - uiRva), std::ios_base::beg);
+			inStream.read(reinterpret_cast<char*>(m_data.data()), uiEntrySize);
+		}
 
 		if (uiEntrySize > 0)
 		{
@@ -390,7 +512,9 @@ namespace PeLib
 		obBuffer.insert(uiOffset + 8, entry.CodePage);
 		obBuffer.insert(uiOffset + 12, entry.Reserved);
 
-		for (unsigned int i=0;i<m_data.size();i++)
+		std::vector<byte> vBuffer;
+		ByteSpan data = getDataSpan(vBuffer);
+		for (unsigned int i=0;i<data.size;i++)
 		{
 			// If it is less than RVA, it means that data are out of directory
 			// This is not ordinary but needs to be handled, otherwise few, usually packed samples won't work
@@ -398,7 +522,7 @@ namespace PeLib
 			if (entry.OffsetToData < uiRva)
 				continue;
 
-			obBuffer.insert(entry.OffsetToData - uiRva + i, m_data[i]);
+			obBuffer.insert(entry.OffsetToData - uiRva + i, data[i]);
 		}
 //		std::cout << "LeafChild: " << std::endl;
 	}
@@ -418,7 +542,7 @@ namespace PeLib
 
 	void ResourceLeaf::makeValid()
 	{
-		entry.Size = static_cast<unsigned int>(m_data.size());
+		entry.Size = static_cast<unsigned int>(getDataSize());
 	}
 
 /*	/// Returns the size of a resource leaf.
@@ -434,7 +558,68 @@ namespace PeLib
 	**/
 	std::vector<byte> ResourceLeaf::getData() const
 	{
-		return m_data;
+		if (!m_source)
+		{
+			return m_data;
+		}
+
+		std::vector<byte> vData;
+		ByteSpan data = getDataSpan(vData);
+		if (data.data != vData.data())
+		{
+			vData.assign(data.begin(), data.end());
+		}
+		return vData;
+	}
+
+	/**
+	* Returns a view of the raw data of a resource. If the data are left in a byte source which
+	* is contiguous in memory or they are owned by the leaf, the view points straight at them.
+	* Otherwise the data are read into vBuffer.
+	* @param vBuffer Buffer used when the data have to be copied.
+	* @return View of the raw data of the resource, valid as long as the leaf, its source and vBuffer.
+	**/
+	ByteSpan ResourceLeaf::getDataSpan(std::vector<byte>& vBuffer) const
+	{
+		if (!m_source)
+		{
+			return ByteSpan(m_data.data(), m_data.size());
+		}
+
+		return ByteSpan(m_source->readRange(m_dataOffset, m_dataSize, vBuffer), m_dataSize);
+	}
+
+	/**
+	* Returns the number of bytes of the resource data. It may be less than the Size value
+	* if the data are cut at the end of the file.
+	* @return Number of bytes of the resource data.
+	**/
+	std::size_t ResourceLeaf::getDataSize() const
+	{
+		return m_source ? m_dataSize : m_data.size();
+	}
+
+	/**
+	* Checks whether the raw data of the resource are read from the file on demand.
+	* @return True if the leaf refers to its data in the data source of the resource directory.
+	**/
+	bool ResourceLeaf::isDataDeferred() const
+	{
+		return m_source != nullptr;
+	}
+
+	/**
+	* Copies the raw data of the resource from the data source into the leaf.
+	**/
+	void ResourceLeaf::loadData()
+	{
+		if (m_source)
+		{
+			m_data = getData();
+			m_source.reset();
+			m_dataOffset = 0;
+			m_dataSize = 0;
+		}
 	}
 
 	/**
@@ -444,6 +629,9 @@ namespace PeLib
 	void ResourceLeaf::setData(const std::vector<byte>& vData)
 	{
 		m_data = vData;
+		m_source.reset();
+		m_dataOffset = 0;
+		m_dataSize = 0;
 	}
 
 	/**
@@ -519,7 +707,7 @@ namespace PeLib
 		entry.Reserved = dwValue;
 	}
 
-	ResourceLeaf::ResourceLeaf() : ResourceElement()
+	ResourceLeaf::ResourceLeaf() : ResourceElement(), m_dataOffset(0), m_dataSize(0)
 	{
 
 	}
@@ -646,38 +834,39 @@ namespace PeLib
 	}
 
 	/**
-	* Reads the next resource node from the input file.
+	* Reads the header of a resource node and its array of entries, but none of its children.
 	* @param inStream An input stream.
 	* @param uiRsrcOffset Offset of resource directory in the file.
 	* @param uiOffset Offset of the resource node that's to be read.
 	* @param uiRva RVA of the beginning of the resource directory.
-	* @param uiFileSize Size of the input file.
+	* @param ulStreamSize Size of the input stream.
+	* @param uiSizeOfImage Size of the image.
 	* @param resDir Resource directory.
+	* @param vEntries Vector the entries of the node are appended to, none if the node has no valid entries.
 	**/
-	int ResourceNode::read(
+	int ResourceNode::readHeader(
 			std::istream& inStream,
 			unsigned int uiRsrcOffset,
 			unsigned int uiOffset,
 			unsigned int uiRva,
-			unsigned int uiFileSize,
+			std::uint64_t ulStreamSize,
 			unsigned int uiSizeOfImage,
-			ResourceDirectory* resDir)
+			ResourceDirectory* resDir,
+			std::vector<unsigned char>& vEntries)
 	{
-		IStreamWrapper inStream_w(inStream);
-
 		// Not enough space to be a valid node.
-		if (!resDir || uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DIRECTORY::size() > fileSize(inStream_w))
+		if (uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DIRECTORY::size() > ulStreamSize)
 		{
 			return ERROR_INVALID_FILE;
 		}
 
 		uiElementRva = uiOffset + uiRva;
 
-		std::vector<unsigned char> vResourceDirectory(PELIB_IMAGE_RESOURCE_DIRECTORY::size());
-		inStream_w.seekg(uiRsrcOffset + uiOffset, std::ios_base::beg);
-		inStream_w.read(reinterpret_cast<char*>(vResourceDirectory.data()), PELIB_IMAGE_RESOURCE_DIRECTORY::size());
+		unsigned char resourceDirectory[PELIB_IMAGE_RESOURCE_DIRECTORY::size()];
+		inStream.seekg(uiRsrcOffset + uiOffset, std::ios_base::beg);
+		inStream.read(reinterpret_cast<char*>(resourceDirectory), PELIB_IMAGE_RESOURCE_DIRECTORY::size());
 
-		InputBuffer inpBuffer(vResourceDirectory);
+		InputBuffer inpBuffer(resourceDirectory, PELIB_IMAGE_RESOURCE_DIRECTORY::size());
 
 		inpBuffer >> header.Characteristics;
 		inpBuffer >> header.TimeDateStamp;
@@ -701,14 +890,14 @@ namespace PeLib
 		}
 
 		// Not enough space to be a valid node.
-		if (uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DIRECTORY::size() + uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size() > fileSize(inStream_w))
+		if (uiRsrcOffset + uiOffset + PELIB_IMAGE_RESOURCE_DIRECTORY::size() + uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size() > ulStreamSize)
 		{
 			return ERROR_INVALID_FILE;
 		}
 
-		std::vector<unsigned char> vResourceChildren(uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
-		inStream_w.read(reinterpret_cast<char*>(vResourceChildren.data()), uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
-		InputBuffer childInpBuffer(vResourceChildren);
+		std::size_t uiEntriesBegin = vEntries.size();
+		vEntries.resize(uiEntriesBegin + uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+		inStream.read(reinterpret_cast<char*>(vEntries.data() + uiEntriesBegin), uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
 
 		resDir->insertNodeOffset(uiOffset);
 		if (uiNumberOfEntries > 0)
@@ -719,73 +908,257 @@ namespace PeLib
 				);
 		}
 
-		for (unsigned int i = 0; i < uiNumberOfEntries; ++i)
+		return ERROR_NONE;
+	}
+
+	/**
+	* Reads the resource node and the whole tree below it.
+	* @param inStream An input stream.
+	* @param uiRsrcOffset Offset of resource directory in the file.
+	* @param uiOffset Offset of the resource node that's to be read.
+	* @param uiRva RVA of the beginning of the resource directory.
+	* @param uiFileSize Size of the input file.
+	* @param uiSizeOfImage Size of the image.
+	* @param resDir Resource directory.
+	**/
+	int ResourceNode::read(
+			std::istream& inStream,
+			unsigned int uiRsrcOffset,
+			unsigned int uiOffset,
+			unsigned int uiRva,
+			unsigned int uiFileSize,
+			unsigned int uiSizeOfImage,
+			ResourceDirectory* resDir)
+	{
+		if (!resDir)
+		{
+			return ERROR_INVALID_FILE;
+		}
+
+		IStreamWrapper inStream_w(inStream);
+		const std::uint64_t ulStreamSize = fileSize(inStream_w);
+
+		std::vector<unsigned char> vEntries;
+		if (readHeader(inStream_w, uiRsrcOffset, uiOffset, uiRva, ulStreamSize, uiSizeOfImage, resDir, vEntries) != ERROR_NONE)
+		{
+			return ERROR_INVALID_FILE;
+		}
+
+		ResourceReadProgress progress;
+		progress.elements = 1;
+		progress.bytes = PELIB_IMAGE_RESOURCE_DIRECTORY::size() + vEntries.size();
+		return readChildren(inStream_w, uiRsrcOffset, uiRva, uiFileSize, ulStreamSize, uiSizeOfImage, resDir, vEntries, progress);
+	}
+
+	/**
+	* Reads the children of the node and the whole tree below them. The tree is walked depth-first
+	* with an explicit stack, so a deep or cyclic tree cannot exhaust the call stack. A node whose
+	* child is at the offset of a node read before keeps only the children before that one.
+	* Reading stops, keeping the tree read so far, once it reaches a limit of the resource directory.
+	* If the progress has a budget, reading also stops once the work of all the trees sharing it
+	* reaches a limit or at a node which another tree read.
+	* @param inStream An input stream.
+	* @param uiRsrcOffset Offset of resource directory in the file.
+	* @param uiRva RVA of the beginning of the resource directory.
+	* @param uiFileSize Size of the input file.
+	* @param ulStreamSize Size of the input stream.
+	* @param uiSizeOfImage Size of the image.
+	* @param resDir Resource directory.
+	* @param vEntries Entries of the node, the entries of the nodes below it are appended temporarily.
+	* @param progress Work done so far, updated by the work done by this call.
+	**/
+	int ResourceNode::readChildren(
+			std::istream& inStream,
+			unsigned int uiRsrcOffset,
+			unsigned int uiRva,
+			unsigned int uiFileSize,
+			std::uint64_t ulStreamSize,
+			unsigned int uiSizeOfImage,
+			ResourceDirectory* resDir,
+			std::vector<unsigned char>& vEntries,
+			ResourceReadProgress& progress)
+	{
+		// Node whose children are being read. Every node but the first one is owned by its child
+		// entry, which is added to the parent node once the node is complete.
+		struct PendingNode
+		{
+			ResourceNode* node;
+			ResourceChild rc;
+			std::size_t entriesBegin;
+			unsigned int numberOfEntries;
+			unsigned int nextEntry;
+			unsigned int depth;
+		};
+
+		const ResourceReadLimits& limits = resDir->getReadLimits();
+		ResourceReadBudget* budget = progress.budget;
+
+		// Counts work towards the limits, of this tree and of all the trees sharing the budget
+		auto addWork = [&](std::size_t elements, std::uint64_t bytes)
+		{
+			progress.elements += elements;
+			progress.bytes += bytes;
+			if (budget)
+			{
+				budget->elements += elements;
+				budget->bytes += bytes;
+			}
+		};
+
+		// vEntries holds the entries of all pending nodes, those of the deepest node last
+		std::vector<PendingNode> vPending;
+		vPending.push_back({this, ResourceChild(), 0, static_cast<unsigned int>(vEntries.size() / PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size()), 0, 0});
+
+		// Names are decoded in place if the directory is in memory, otherwise each one is read at once
+		const ByteSource* source = getContiguousByteSource(inStream);
+		std::vector<unsigned char> vName;
+		auto readNameRange = [&](std::uint64_t ulOffset, std::size_t uiSize) -> const unsigned char*
 		{
+			if (source && source->contains(ulOffset, uiSize))
+			{
+				return source->data() + ulOffset;
+			}
+
+			// The name may reach up to two bytes beyond the end of the stream, which are zero
+			std::size_t uiAvailable = uiSize;
+			readStreamRange(inStream, ulOffset, uiAvailable, vName);
+			vName.resize(uiSize, 0);
+			return vName.data();
+		};
+
+		// Adds the deepest pending node to its parent.
+		auto completeNode = [&]()
+		{
+			PendingNode& pending = vPending.back();
+			vEntries.resize(pending.entriesBegin);
+			if (vPending.size() > 1)
+			{
+				vPending[vPending.size() - 2].node->children.push_back(std::move(pending.rc));
+			}
+			vPending.pop_back();
+		};
+
+		while (!vPending.empty())
+		{
+			PendingNode& pending = vPending.back();
+			if (pending.nextEntry == pending.numberOfEntries)
+			{
+				completeNode();
+				continue;
+			}
+
+			if (progress.elements >= limits.maxElements || progress.bytes > limits.maxBytes
+				|| (budget && (budget->elements >= limits.maxElements || budget->bytes > limits.maxBytes)))
+			{
+				break;
+			}
+
+			InputBuffer childInpBuffer(
+					vEntries.data() + pending.entriesBegin + pending.nextEntry * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size(),
+					PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+			pending.nextEntry++;
+
 			ResourceChild rc;
 			childInpBuffer >> rc.entry.irde.Name;
 			childInpBuffer >> rc.entry.irde.OffsetToData;
 
-			unsigned int lastPos = inStream_w.tellg();
+			// A failed read of the previous element must not affect this one
+			inStream.clear();
 
 			if (rc.entry.irde.Name & PELIB_IMAGE_RESOURCE_NAME_IS_STRING)
 			{
 				// Enough space to read string length?
-				if ((rc.entry.irde.Name & ~PELIB_IMAGE_RESOURCE_NAME_IS_STRING) + 2 < fileSize(inStream_w))
+				if ((rc.entry.irde.Name & ~PELIB_IMAGE_RESOURCE_NAME_IS_STRING) + 2 < ulStreamSize)
 				{
 					unsigned int uiNameOffset = rc.entry.irde.Name & ~PELIB_IMAGE_RESOURCE_NAME_IS_STRING;
-					if (uiRsrcOffset + uiNameOffset + sizeof(word) > fileSize(inStream_w))
+					if (uiRsrcOffset + uiNameOffset + sizeof(word) > ulStreamSize)
 					{
 						return ERROR_INVALID_FILE;
 					}
 
-					inStream_w.seekg(uiRsrcOffset + uiNameOffset, std::ios_base::beg);
-
-					word len;
-					inStream_w.read(reinterpret_cast<char*>(&len), sizeof(word));
+					std::uint64_t ulNameOffset = uiRsrcOffset + uiNameOffset;
+					const unsigned char* lenData = readNameRange(ulNameOffset, sizeof(word));
+					word len = static_cast<word>(lenData[0] | (lenData[1] << 8));
 
 					// Enough space to read string?
-					if (uiRsrcOffset + uiNameOffset + 2 * len > fileSize(inStream_w))
+					if (uiRsrcOffset + uiNameOffset + 2 * len > ulStreamSize)
 					{
 						return ERROR_INVALID_FILE;
 					}
 
-					// jk: This construction is incorrect on 64bit systems
-					// wchar_t c;
-					word c;
-					for (word ii=0; ii<len; ++ii)
-					{
-						inStream_w.read(reinterpret_cast<char*>(&c), sizeof(word));
-						rc.entry.wstrName += c;
-					}
+					ulNameOffset += sizeof(word);
+					const unsigned char* chars = readNameRange(ulNameOffset, 2 * len);
+					decodeResourceName(chars, len, rc.entry);
+					addWork(0, sizeof(word) + 2 * len);
 				}
-
-				inStream_w.seekg(lastPos, std::ios_base::beg);
 			}
 
 			const auto value = (rc.entry.irde.OffsetToData & PELIB_IMAGE_RESOURCE_DATA_IS_DIRECTORY) ?
 				(rc.entry.irde.OffsetToData & ~PELIB_IMAGE_RESOURCE_DATA_IS_DIRECTORY) : rc.entry.irde.OffsetToData;
-			// Detect cycles to prevent infinite recursion.
+			if (progress.checkedOffsets)
+			{
+				progress.checkedOffsets->push_back(value);
+			}
+
+			// Detect cycles to prevent infinite traversal.
 			if (resDir->hasNodeOffset(value))
 			{
-				return ERROR_NONE;
+				progress.stopped = progress.stopped || vPending.size() == 1;
+				completeNode();
+				continue;
 			}
 
 			if (rc.entry.irde.OffsetToData & PELIB_IMAGE_RESOURCE_DATA_IS_DIRECTORY)
 			{
-				rc.child = new ResourceNode;
+				if (pending.depth >= limits.maxDepth)
+				{
+					break;
+				}
+
+				// A node read by another tree sharing the budget makes the order of the trees matter
+				if (budget && !budget->claimNode(value, resDir))
+				{
+					break;
+				}
+
+				ResourceNode* node = new ResourceNode;
+				rc.child = node;
+
+				std::size_t uiEntriesBegin = vEntries.size();
+				if (node->readHeader(inStream, uiRsrcOffset, value, uiRva, ulStreamSize, uiSizeOfImage, resDir, vEntries) != ERROR_NONE)
+				{
+					return ERROR_INVALID_FILE;
+				}
+
+				unsigned int uiNumberOfEntries = static_cast<unsigned int>((vEntries.size() - uiEntriesBegin) / PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+				unsigned int uiDepth = pending.depth + 1;
+				addWork(1, PELIB_IMAGE_RESOURCE_DIRECTORY::size() + uiNumberOfEntries * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+				vPending.push_back({node, std::move(rc), uiEntriesBegin, uiNumberOfEntries, 0, uiDepth});
 			}
 			else
 			{
-				rc.child = new ResourceLeaf;
+				ResourceLeaf* leaf = new ResourceLeaf;
+				rc.child = leaf;
+
+				if (leaf->readEntry(inStream, uiRsrcOffset, value, uiRva, uiFileSize, ulStreamSize, resDir) != ERROR_NONE)
+				{
+					return ERROR_INVALID_FILE;
+				}
+
+				addWork(1, PELIB_IMAGE_RESOURCE_DATA_ENTRY::size());
+				pending.node->children.push_back(std::move(rc));
 			}
+		}
 
-			if (rc.child->read(inStream_w, uiRsrcOffset, value, uiRva, uiFileSize, uiSizeOfImage, resDir) != ERROR_NONE)
+		// A limit was reached or a node was claimed by another tree, the nodes read so far are kept
+		if (!vPending.empty())
+		{
+			resDir->setLoaderError(LDR_ERROR_RSRC_LIMIT_EXCEEDED);
+			progress.stopped = true;
+			while (!vPending.empty())
 			{
-				return ERROR_INVALID_FILE;
+				completeNode();
 			}
-
-			children.push_back(rc);
-			inStream_w.seekg(lastPos, std::ios_base::beg);
 		}
 
 		return ERROR_NONE;
@@ -1041,13 +1414,14 @@ namespace PeLib
 	/**
 	* Constructor
 	*/
-	ResourceDirectory::ResourceDirectory() : m_readOffset(0), m_ldrError(LDR_ERROR_NONE)
+	ResourceDirectory::ResourceDirectory() : m_readOffset(0), m_executor(nullptr), m_ldrError(LDR_ERROR_NONE)
 	{
 
 	}
 
 	/**
-	* Returns the root node of the resource directory.
+	* Returns the root node of the resource directory. The caller may modify the tree, the
+	* lookups check the index of the resources against the tree.
 	* @return Root node of the resource directory.
 	**/
 	ResourceNode* ResourceDirectory::getRoot()
@@ -1081,6 +1455,281 @@ namespace PeLib
 		}
 	}
 
+	/**
+	* Sets the source which the data of the leaves are left in when the resource directory is read.
+	* The source must be the one the directory is read from. The leaves share its ownership,
+	* so copies of the directory and of its leaves can read their data after the file is gone.
+	* @param source Data source, nullptr to copy the data of the leaves when reading them.
+	**/
+	void ResourceDirectory::setDataSource(std::shared_ptr<const ByteSource> source)
+	{
+		m_dataSource = std::move(source);
+	}
+
+	const std::shared_ptr<const ByteSource>& ResourceDirectory::getDataSource() const
+	{
+		return m_dataSource;
+	}
+
+	/**
+	* Sets the limits of the work done when the resource tree is read. Reading stops once
+	* the tree reaches one of them, see ResourceReadLimits.
+	* @param limits Limits of depth, number of elements and size of the tree.
+	**/
+	void ResourceDirectory::setReadLimits(const ResourceReadLimits& limits)
+	{
+		m_readLimits = limits;
+	}
+
+	const ResourceReadLimits& ResourceDirectory::getReadLimits() const
+	{
+		return m_readLimits;
+	}
+
+	/**
+	* Sets the thread pool which the subtrees of the root node are read on. The tree read
+	* is the same as the one read on the calling thread.
+	* @param executor Thread pool, nullptr to read the whole tree on the calling thread.
+	**/
+	void ResourceDirectory::setTaskExecutor(TaskExecutor* executor)
+	{
+		m_executor = executor;
+	}
+
+	TaskExecutor* ResourceDirectory::getTaskExecutor() const
+	{
+		return m_executor;
+	}
+
+	/**
+	* Subtree of the root node read on its own, into a scratch directory which knows only
+	* the nodes read before the subtrees.
+	**/
+	struct ResourceDirectory::ParallelSubtree
+	{
+		ResourceDirectory scratch;
+		ResourceNode parent; ///< Receives the child of the root node.
+		ResourceReadProgress progress;
+		std::vector<std::size_t> checkedOffsets;
+		int result = ERROR_NONE;
+	};
+
+	/**
+	* Progress of a parallel read of the subtrees of the root node, shared by the tasks which read them.
+	**/
+	struct ResourceDirectory::ParallelRead
+	{
+		const ByteSource* source;
+		unsigned int rsrcOffset;
+		unsigned int rva;
+		unsigned int fileSize;
+		std::uint64_t streamSize;
+		unsigned int sizeOfImage;
+		std::vector<unsigned char> vEntries; ///< Entries of the root node.
+		std::vector<ParallelSubtree> subtrees;
+		ResourceReadBudget budget; ///< Shared by the subtrees, starts with the work of the root node.
+		std::atomic<std::size_t> nextSubtree;
+		std::size_t finishedSubtrees;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	/**
+	* Reads the resource tree. Without an executor, or if the directory is not in memory, the
+	* tree is read on the calling thread. So is a root node with too many entries or with two
+	* entries of the same node. Otherwise every subtree of the root node is read on its own and
+	* the subtrees are added in the order of the root entries, as if they were read one after
+	* another. The subtrees share one budget of work and read every node once at most, see
+	* ResourceReadBudget. A subtree which stopped early, because of a limit or at a node read by
+	* another subtree, or which would have seen a node of an earlier subtree as a cycle, is read
+	* again on the calling thread. So the tree, the occupied ranges and the loader error are
+	* the same as those read on the calling thread, and the limits bound the work of both reads.
+	* @param inStream Input stream.
+	* @param uiRsrcOffset Offset of resource directory in the file.
+	* @param uiRva RVA of the beginning of the resource directory.
+	* @param uiFileSize Size of the input file.
+	* @param uiSizeOfImage Size of the image.
+	**/
+	int ResourceDirectory::readTree(
+			std::istream& inStream,
+			unsigned int uiRsrcOffset,
+			unsigned int uiRva,
+			unsigned int uiFileSize,
+			unsigned int uiSizeOfImage)
+	{
+		const ByteSource* source = getContiguousByteSource(inStream);
+		if (!m_executor || !source)
+		{
+			return m_rnRoot.read(inStream, uiRsrcOffset, 0, uiRva, uiFileSize, uiSizeOfImage, this);
+		}
+
+		// Tasks may outlive this call, the state they share is released by the last of them
+		auto state = std::make_shared<ParallelRead>();
+		state->source = source;
+		state->rsrcOffset = uiRsrcOffset;
+		state->rva = uiRva;
+		state->fileSize = uiFileSize;
+		state->streamSize = source->size();
+		state->sizeOfImage = uiSizeOfImage;
+
+		if (m_rnRoot.readHeader(inStream, uiRsrcOffset, 0, uiRva, state->streamSize, uiSizeOfImage, this, state->vEntries) != ERROR_NONE)
+		{
+			return ERROR_INVALID_FILE;
+		}
+
+		ResourceReadProgress progress;
+		progress.elements = 1;
+		progress.bytes = PELIB_IMAGE_RESOURCE_DIRECTORY::size() + state->vEntries.size();
+
+		// Subtrees which start at the same node would be read twice
+		std::size_t uiNumberOfSubtrees = state->vEntries.size() / PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size();
+		std::unordered_set<dword> rootNodes;
+		bool bSharesNodes = false;
+		for (std::size_t i = 0; i < uiNumberOfSubtrees && !bSharesNodes; i++)
+		{
+			dword dwOffsetToData;
+			std::memcpy(&dwOffsetToData, state->vEntries.data() + i * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size() + sizeof(dword), sizeof(dword));
+			if (dwOffsetToData & PELIB_IMAGE_RESOURCE_DATA_IS_DIRECTORY)
+			{
+				bSharesNodes = !rootNodes.insert(dwOffsetToData).second;
+			}
+		}
+
+		if (uiNumberOfSubtrees < 2 || uiNumberOfSubtrees > MAX_PARALLEL_SUBTREES || bSharesNodes)
+		{
+			return m_rnRoot.readChildren(inStream, uiRsrcOffset, uiRva, uiFileSize, state->streamSize, uiSizeOfImage, this, state->vEntries, progress);
+		}
+
+		state->subtrees.resize(uiNumberOfSubtrees);
+		for (ParallelSubtree& subtree : state->subtrees)
+		{
+			subtree.scratch.m_resourceNodeOffsets = m_resourceNodeOffsets;
+			subtree.scratch.m_readLimits = m_readLimits;
+			subtree.scratch.m_dataSource = m_dataSource;
+			subtree.progress.checkedOffsets = &subtree.checkedOffsets;
+			subtree.progress.budget = &state->budget;
+		}
+		state->budget.elements = progress.elements;
+		state->budget.bytes = progress.bytes;
+		state->nextSubtree = 0;
+		state->finishedSubtrees = 0;
+
+		for (std::size_t i = 1; i < uiNumberOfSubtrees; i++)
+		{
+			m_executor->execute([state]() { readClaimedSubtrees(*state); });
+		}
+		readClaimedSubtrees(*state);
+
+		// Wait for the subtrees which are still being read by the other tasks
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->finished.wait(lock, [&state]() { return state->finishedSubtrees == state->subtrees.size(); });
+		}
+
+		for (std::size_t i = 0; i < uiNumberOfSubtrees; i++)
+		{
+			if (progress.elements >= m_readLimits.maxElements || progress.bytes > m_readLimits.maxBytes)
+			{
+				setLoaderError(LDR_ERROR_RSRC_LIMIT_EXCEEDED);
+				return ERROR_NONE;
+			}
+
+			ParallelSubtree& subtree = state->subtrees[i];
+			bool bSeesEarlierNode = std::any_of(subtree.checkedOffsets.begin(), subtree.checkedOffsets.end(),
+					[this](std::size_t offset) { return hasNodeOffset(offset); });
+
+			if (bSeesEarlierNode
+				|| subtree.progress.stopped
+				|| subtree.progress.elements >= m_readLimits.maxElements - progress.elements
+				|| subtree.progress.bytes > m_readLimits.maxBytes - progress.bytes)
+			{
+				std::vector<unsigned char> vEntry(
+						state->vEntries.begin() + i * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size(),
+						state->vEntries.begin() + (i + 1) * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+				int result = m_rnRoot.readChildren(inStream, uiRsrcOffset, uiRva, uiFileSize, state->streamSize, uiSizeOfImage, this, vEntry, progress);
+				if (result != ERROR_NONE || progress.stopped)
+				{
+					return result;
+				}
+
+				continue;
+			}
+
+			m_occupiedAddresses.insert(m_occupiedAddresses.end(), subtree.scratch.m_occupiedAddresses.begin(), subtree.scratch.m_occupiedAddresses.end());
+			m_resourceNodeOffsets.insert(subtree.scratch.m_resourceNodeOffsets.begin(), subtree.scratch.m_resourceNodeOffsets.end());
+			setLoaderError(subtree.scratch.loaderError());
+			progress.elements += subtree.progress.elements;
+			progress.bytes += subtree.progress.bytes;
+
+			if (subtree.result != ERROR_NONE)
+			{
+				return subtree.result;
+			}
+
+			std::move(subtree.parent.children.begin(), subtree.parent.children.end(), std::back_inserter(m_rnRoot.children));
+		}
+
+		return ERROR_NONE;
+	}
+
+	/**
+	* Claims the subtrees of the root node one by one and reads them through a stream of its own.
+	* Once all the subtrees are claimed, the source is not touched anymore, as it may not exist by then.
+	* @param state Shared state of the parallel read.
+	**/
+	void ResourceDirectory::readClaimedSubtrees(ParallelRead& state)
+	{
+		std::unique_ptr<ByteSourceStream> stream;
+
+		for (std::size_t i = state.nextSubtree++; i < state.subtrees.size(); i = state.nextSubtree++)
+		{
+			if (!stream)
+				stream.reset(new ByteSourceStream(*state.source));
+
+			ParallelSubtree& subtree = state.subtrees[i];
+			std::vector<unsigned char> vEntry(
+					state.vEntries.begin() + i * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size(),
+					state.vEntries.begin() + (i + 1) * PELIB_IMAGE_RESOURCE_DIRECTORY_ENTRY::size());
+			try
+			{
+				subtree.result = subtree.parent.readChildren(*stream, state.rsrcOffset, state.rva, state.fileSize, state.streamSize,
+						state.sizeOfImage, &subtree.scratch, vEntry, subtree.progress);
+			}
+			catch (...)
+			{
+				// Read again on the calling thread, where the exception reaches the caller
+				subtree.progress.stopped = true;
+			}
+
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (++state.finishedSubtrees == state.subtrees.size())
+				state.finished.notify_all();
+		}
+	}
+
+	/**
+	* Copies the data of all leaves which refer to the data source into the leaves.
+	**/
+	void ResourceDirectory::loadData()
+	{
+		std::vector<ResourceNode*> nodes(1, &m_rnRoot);
+		while (!nodes.empty())
+		{
+			ResourceNode* node = nodes.back();
+			nodes.pop_back();
+
+			for (auto& rc : node->children)
+			{
+				if (!rc.child)
+					continue;
+				else if (rc.child->isLeaf())
+					static_cast<ResourceLeaf*>(rc.child)->loadData();
+				else
+					nodes.push_back(static_cast<ResourceNode*>(rc.child));
+			}
+		}
+	}
+
 	/**
 	* Correctly sorts the resource nodes of the resource tree. This function should be called
 	* before calling rebuild.
@@ -1088,6 +1737,7 @@ namespace PeLib
 	void ResourceDirectory::makeValid()
 	{
 		m_rnRoot.makeValid();
+		invalidateIndex();
 	}
 
 	/**
@@ -1183,6 +1833,7 @@ namespace PeLib
 		rcCurr.child = new ResourceNode;
 		rcCurr.entry.irde.Name = dwResTypeId;
 		m_rnRoot.children.push_back(rcCurr);
+		invalidateIndex();
 
 		return ERROR_NONE;
 	}
@@ -1208,6 +1859,7 @@ namespace PeLib
 		rcCurr.entry.wstrName = strResTypeName;
 		rcCurr.child = new ResourceNode;
 		m_rnRoot.children.push_back(rcCurr);
+		invalidateIndex();
 
 		return ERROR_NONE;
 	}
@@ -1233,6 +1885,7 @@ namespace PeLib
 		if (Iter->isNamedResource()) isNamed = true;
 
 		m_rnRoot.children.erase(Iter);
+		invalidateIndex();
 
 		if (isNamed) m_rnRoot.header.NumberOfNamedEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
 		else m_rnRoot.header.NumberOfIdEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
@@ -1261,6 +1914,7 @@ namespace PeLib
 		if (Iter->isNamedResource()) isNamed = true;
 
 		m_rnRoot.children.erase(Iter);
+		invalidateIndex();
 
 		if (isNamed) m_rnRoot.header.NumberOfNamedEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
 		else m_rnRoot.header.NumberOfIdEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
@@ -1278,6 +1932,7 @@ namespace PeLib
 		if (m_rnRoot.children[uiIndex].isNamedResource()) isNamed = true;
 
 		m_rnRoot.children.erase(m_rnRoot.children.begin() + uiIndex);
+		invalidateIndex();
 
 		if (isNamed) m_rnRoot.header.NumberOfNamedEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
 		else m_rnRoot.header.NumberOfIdEntries = static_cast<PeLib::word>(m_rnRoot.children.size());
@@ -1428,13 +2083,7 @@ namespace PeLib
 	**/
 	int ResourceDirectory::resourceTypeIdToIndex(dword dwResTypeId) const
 	{
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& i) { return i.equalId(dwResTypeId); }
-		);
-		if (Iter == m_rnRoot.children.end()) return -1;
-		return static_cast<unsigned int>(std::distance(m_rnRoot.children.begin(), Iter));
+		return findChild(m_rnRoot, &resourceIndex().types, dwResTypeId);
 	}
 
 	/**
@@ -1444,13 +2093,7 @@ namespace PeLib
 	**/
 	int ResourceDirectory::resourceTypeNameToIndex(const std::string& strResTypeName) const
 	{
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& i) { return i.equalName(strResTypeName); }
-		);
-		if (Iter == m_rnRoot.children.end()) return -1;
-		return static_cast<unsigned int>(std::distance(m_rnRoot.children.begin(), Iter));
+		return findChild(m_rnRoot, &resourceIndex().types, strResTypeName);
 	}
 
 	/**
@@ -1460,27 +2103,14 @@ namespace PeLib
 	**/
 	unsigned int ResourceDirectory::getNumberOfResources(dword dwId) const
 	{
-//		std::vector<ResourceChild>::const_iterator IterD = m_rnRoot.children.begin();
-//		std::cout << dwId << std::endl;
-//		while (IterD != m_rnRoot.children.end())
-//		{
-//			std::cout << IterD->entry.irde.Name << std::endl;
-//			++IterD;
-//		}
-
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& i) { return i.equalId(dwId); }
-		);
-		if (Iter == m_rnRoot.children.end())
+		int iResTypeIndex = resourceTypeIdToIndex(dwId);
+		if (iResTypeIndex == -1)
 		{
 			return 0xFFFFFFFF;
 		}
 		else
 		{
-			ResourceNode* currNode = static_cast<ResourceNode*>(Iter->child);
-			return static_cast<unsigned int>(currNode->children.size());
+			return getNumberOfResourcesByIndex(iResTypeIndex);
 		}
 	}
 
@@ -1491,19 +2121,14 @@ namespace PeLib
 	**/
 	unsigned int ResourceDirectory::getNumberOfResources(const std::string& strResTypeName) const
 	{
-		auto Iter = std::find_if(
-				m_rnRoot.children.begin(),
-				m_rnRoot.children.end(),
-				[&](const auto& i) { return i.equalName(strResTypeName); }
-		);
-		if (Iter == m_rnRoot.children.end())
+		int iResTypeIndex = resourceTypeNameToIndex(strResTypeName);
+		if (iResTypeIndex == -1)
 		{
 			return 0xFFFFFFFF;
 		}
 		else
 		{
-			ResourceNode* currNode = static_cast<ResourceNode*>(Iter->child);
-			return static_cast<unsigned int>(currNode->children.size());
+			return getNumberOfResourcesByIndex(iResTypeIndex);
 		}
 	}
 
@@ -1579,7 +2204,81 @@ namespace PeLib
 		currNode = static_cast<ResourceNode*>(currNode->children[uiResIndex].child);
 		ResourceLeaf* currLeaf = static_cast<ResourceLeaf*>(currNode->children[0].child);
 
-		data.assign(currLeaf->m_data.begin(), currLeaf->m_data.end());
+		data = currLeaf->getData();
+	}
+
+	/**
+	* Returns the leaf of a specific resource in a specific language.
+	* @param dwResTypeId Identifies the resource type of the resource.
+	* @param dwResId Identifies the resource.
+	* @param dwLanguage ID of the language.
+	* @return The leaf of the resource, nullptr if there is no such resource.
+	**/
+	const ResourceLeaf* ResourceDirectory::getResourceLeaf(dword dwResTypeId, dword dwResId, dword dwLanguage) const
+	{
+		return getResourceLeafT(dwResTypeId, dwResId, dwLanguage);
+	}
+
+	/**
+	* Returns the leaf of a specific resource in a specific language.
+	* @param dwResTypeId Identifies the resource type of the resource.
+	* @param strResName Identifies the resource.
+	* @param dwLanguage ID of the language.
+	* @return The leaf of the resource, nullptr if there is no such resource.
+	**/
+	const ResourceLeaf* ResourceDirectory::getResourceLeaf(dword dwResTypeId, const std::string& strResName, dword dwLanguage) const
+	{
+		return getResourceLeafT(dwResTypeId, strResName, dwLanguage);
+	}
+
+	/**
+	* Returns the leaf of a specific resource in a specific language.
+	* @param strResTypeName Identifies the resource type of the resource.
+	* @param dwResId Identifies the resource.
+	* @param dwLanguage ID of the language.
+	* @return The leaf of the resource, nullptr if there is no such resource.
+	**/
+	const ResourceLeaf* ResourceDirectory::getResourceLeaf(const std::string& strResTypeName, dword dwResId, dword dwLanguage) const
+	{
+		return getResourceLeafT(strResTypeName, dwResId, dwLanguage);
+	}
+
+	/**
+	* Returns the leaf of a specific resource in a specific language.
+	* @param strResTypeName Identifies the resource type of the resource.
+	* @param strResName Identifies the resource.
+	* @param dwLanguage ID of the language.
+	* @return The leaf of the resource, nullptr if there is no such resource.
+	**/
+	const ResourceLeaf* ResourceDirectory::getResourceLeaf(const std::string& strResTypeName, const std::string& strResName, dword dwLanguage) const
+	{
+		return getResourceLeafT(strResTypeName, strResName, dwLanguage);
+	}
+
+	/**
+	* Returns the leaves of all resources of a specific resource type in all languages, in the
+	* order of the resource tree.
+	* @param dwResTypeId Identifies the resource type.
+	* @return Leaves of the resources, empty if there is no such resource type.
+	**/
+	std::vector<const ResourceLeaf*> ResourceDirectory::getResourceLeaves(dword dwResTypeId) const
+	{
+		std::vector<const ResourceLeaf*> vLeaves;
+		collectLeaves(getResourceTypeNode(resourceTypeIdToIndex(dwResTypeId)), vLeaves);
+		return vLeaves;
+	}
+
+	/**
+	* Returns the leaves of all resources of a specific resource type in all languages, in the
+	* order of the resource tree.
+	* @param strResTypeName Identifies the resource type.
+	* @return Leaves of the resources, empty if there is no such resource type.
+	**/
+	std::vector<const ResourceLeaf*> ResourceDirectory::getResourceLeaves(const std::string& strResTypeName) const
+	{
+		std::vector<const ResourceLeaf*> vLeaves;
+		collectLeaves(getResourceTypeNode(resourceTypeNameToIndex(strResTypeName)), vLeaves);
+		return vLeaves;
 	}
 
 	/**
@@ -1640,7 +2339,7 @@ namespace PeLib
 		ResourceNode* currNode = static_cast<ResourceNode*>(m_rnRoot.children[uiResTypeIndex].child);
 		currNode = static_cast<ResourceNode*>(currNode->children[uiResIndex].child);
 		ResourceLeaf* currLeaf = static_cast<ResourceLeaf*>(currNode->children[0].child);
-		currLeaf->m_data.assign(data.begin(), data.end());
+		currLeaf->setData(data);
 	}
 
 	/**
@@ -1731,6 +2430,7 @@ namespace PeLib
 	{
 		ResourceNode* currNode = static_cast<ResourceNode*>(m_rnRoot.children[uiResTypeIndex].child);
 		currNode->children[uiResIndex].entry.irde.Name = dwNewResId;
+		invalidateIndex();
 	}
 
 	/**
@@ -1820,7 +2520,147 @@ namespace PeLib
 	void ResourceDirectory::setResourceNameByIndex(unsigned int uiResTypeIndex, unsigned int uiResIndex, const std::string& strNewResName)
 	{
 		ResourceNode* currNode = static_cast<ResourceNode*>(m_rnRoot.children[uiResTypeIndex].child);
-		currNode->children[uiResIndex].entry.wstrName = strNewResName;
+		currNode->children[uiResIndex].setName(strNewResName);
+		invalidateIndex();
+	}
+
+	/**
+	* Returns the index of the resources. The index is built on the first lookup after the
+	* directory was read or modified, lookups from several threads build it only once.
+	* @return Index of the resource types and of the resources of every type.
+	**/
+	const ResourceDirectory::ResourceIndex& ResourceDirectory::resourceIndex() const
+	{
+		std::lock_guard<std::mutex> lock(m_indexMutex.mutex);
+		if (m_index.valid)
+		{
+			return m_index;
+		}
+
+		// The lowest index wins, the linear searches used to find the first matching child
+		auto addChildren = [](const ResourceNode& node, ResourceIndex::Level& level)
+		{
+			level.node = &node;
+			level.byId.reserve(node.children.size());
+			level.byName.reserve(node.children.size());
+			for (std::size_t i = 0; i < node.children.size(); i++)
+			{
+				const ResourceChild& rc = node.children[i];
+				level.byId.emplace(rc.entry.irde.Name, static_cast<unsigned int>(i));
+				level.byName.emplace(rc.entry.wstrName, static_cast<unsigned int>(i));
+			}
+		};
+
+		addChildren(m_rnRoot, m_index.types);
+		m_index.resources.resize(m_rnRoot.children.size());
+		for (std::size_t i = 0; i < m_rnRoot.children.size(); i++)
+		{
+			const ResourceNode* typeNode = getResourceTypeNode(static_cast<int>(i));
+			if (typeNode)
+			{
+				addChildren(*typeNode, m_index.resources[i]);
+			}
+		}
+
+		m_index.valid = true;
+		return m_index;
+	}
+
+	/**
+	* Drops the index of the resources, it is built again on the next lookup. Called by the
+	* functions of the directory which add, remove, reorder or rename children in the top two
+	* levels of the tree. Changes made through the nodes themselves are caught by findChild.
+	**/
+	void ResourceDirectory::invalidateIndex()
+	{
+		std::lock_guard<std::mutex> lock(m_indexMutex.mutex);
+		m_index = ResourceIndex();
+	}
+
+	/**
+	* Looks a child of a node up in the index of its children. The tree may have been modified
+	* through the nodes since the index was built, so a position from the index is used only if
+	* the child there still has the ID, and the children are searched if it has not.
+	* @param node Node whose children are searched.
+	* @param level Index of the children of the node, nullptr if there is none.
+	* @param dwId ID of the child.
+	* @return Index of the first child with the ID, -1 if there is none.
+	**/
+	int ResourceDirectory::findChild(const ResourceNode& node, const ResourceIndex::Level* level, dword dwId)
+	{
+		if (level)
+		{
+			auto Iter = level->byId.find(dwId);
+			if (Iter != level->byId.end() && Iter->second < node.children.size() && node.children[Iter->second].entry.irde.Name == dwId)
+			{
+				return static_cast<int>(Iter->second);
+			}
+		}
+
+		auto Iter = std::find_if(node.children.begin(), node.children.end(), [dwId](const ResourceChild& rc) { return rc.entry.irde.Name == dwId; });
+		return Iter != node.children.end() ? static_cast<int>(Iter - node.children.begin()) : -1;
+	}
+
+	/**
+	* Looks a child of a node up in the index of its children, like the overload for IDs.
+	* @param node Node whose children are searched.
+	* @param level Index of the children of the node, nullptr if there is none.
+	* @param strName Name of the child.
+	* @return Index of the first child with the name, -1 if there is none.
+	**/
+	int ResourceDirectory::findChild(const ResourceNode& node, const ResourceIndex::Level* level, const std::string& strName)
+	{
+		if (level)
+		{
+			auto Iter = level->byName.find(strName);
+			if (Iter != level->byName.end() && Iter->second < node.children.size() && node.children[Iter->second].entry.wstrName == strName)
+			{
+				return static_cast<int>(Iter->second);
+			}
+		}
+
+		auto Iter = std::find_if(node.children.begin(), node.children.end(), [&strName](const ResourceChild& rc) { return rc.entry.wstrName == strName; });
+		return Iter != node.children.end() ? static_cast<int>(Iter - node.children.begin()) : -1;
+	}
+
+	const ResourceNode* ResourceDirectory::getResourceTypeNode(int iResTypeIndex) const
+	{
+		if (iResTypeIndex < 0 || static_cast<std::size_t>(iResTypeIndex) >= m_rnRoot.children.size())
+		{
+			return nullptr;
+		}
+
+		const ResourceElement* typeNode = m_rnRoot.children[iResTypeIndex].child;
+		return typeNode && !typeNode->isLeaf() ? static_cast<const ResourceNode*>(typeNode) : nullptr;
+	}
+
+	/**
+	* Appends the leaves of all resources below a resource type node, in all languages.
+	* @param typeNode Node of the resource type, nullptr for none.
+	* @param vLeaves Vector the leaves are appended to.
+	**/
+	void ResourceDirectory::collectLeaves(const ResourceNode* typeNode, std::vector<const ResourceLeaf*>& vLeaves)
+	{
+		if (!typeNode)
+		{
+			return;
+		}
+
+		for (const auto& rcRes : typeNode->children)
+		{
+			if (!rcRes.child)
+				continue;
+			else if (rcRes.child->isLeaf())
+				vLeaves.push_back(static_cast<const ResourceLeaf*>(rcRes.child));
+			else
+			{
+				for (const auto& rcLang : static_cast<const ResourceNode*>(rcRes.child)->children)
+				{
+					if (rcLang.child && rcLang.child->isLeaf())
+						vLeaves.push_back(static_cast<const ResourceLeaf*>(rcLang.child));
+				}
+			}
+		}
 	}
 
 	/**
@@ -838,14 +838,8 @@ namespace
 	void RichHeader::read(InputBuffer& inputbuffer, std::size_t uiSize, bool ignoreInvalidKey)
 	{
 		init();
-		std::vector<dword> rich;
-
-		for (std::size_t i = 0, e = uiSize / sizeof(dword); i < e; ++i)
-		{
-			dword actInput;
-			inputbuffer >> actInput;
-			rich.push_back(actInput);
-		}
+		std::vector<dword> rich(uiSize / sizeof(dword));
+		inputbuffer.readArray(rich.data(), rich.size());
 
 		dword sign[] = {0x68636952};
 		auto lastPos = rich.end();
@@ -897,11 +891,10 @@ namespace
 			return ERROR_INVALID_FILE;
 		}
 
-		inStream_w.seekg(uiOffset, std::ios::beg);
 		std::vector<unsigned char> tableDump;
-		tableDump.resize(uiSize);
-		inStream_w.read(reinterpret_cast<char*>(tableDump.data()), uiSize);
-		InputBuffer ibBuffer(tableDump);
+		std::size_t uiTableSize = uiSize;
+		const unsigned char* tableData = readStreamRange(inStream_w, uiOffset, uiTableSize, tableDump);
+		InputBuffer ibBuffer(tableData, static_cast<unsigned long>(uiTableSize));
 		read(ibBuffer, uiSize, ignoreInvalidKey);
 
 		return ERROR_NONE;
@@ -37,12 +37,11 @@ namespace PeLib
 			return ERROR_INVALID_FILE;
 		}
 
-		inStream_w.seekg(uiOffset, std::ios::beg);
+		std::vector<unsigned char> vCertDirectory;
+		std::size_t uiCertSize = uiSize;
+		const unsigned char* certData = readStreamRange(inStream_w, uiOffset, uiCertSize, vCertDirectory);
 
-		std::vector<unsigned char> vCertDirectory(uiSize);
-		inStream_w.read(reinterpret_cast<char*>(vCertDirectory.data()), uiSize);
-
-		InputBuffer inpBuffer(vCertDirectory);
+		InputBuffer inpBuffer(certData, static_cast<unsigned long>(uiCertSize));
 
 		unsigned bytesRead = 0;
 		while (bytesRead < uiSize)
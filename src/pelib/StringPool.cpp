@@ -0,0 +1,104 @@
+/**
+ * @file StringPool.cpp
+ * @brief Thread-safe pool of interned strings shared by the parsed files.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <cstring>
+
+#include "pelib/StringPool.h"
+
+namespace PeLib
+{
+	bool StringPool::Key::operator==(const Key& other) const
+	{
+		return size == other.size && std::memcmp(data, other.data, size) == 0;
+	}
+
+	/**
+	* FNV-1a hash of the string, computed once per interned string and used both
+	* to select the shard and as the hash in the shard's index.
+	**/
+	std::size_t StringPool::hashString(const char* data, std::size_t size)
+	{
+		std::uint64_t hash = 0xcbf29ce484222325ULL;
+		for (std::size_t i = 0; i < size; i++)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 0x100000001b3ULL;
+		}
+		return static_cast<std::size_t>(hash ^ (hash >> 32));
+	}
+
+	/**
+	* Takes the memory from the end of the last block, or starts a new block if it does not fit.
+	* The lock of the shard must be held.
+	* @param size Number of bytes to allocate.
+	* @return Memory which stays valid as long as the pool.
+	**/
+	char* StringPool::Shard::allocate(std::size_t size)
+	{
+		if (size > BLOCK_SIZE / 4)
+		{
+			largeBlocks.emplace_back(new char[size]);
+			return largeBlocks.back().get();
+		}
+
+		if (size > BLOCK_SIZE - used)
+		{
+			blocks.emplace_back(new char[BLOCK_SIZE]);
+			used = 0;
+		}
+
+		char* result = blocks.back().get() + used;
+		used += size;
+		return result;
+	}
+
+	/**
+	* @param data Characters of the string.
+	* @param size Number of characters.
+	* @return Pooled copy of the string, valid as long as the pool. The empty string is not stored.
+	**/
+	PooledString StringPool::intern(const char* data, std::size_t size)
+	{
+		if (size == 0)
+			return PooledString();
+
+		Key key = { data, size, hashString(data, size) };
+		Shard& shard = m_shards[key.hash % NUMBER_OF_SHARDS];
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it != shard.index.end())
+			return PooledString(it->second);
+
+		// The characters are preceded by their number and followed by a zero
+		const std::uint32_t uiSize = static_cast<std::uint32_t>(size);
+		char* memory = shard.allocate(sizeof(uiSize) + size + 1);
+		std::memcpy(memory, &uiSize, sizeof(uiSize));
+		char* pooled = memory + sizeof(uiSize);
+		std::memcpy(pooled, data, size);
+		pooled[size] = '\0';
+
+		key.data = pooled;
+		shard.index.emplace(key, pooled);
+		return PooledString(pooled);
+	}
+
+	PooledString StringPool::intern(const std::string& value)
+	{
+		return intern(value.data(), value.size());
+	}
+
+	std::size_t StringPool::size() const
+	{
+		std::size_t result = 0;
+		for (const auto& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			result += shard.index.size();
+		}
+		return result;
+	}
+}
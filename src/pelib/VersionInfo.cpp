@@ -0,0 +1,476 @@
+/**
+ * @file VersionInfo.cpp
+ * @brief Views of the version information (VS_VERSIONINFO) in the data of a resource.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+
+#include "pelib/InputBuffer.h"
+#include "pelib/VersionInfo.h"
+
+namespace PeLib
+{
+	namespace
+	{
+		const std::size_t VERSION_BLOCK_HEADER_SIZE = 3 * sizeof(word);
+
+		word readWord(const unsigned char* data)
+		{
+			return static_cast<word>(data[0] | (data[1] << 8));
+		}
+
+		char toLowerAscii(char c)
+		{
+			return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+
+		bool parseHexWord(const Utf16View& str, std::size_t uiStart, word& value)
+		{
+			value = 0;
+			for (std::size_t i = uiStart; i < uiStart + 4; i++)
+			{
+				char16_t c = str[i];
+				unsigned int uiDigit;
+				if (c >= '0' && c <= '9')
+					uiDigit = c - '0';
+				else if (c >= 'a' && c <= 'f')
+					uiDigit = c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F')
+					uiDigit = c - 'A' + 10;
+				else
+					return false;
+
+				value = static_cast<word>((value << 4) | uiDigit);
+			}
+
+			return true;
+		}
+	}
+
+// -------------------------------------------------- Utf16View -------------------------------------------
+
+	bool Utf16View::equals(const char* ascii) const
+	{
+		for (std::size_t i = 0; i < m_length; i++)
+		{
+			if (ascii[i] == '\0' || (*this)[i] != static_cast<unsigned char>(ascii[i]))
+			{
+				return false;
+			}
+		}
+
+		return ascii[m_length] == '\0';
+	}
+
+	bool Utf16View::equalsNc(const char* ascii) const
+	{
+		for (std::size_t i = 0; i < m_length; i++)
+		{
+			char16_t c = (*this)[i];
+			if (ascii[i] == '\0' || c > 0x7F || toLowerAscii(static_cast<char>(c)) != toLowerAscii(ascii[i]))
+			{
+				return false;
+			}
+		}
+
+		return ascii[m_length] == '\0';
+	}
+
+	/**
+	* Appends the string in UTF-8. The characters are converted in chunks on the stack, a chunk
+	* never ends between the two halves of a surrogate pair.
+	* @param result String the characters are appended to.
+	**/
+	void Utf16View::appendUtf8(std::string& result) const
+	{
+		const std::size_t CHUNK_LENGTH = 64;
+		char16_t chunk[CHUNK_LENGTH];
+
+		for (std::size_t i = 0; i < m_length; )
+		{
+			std::size_t uiChunkLength = std::min(CHUNK_LENGTH, m_length - i);
+			for (std::size_t j = 0; j < uiChunkLength; j++)
+			{
+				chunk[j] = (*this)[i + j];
+			}
+
+			if (uiChunkLength > 1 && i + uiChunkLength < m_length && chunk[uiChunkLength - 1] >= 0xD800 && chunk[uiChunkLength - 1] <= 0xDBFF)
+			{
+				uiChunkLength--;
+			}
+
+			utf16ToUtf8(chunk, uiChunkLength, result);
+			i += uiChunkLength;
+		}
+	}
+
+	std::string Utf16View::toUtf8() const
+	{
+		std::string result;
+		appendUtf8(result);
+		return result;
+	}
+
+// -------------------------------------------------- VersionBlock -------------------------------------------
+
+	VersionBlock::VersionBlock() :
+			m_base(nullptr), m_data(nullptr), m_end(nullptr), m_size(0), m_valueLength(0), m_type(0), m_childrenOffset(0)
+	{
+	}
+
+	/**
+	* Parses the header of a block. The block ends at its wLength or at the end of its parent,
+	* whichever comes first, and its key, value and child blocks are cut off at its end.
+	* @param base Start of the version information.
+	* @param data Start of the block.
+	* @param end End of the parent block.
+	**/
+	VersionBlock::VersionBlock(const unsigned char* base, const unsigned char* data, const unsigned char* end) :
+			m_base(base), m_data(nullptr), m_end(end), m_size(0), m_valueLength(0), m_type(0), m_childrenOffset(0)
+	{
+		if (!data || data > end || static_cast<std::size_t>(end - data) < VERSION_BLOCK_HEADER_SIZE)
+		{
+			return;
+		}
+
+		word wLength = readWord(data);
+		if (wLength < VERSION_BLOCK_HEADER_SIZE)
+		{
+			return;
+		}
+
+		m_data = data;
+		m_size = std::min<std::size_t>(wLength, end - data);
+		m_valueLength = readWord(data + 2);
+		m_type = readWord(data + 4);
+
+		// The key is terminated by a zero character
+		std::size_t uiKeyLength = 0;
+		std::size_t uiOffset = VERSION_BLOCK_HEADER_SIZE;
+		while (uiOffset + sizeof(word) <= m_size && readWord(data + uiOffset) != 0)
+		{
+			uiKeyLength++;
+			uiOffset += sizeof(word);
+		}
+
+		m_key = Utf16View(data + VERSION_BLOCK_HEADER_SIZE, uiKeyLength);
+		uiOffset = std::min(alignedOffset(uiOffset + sizeof(word)), m_size);
+
+		// Text values are measured in characters, binary ones in bytes
+		std::size_t uiValueSize = std::min<std::size_t>(m_type == 1 ? 2 * m_valueLength : m_valueLength, m_size - uiOffset);
+		m_value = ByteSpan(data + uiOffset, uiValueSize);
+		m_childrenOffset = std::min(alignedOffset(uiOffset + uiValueSize), m_size);
+	}
+
+	/**
+	* Rounds an offset in the block up to a multiple of four bytes from the start of the version information.
+	* @param offset Offset in the block.
+	* @return Aligned offset in the block.
+	**/
+	std::size_t VersionBlock::alignedOffset(std::size_t offset) const
+	{
+		std::size_t uiStart = m_data - m_base;
+		return ((uiStart + offset + 3) & ~static_cast<std::size_t>(3)) - uiStart;
+	}
+
+	bool VersionBlock::isValid() const
+	{
+		return m_data != nullptr;
+	}
+
+	ByteSpan VersionBlock::getData() const
+	{
+		return ByteSpan(m_data, m_size);
+	}
+
+	word VersionBlock::getValueLength() const
+	{
+		return m_valueLength;
+	}
+
+	word VersionBlock::getType() const
+	{
+		return m_type;
+	}
+
+	Utf16View VersionBlock::getKey() const
+	{
+		return m_key;
+	}
+
+	ByteSpan VersionBlock::getValue() const
+	{
+		return m_value;
+	}
+
+	/**
+	* Returns the value of the block as text, which ends at the first zero character.
+	* @return View of the text.
+	**/
+	Utf16View VersionBlock::getTextValue() const
+	{
+		std::size_t uiLength = 0;
+		while (2 * uiLength + 1 < m_value.size && readWord(m_value.data + 2 * uiLength) != 0)
+		{
+			uiLength++;
+		}
+
+		return Utf16View(m_value.data, uiLength);
+	}
+
+	VersionBlock VersionBlock::getFirstChild() const
+	{
+		if (!isValid() || m_childrenOffset >= m_size)
+		{
+			return VersionBlock();
+		}
+
+		return VersionBlock(m_base, m_data + m_childrenOffset, m_data + m_size);
+	}
+
+	VersionBlock VersionBlock::getNextSibling() const
+	{
+		if (!isValid())
+		{
+			return VersionBlock();
+		}
+
+		std::size_t uiNext = alignedOffset(m_size);
+		if (uiNext >= static_cast<std::size_t>(m_end - m_data))
+		{
+			return VersionBlock();
+		}
+
+		return VersionBlock(m_base, m_data + uiNext, m_end);
+	}
+
+	/**
+	* Finds a child block by its key.
+	* @param key Key of the block in ASCII.
+	* @return The first child block with the key, a view which is not valid if there is none.
+	**/
+	VersionBlock VersionBlock::findChild(const char* key) const
+	{
+		for (VersionBlock child = getFirstChild(); child.isValid(); child = child.getNextSibling())
+		{
+			if (child.getKey().equals(key))
+			{
+				return child;
+			}
+		}
+
+		return VersionBlock();
+	}
+
+// -------------------------------------------------- VersionInfo -------------------------------------------
+
+	VersionInfo::VersionInfo() : m_hasFixedFileInfo(false)
+	{
+	}
+
+	/**
+	* Parses the version information in the data of a resource. Only the location of the fixed
+	* file info and of the translations is looked up, the other blocks are parsed when they are
+	* queried.
+	* @param data Data of the resource, which must outlive the version information.
+	* @return ERROR_NONE, or ERROR_INVALID_FILE if the data do not start with a VS_VERSION_INFO block.
+	**/
+	int VersionInfo::parse(ByteSpan data)
+	{
+		m_data = data;
+		m_root = VersionBlock();
+		m_fixedFileInfo = PELIB_VS_FIXEDFILEINFO();
+		m_hasFixedFileInfo = false;
+		m_translations = ByteSpan();
+
+		VersionBlock root(data.data, data.data, data.data + data.size);
+		if (!root.isValid() || !root.getKey().equals("VS_VERSION_INFO"))
+		{
+			return ERROR_INVALID_FILE;
+		}
+
+		m_root = root;
+
+		ByteSpan value = m_root.getValue();
+		if (value.size >= PELIB_VS_FIXEDFILEINFO::size())
+		{
+			PELIB_VS_FIXEDFILEINFO fixedFileInfo;
+			InputBuffer inpBuffer(value.data, PELIB_VS_FIXEDFILEINFO::size());
+			inpBuffer >> fixedFileInfo.Signature;
+			inpBuffer >> fixedFileInfo.StrucVersion;
+			inpBuffer >> fixedFileInfo.FileVersionMS;
+			inpBuffer >> fixedFileInfo.FileVersionLS;
+			inpBuffer >> fixedFileInfo.ProductVersionMS;
+			inpBuffer >> fixedFileInfo.ProductVersionLS;
+			inpBuffer >> fixedFileInfo.FileFlagsMask;
+			inpBuffer >> fixedFileInfo.FileFlags;
+			inpBuffer >> fixedFileInfo.FileOS;
+			inpBuffer >> fixedFileInfo.FileType;
+			inpBuffer >> fixedFileInfo.FileSubtype;
+			inpBuffer >> fixedFileInfo.FileDateMS;
+			inpBuffer >> fixedFileInfo.FileDateLS;
+
+			if (fixedFileInfo.Signature == PELIB_VS_FFI_SIGNATURE)
+			{
+				m_fixedFileInfo = fixedFileInfo;
+				m_hasFixedFileInfo = true;
+			}
+		}
+
+		ByteSpan translations = getVarFileInfo().findChild("Translation").getValue();
+		m_translations = ByteSpan(translations.data, translations.size & ~static_cast<std::size_t>(3));
+
+		return ERROR_NONE;
+	}
+
+	/**
+	* Parses the version information of the first language of the first RT_VERSION resource.
+	* @param resDir Resource directory.
+	* @param vBuffer Buffer which receives the data of the resource if they are not in memory.
+	* It must outlive the version information, like the data source of the directory.
+	* @return ERROR_NONE, ERROR_ENTRY_NOT_FOUND if there is no such resource or the result of parse().
+	**/
+	int VersionInfo::read(const ResourceDirectory& resDir, std::vector<byte>& vBuffer)
+	{
+		parse(ByteSpan());
+
+		int iResTypeIndex = resDir.resourceTypeIdToIndex(PELIB_RT_VERSION);
+		if (iResTypeIndex < 0)
+		{
+			return ERROR_ENTRY_NOT_FOUND;
+		}
+
+		const ResourceElement* element = resDir.getRoot()->getChild(iResTypeIndex)->getNode();
+		while (element && !element->isLeaf())
+		{
+			const ResourceNode* node = static_cast<const ResourceNode*>(element);
+			element = node->getNumberOfChildren() ? node->getChild(0)->getNode() : nullptr;
+		}
+
+		if (!element)
+		{
+			return ERROR_ENTRY_NOT_FOUND;
+		}
+
+		return parse(static_cast<const ResourceLeaf*>(element)->getDataSpan(vBuffer));
+	}
+
+	const VersionBlock& VersionInfo::getRoot() const
+	{
+		return m_root;
+	}
+
+	bool VersionInfo::hasFixedFileInfo() const
+	{
+		return m_hasFixedFileInfo;
+	}
+
+	const PELIB_VS_FIXEDFILEINFO& VersionInfo::getFixedFileInfo() const
+	{
+		return m_fixedFileInfo;
+	}
+
+	std::size_t VersionInfo::getNumberOfTranslations() const
+	{
+		return m_translations.size / sizeof(dword);
+	}
+
+	/**
+	* Returns a translation in VarFileInfo, a language and a code page of the file.
+	* @param uiIndex Index of the translation, less than getNumberOfTranslations().
+	* @return Language and code page.
+	**/
+	VersionTranslation VersionInfo::getTranslation(std::size_t uiIndex) const
+	{
+		VersionTranslation translation;
+		translation.language = readWord(m_translations.data + uiIndex * sizeof(dword));
+		translation.codePage = readWord(m_translations.data + uiIndex * sizeof(dword) + sizeof(word));
+		return translation;
+	}
+
+	VersionBlock VersionInfo::getStringFileInfo() const
+	{
+		return m_root.findChild("StringFileInfo");
+	}
+
+	VersionBlock VersionInfo::getVarFileInfo() const
+	{
+		return m_root.findChild("VarFileInfo");
+	}
+
+	/**
+	* Finds the string table of a translation.
+	* @param translation Language and code page.
+	* @return The string table, a view which is not valid if there is none.
+	**/
+	VersionBlock VersionInfo::getStringTable(VersionTranslation translation) const
+	{
+		for (VersionBlock table = getStringFileInfo().getFirstChild(); table.isValid(); table = table.getNextSibling())
+		{
+			VersionTranslation tableTranslation;
+			if (parseTranslation(table.getKey(), tableTranslation)
+				&& tableTranslation.language == translation.language
+				&& tableTranslation.codePage == translation.codePage)
+			{
+				return table;
+			}
+		}
+
+		return VersionBlock();
+	}
+
+	/**
+	* Finds a string, e.g. "FileVersion" or "CompanyName", in the string tables.
+	* @param key Key of the string in ASCII.
+	* @param value Receives the text of the string.
+	* @return True, if a string table has the string.
+	**/
+	bool VersionInfo::getString(const char* key, Utf16View& value) const
+	{
+		for (VersionBlock table = getStringFileInfo().getFirstChild(); table.isValid(); table = table.getNextSibling())
+		{
+			VersionBlock str = table.findChild(key);
+			if (str.isValid())
+			{
+				value = str.getTextValue();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	* Finds a string in the string table of a translation.
+	* @param translation Language and code page of the string table.
+	* @param key Key of the string in ASCII.
+	* @param value Receives the text of the string.
+	* @return True, if the string table exists and has the string.
+	**/
+	bool VersionInfo::getString(VersionTranslation translation, const char* key, Utf16View& value) const
+	{
+		VersionBlock str = getStringTable(translation).findChild(key);
+		if (!str.isValid())
+		{
+			return false;
+		}
+
+		value = str.getTextValue();
+		return true;
+	}
+
+	/**
+	* Reads the language and the code page from the key of a string table, which consists
+	* of eight hexadecimal digits.
+	* @param key Key of a string table.
+	* @param translation Receives the language and the code page.
+	* @return True, if the key is valid.
+	**/
+	bool VersionInfo::parseTranslation(const Utf16View& key, VersionTranslation& translation)
+	{
+		return key.length() == 8
+			&& parseHexWord(key, 0, translation.language)
+			&& parseHexWord(key, 4, translation.codePage);
+	}
+}
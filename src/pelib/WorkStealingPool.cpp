@@ -0,0 +1,157 @@
+/**
+ * @file WorkStealingPool.cpp
+ * @brief Thread pool with per-thread task queues and work stealing.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+
+#include "pelib/WorkStealingPool.h"
+
+namespace PeLib
+{
+	namespace
+	{
+		/// Pool which owns the current thread, if any.
+		thread_local const WorkStealingPool* currentPool = nullptr;
+		/// Index of the current thread in its pool.
+		thread_local std::size_t currentWorker = 0;
+	}
+
+	WorkStealingPool::WorkStealingPool(std::size_t uiThreads) :
+			m_nextWorker(0),
+			m_queuedTasks(0),
+			m_pendingTasks(0),
+			m_stop(false)
+	{
+		if (uiThreads == 0)
+			uiThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		for (std::size_t i = 0; i < uiThreads; ++i)
+			m_workers.emplace_back(new Worker);
+
+		for (std::size_t i = 0; i < uiThreads; ++i)
+			m_threads.emplace_back(&WorkStealingPool::run, this, i);
+	}
+
+	WorkStealingPool::~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wakeUp.notify_all();
+
+		for (auto& thread : m_threads)
+			thread.join();
+	}
+
+	void WorkStealingPool::execute(std::function<void()> task)
+	{
+		std::size_t uiWorker = (currentPool == this)
+				? currentWorker
+				: m_nextWorker++ % m_workers.size();
+
+		// Count the task first, so that a thread which takes it never sees the counter at zero
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_queuedTasks;
+			++m_pendingTasks;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_workers[uiWorker]->mutex);
+			m_workers[uiWorker]->tasks.push_back(std::move(task));
+		}
+
+		m_wakeUp.notify_one();
+	}
+
+	void WorkStealingPool::wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_pendingTasks == 0; });
+	}
+
+	std::size_t WorkStealingPool::size() const
+	{
+		return m_threads.size();
+	}
+
+	/**
+	* Takes the newest task of the thread's own queue or, if it is empty, the oldest task
+	* of the first other queue which has any.
+	* @param uiWorker Index of the thread.
+	* @param task Receives the task.
+	* @return True if a task was taken.
+	**/
+	bool WorkStealingPool::popTask(std::size_t uiWorker, std::function<void()>& task)
+	{
+		bool found = false;
+
+		{
+			Worker& own = *m_workers[uiWorker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				found = true;
+			}
+		}
+
+		for (std::size_t i = 1; !found && i < m_workers.size(); ++i)
+		{
+			Worker& victim = *m_workers[(uiWorker + i) % m_workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				found = true;
+			}
+		}
+
+		if (found)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_queuedTasks;
+		}
+
+		return found;
+	}
+
+	void WorkStealingPool::run(std::size_t uiWorker)
+	{
+		currentPool = this;
+		currentWorker = uiWorker;
+
+		for (;;)
+		{
+			std::function<void()> task;
+			if (popTask(uiWorker, task))
+			{
+				// An exception must not take down the thread, the task is expected to report its failure itself
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_pendingTasks == 0)
+					m_idle.notify_all();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeUp.wait(lock, [this]() { return m_stop || m_queuedTasks > 0; });
+			if (m_stop && m_queuedTasks == 0)
+				break;
+		}
+
+		currentPool = nullptr;
+	}
+}
@@ -0,0 +1,219 @@
+/**
+ * @file pelib_scan.cpp
+ * @brief Prints a summary of every PE file in a list of files and directories.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "pelib/PeScanner.h"
+
+using namespace PeLib;
+
+namespace
+{
+	void printUsage(const char* program)
+	{
+		std::cerr << "Usage: " << program << " [options] [file|directory]...\n"
+			<< "\n"
+			<< "Prints a tab separated summary of every given file and every file in the given directories.\n"
+			<< "\n"
+			<< "Options:\n"
+			<< "  -j N    Number of threads (default: number of cores).\n"
+			<< "  -l FILE Read names of the files to scan from FILE, one per line, '-' for standard input.\n"
+			<< "  -m N    Maximum number of files parsed or waiting for output at once (default: 4 per thread).\n"
+			<< "  -p      Also parse the directories of every file in parallel.\n"
+			<< "  -u      Print the files as they finish instead of in the given order.\n"
+			<< "  -h      Print this help.\n";
+	}
+
+	/**
+	 * Adds the path to the list of files, or all the files under it if it is a directory.
+	 */
+	void collectFiles(const std::string& path, std::vector<std::string>& files)
+	{
+#ifdef _WIN32
+		DWORD attributes = GetFileAttributesA(path.c_str());
+		if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			files.push_back(path);
+			return;
+		}
+
+		WIN32_FIND_DATAA findData;
+		HANDLE hFind = FindFirstFileA((path + "\\*").c_str(), &findData);
+		if (hFind == INVALID_HANDLE_VALUE)
+			return;
+
+		do
+		{
+			if (std::strcmp(findData.cFileName, ".") != 0 && std::strcmp(findData.cFileName, "..") != 0)
+				collectFiles(path + "\\" + findData.cFileName, files);
+		}
+		while (FindNextFileA(hFind, &findData));
+		FindClose(hFind);
+#else
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+		{
+			files.push_back(path);
+			return;
+		}
+
+		DIR* dir = opendir(path.c_str());
+		if (dir == nullptr)
+			return;
+
+		while (struct dirent* entry = readdir(dir))
+		{
+			if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			std::string child = path + "/" + entry->d_name;
+
+			// Do not follow links to directories, they may form cycles
+			struct stat lst;
+			if (lstat(child.c_str(), &lst) == 0 && S_ISLNK(lst.st_mode) && stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+				continue;
+
+			collectFiles(child, files);
+		}
+		closedir(dir);
+#endif
+	}
+
+	void readFileList(std::istream& list, std::vector<std::string>& files)
+	{
+		std::string line;
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (!line.empty())
+				collectFiles(line, files);
+		}
+	}
+
+	void printHeader()
+	{
+		std::cout << "file\ttype\tresult\tloader_error\tmachine\tsections\ttimestamp\tcharacteristics"
+			<< "\tentry_point\timage_base\tsize_of_image\tsubsystem\tdll_characteristics"
+			<< "\trich\tdotnet\timported_files\timported_functions\texported_functions"
+			<< "\tresource_types\tresources\trelocations\tdebug_entries\tdelay_imported_files"
+			<< "\tcertificates\tcoff_symbols\n";
+	}
+
+	void printSummary(const PeScanSummary& summary)
+	{
+		std::cout << summary.filename
+			<< '\t' << summary.fileType
+			<< '\t' << summary.result
+			<< '\t' << getLoaderErrorString(summary.loaderError)
+			<< std::hex
+			<< "\t0x" << summary.machine
+			<< std::dec
+			<< '\t' << summary.numberOfSections
+			<< '\t' << summary.timeDateStamp
+			<< std::hex
+			<< "\t0x" << summary.characteristics
+			<< "\t0x" << summary.addressOfEntryPoint
+			<< "\t0x" << summary.imageBase
+			<< "\t0x" << summary.sizeOfImage
+			<< std::dec
+			<< '\t' << summary.subsystem
+			<< std::hex
+			<< "\t0x" << summary.dllCharacteristics
+			<< std::dec
+			<< '\t' << summary.hasRichHeader
+			<< '\t' << summary.hasComHeader
+			<< '\t' << summary.importedFiles
+			<< '\t' << summary.importedFunctions
+			<< '\t' << summary.exportedFunctions
+			<< '\t' << summary.resourceTypes
+			<< '\t' << summary.resources
+			<< '\t' << summary.relocations
+			<< '\t' << summary.debugEntries
+			<< '\t' << summary.delayImportedFiles
+			<< '\t' << summary.certificates
+			<< '\t' << summary.coffSymbols
+			<< '\n';
+	}
+}
+
+int main(int argc, char** argv)
+{
+	PeScanOptions options;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if ((arg == "-j" || arg == "-m" || arg == "-l") && i + 1 >= argc)
+		{
+			std::cerr << "Missing value of " << arg << "\n";
+			return EXIT_FAILURE;
+		}
+
+		if (arg == "-h" || arg == "--help")
+		{
+			printUsage(argv[0]);
+			return EXIT_SUCCESS;
+		}
+		else if (arg == "-j")
+			options.threads = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-m")
+			options.maxFilesInFlight = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-p")
+			options.parallelDirectories = true;
+		else if (arg == "-u")
+			options.orderedOutput = false;
+		else if (arg == "-l")
+		{
+			std::string listName = argv[++i];
+			if (listName == "-")
+				readFileList(std::cin, files);
+			else
+			{
+				std::ifstream list(listName);
+				if (!list)
+				{
+					std::cerr << "Cannot open " << listName << "\n";
+					return EXIT_FAILURE;
+				}
+				readFileList(list, files);
+			}
+		}
+		else if (arg.size() > 1 && arg[0] == '-')
+		{
+			std::cerr << "Unknown option " << arg << "\n";
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		else
+			collectFiles(arg, files);
+	}
+
+	if (files.empty())
+	{
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	PeScanner scanner(options);
+	printHeader();
+	scanner.scan(files, printSummary);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,420 @@
+/**
+ * @file export_cache_test.cpp
+ * @brief Tests of ExportCache against a directory of crafted DLLs.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "pelib/ExportCache.h"
+
+using namespace PeLib;
+
+namespace
+{
+	unsigned int failures = 0;
+
+	void check(bool condition, const char* expression, int line)
+	{
+		if (!condition)
+		{
+			std::cerr << "line " << line << ": check failed: " << expression << "\n";
+			failures++;
+		}
+	}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+	/// Function exported by a crafted DLL.
+	struct Export
+	{
+		std::vector<std::string> names; ///< Names of the function in the name table, none if it is exported by ordinal only.
+		dword rva; ///< RVA of the function, used if it is not forwarded.
+		std::string forwarder; ///< "DLL.Function" or "DLL.#Ordinal" if the function is forwarded.
+	};
+
+	/// Builds the contents of a file, fields are little endian.
+	class Image
+	{
+		private:
+		  std::vector<unsigned char> m_data;
+
+		public:
+		  explicit Image(std::size_t size) : m_data(size, 0) {}
+
+		  void put16(std::size_t offset, std::uint16_t value)
+		  {
+			  m_data[offset] = value & 0xFF;
+			  m_data[offset + 1] = value >> 8;
+		  }
+
+		  void put32(std::size_t offset, std::uint32_t value)
+		  {
+			  put16(offset, value & 0xFFFF);
+			  put16(offset + 2, value >> 16);
+		  }
+
+		  void putString(std::size_t offset, const std::string& value)
+		  {
+			  std::memcpy(&m_data[offset], value.c_str(), value.size() + 1);
+		  }
+
+		  const std::vector<unsigned char>& data() const { return m_data; }
+	};
+
+	const std::uint32_t SECTION_RVA = 0x1000;
+	const std::uint32_t SECTION_OFFSET = 0x200;
+	const std::uint32_t SECTION_SIZE = 0x1000;
+
+	/**
+	* Writes a 32-bit DLL whose only section holds the export directory.
+	* @param strPath Path of the file.
+	* @param strName Name of the DLL in its export directory.
+	* @param vExports Functions, the first one has the ordinal 1.
+	* @param bSortNames Whether the name table is sorted, as it is in a valid file.
+	**/
+	void writeDll(const std::string& strPath, const std::string& strName, const std::vector<Export>& vExports, bool bSortNames = true)
+	{
+		Image image(SECTION_OFFSET + SECTION_SIZE);
+
+		// MZ header pointing to the PE header right after it
+		image.put16(0x00, 0x5A4D);
+		image.put32(0x3C, 0x40);
+
+		// PE signature and file header
+		const std::size_t peOffset = 0x40;
+		image.put32(peOffset, 0x00004550);
+		image.put16(peOffset + 4, PELIB_IMAGE_FILE_MACHINE_I386);
+		image.put16(peOffset + 6, 1);
+		image.put16(peOffset + 20, 0xE0);
+		image.put16(peOffset + 22, 0x2102);
+
+		// Optional header
+		const std::size_t ohOffset = peOffset + 24;
+		image.put16(ohOffset, PELIB_IMAGE_NT_OPTIONAL_HDR32_MAGIC);
+		image.put32(ohOffset + 28, 0x10000000);
+		image.put32(ohOffset + 32, 0x1000);
+		image.put32(ohOffset + 36, 0x200);
+		image.put16(ohOffset + 40, 4);
+		image.put16(ohOffset + 48, 4);
+		image.put32(ohOffset + 56, SECTION_RVA + SECTION_SIZE);
+		image.put32(ohOffset + 60, SECTION_OFFSET);
+		image.put16(ohOffset + 68, 2);
+		image.put32(ohOffset + 92, 16);
+
+		// Section header
+		const std::size_t shOffset = ohOffset + 0xE0;
+		image.putString(shOffset, ".edata");
+		image.put32(shOffset + 8, SECTION_SIZE);
+		image.put32(shOffset + 12, SECTION_RVA);
+		image.put32(shOffset + 16, SECTION_SIZE);
+		image.put32(shOffset + 20, SECTION_OFFSET);
+		image.put32(shOffset + 36, 0x40000040);
+
+		// Name table entries: name and index of the function
+		std::vector<std::pair<std::string, std::uint16_t>> vNames;
+		for (std::size_t i = 0; i < vExports.size(); i++)
+		{
+			for (const auto& strFuncname : vExports[i].names)
+			{
+				vNames.emplace_back(strFuncname, static_cast<std::uint16_t>(i));
+			}
+		}
+		if (bSortNames)
+		{
+			std::stable_sort(vNames.begin(), vNames.end(),
+				[](const std::pair<std::string, std::uint16_t>& a, const std::pair<std::string, std::uint16_t>& b) { return a.first < b.first; });
+		}
+
+		// Directory, then the three arrays, then the strings
+		const std::uint32_t dirRva = SECTION_RVA;
+		const std::uint32_t functionsRva = dirRva + 40;
+		const std::uint32_t namesRva = functionsRva + static_cast<std::uint32_t>(4 * vExports.size());
+		const std::uint32_t ordinalsRva = namesRva + static_cast<std::uint32_t>(4 * vNames.size());
+		std::uint32_t stringRva = ordinalsRva + static_cast<std::uint32_t>(2 * vNames.size());
+		auto toOffset = [](std::uint32_t rva) { return rva - SECTION_RVA + SECTION_OFFSET; };
+		auto addString = [&](const std::string& value)
+		{
+			std::uint32_t rva = stringRva;
+			image.putString(toOffset(rva), value);
+			stringRva += static_cast<std::uint32_t>(value.size() + 1);
+			return rva;
+		};
+
+		image.put32(toOffset(dirRva + 12), addString(strName));
+		image.put32(toOffset(dirRva + 16), 1);
+		image.put32(toOffset(dirRva + 20), static_cast<std::uint32_t>(vExports.size()));
+		image.put32(toOffset(dirRva + 24), static_cast<std::uint32_t>(vNames.size()));
+		image.put32(toOffset(dirRva + 28), functionsRva);
+		image.put32(toOffset(dirRva + 32), namesRva);
+		image.put32(toOffset(dirRva + 36), ordinalsRva);
+
+		for (std::size_t i = 0; i < vNames.size(); i++)
+		{
+			image.put32(toOffset(namesRva + static_cast<std::uint32_t>(4 * i)), addString(vNames[i].first));
+			image.put16(toOffset(ordinalsRva + static_cast<std::uint32_t>(2 * i)), vNames[i].second);
+		}
+
+		// Forwarder strings lie within the export directory, which ends after the last string
+		for (std::size_t i = 0; i < vExports.size(); i++)
+		{
+			std::uint32_t rva = vExports[i].forwarder.empty() ? vExports[i].rva : addString(vExports[i].forwarder);
+			image.put32(toOffset(functionsRva + static_cast<std::uint32_t>(4 * i)), rva);
+		}
+
+		image.put32(ohOffset + 96, dirRva);
+		image.put32(ohOffset + 100, stringRva - dirRva);
+
+		std::ofstream file(strPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(image.data().data()), image.data().size());
+	}
+
+	Export function(const std::string& strFuncname, dword rva)
+	{
+		return Export{{strFuncname}, rva, std::string()};
+	}
+
+	Export forwarded(const std::string& strFuncname, const std::string& strForwarder)
+	{
+		return Export{{strFuncname}, 0, strForwarder};
+	}
+
+	void testResolve(const std::string& strDirectory)
+	{
+		writeDll(strDirectory + "/Base.dll", "Base.dll", {function("Alpha", 0x1100), function("Beta", 0x1200)});
+
+		ExportCache cache(strDirectory);
+		ResolvedExport resolved = cache.resolve("Base.dll", "Beta");
+		CHECK(resolved.result == ERROR_NONE);
+		CHECK(resolved.rva == 0x1200);
+		CHECK(resolved.ordinal == 2);
+		CHECK(resolved.forwards == 0);
+
+		// File names are matched case-insensitively and without the extension
+		CHECK(cache.resolve("BASE", "Alpha").rva == 0x1100);
+		CHECK(cache.resolve("base.DLL", dword(2)).rva == 0x1200);
+
+		// Function names are case-sensitive
+		CHECK(cache.resolve("Base.dll", "beta").result == ERROR_ENTRY_NOT_FOUND);
+		CHECK(cache.resolve("Base.dll", dword(3)).result == ERROR_ENTRY_NOT_FOUND);
+		CHECK(cache.resolve("Missing.dll", "Alpha").result == ERROR_OPENING_FILE);
+		CHECK(cache.size() == 1);
+	}
+
+	void testAliases(const std::string& strDirectory)
+	{
+		writeDll(strDirectory + "/Alias.dll", "Alias.dll", {Export{{"Open", "OpenA", "OpenCompat"}, 0x1300, ""}, function("Close", 0x1400)});
+
+		ExportCache cache(strDirectory);
+		for (const char* szName : {"Open", "OpenA", "OpenCompat"})
+		{
+			ResolvedExport resolved = cache.resolve("Alias.dll", szName);
+			CHECK(resolved.result == ERROR_NONE);
+			CHECK(resolved.rva == 0x1300);
+			CHECK(resolved.ordinal == 1);
+		}
+
+		// Imports of the aliases are bound as well
+		ImportDirectory<32> impDir;
+		impDir.addFunction("alias.dll", "OpenCompat");
+		impDir.addFunction("alias.dll", "Close");
+		std::vector<BoundImport> vBound = cache.bind(impDir, NEWDIR);
+		CHECK(vBound.size() == 2);
+		CHECK(vBound.size() == 2 && vBound[0].target.result == ERROR_NONE && vBound[0].target.rva == 0x1300);
+		CHECK(vBound.size() == 2 && vBound[1].target.result == ERROR_NONE && vBound[1].target.rva == 0x1400);
+	}
+
+	void testHints(const std::string& strDirectory)
+	{
+		// The name table is Alpha, Beta, Dup (function 2), Dup (function 3), Gamma
+		writeDll(strDirectory + "/Hint.dll", "Hint.dll",
+			{function("Alpha", 0x1100), function("Beta", 0x1200), function("Dup", 0x1300), function("Dup", 0x1400), function("Gamma", 0x1500)});
+
+		ExportCache cache(strDirectory);
+		std::shared_ptr<const ExportTable> table = cache.getExportTable("Hint.dll");
+		CHECK(table != nullptr);
+		if (table == nullptr)
+			return;
+
+		// A hint which points at the name picks exactly that entry of the table
+		CHECK(table->getFunctionIndex("Dup", 2) == 2);
+		CHECK(table->getFunctionIndex("Dup", 3) == 3);
+		CHECK(cache.resolve("Hint.dll", "Dup", 3).rva == 0x1400);
+
+		// A hint which misses falls back to the search
+		CHECK(table->getFunctionIndex("Gamma", 0) == 4);
+		CHECK(table->getFunctionIndex("Alpha", 1000) == 0);
+		CHECK(table->getFunctionIndex("Beta", -1) == 1);
+		CHECK(table->getFunctionIndex("Delta", 1) == -1);
+
+		// An unsorted name table is searched too, the hints still index it as it is in the file
+		writeDll(strDirectory + "/Unsorted.dll", "Unsorted.dll", {function("Zulu", 0x1100), function("Alpha", 0x1200), function("Mike", 0x1300)}, false);
+		std::shared_ptr<const ExportTable> unsorted = cache.getExportTable("Unsorted.dll");
+		CHECK(unsorted != nullptr);
+		if (unsorted == nullptr)
+			return;
+
+		CHECK(unsorted->getFunctionIndex("Zulu", 0) == 0);
+		CHECK(unsorted->getFunctionIndex("Alpha", 1) == 1);
+		CHECK(unsorted->getFunctionIndex("Mike") == 2);
+		CHECK(unsorted->getFunctionIndex("Alpha", 2) == 1);
+	}
+
+	void testForwarders(const std::string& strDirectory)
+	{
+		writeDll(strDirectory + "/Front.dll", "Front.dll", {forwarded("Run", "Middle.Execute")});
+		writeDll(strDirectory + "/Middle.dll", "Middle.dll", {forwarded("Execute", "Back.#2")});
+		writeDll(strDirectory + "/Back.dll", "Back.dll", {function("Unused", 0x1100), function("Impl", 0x1200)});
+
+		ExportCache cache(strDirectory);
+		ResolvedExport resolved = cache.resolve("Front.dll", "Run");
+		CHECK(resolved.result == ERROR_NONE);
+		CHECK(resolved.dllName == "Back");
+		CHECK(resolved.rva == 0x1200);
+		CHECK(resolved.ordinal == 2);
+		CHECK(resolved.forwards == 2);
+
+		// Forwarders to a function or a DLL which does not exist
+		writeDll(strDirectory + "/Dangling.dll", "Dangling.dll", {forwarded("ToName", "Back.Missing"), forwarded("ToFile", "Nowhere.Impl")});
+		CHECK(cache.resolve("Dangling.dll", "ToName").result == ERROR_ENTRY_NOT_FOUND);
+		CHECK(cache.resolve("Dangling.dll", "ToFile").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("Dangling.dll", "ToFile").dllName == "Nowhere");
+
+		// Forwarders which lead back to themselves
+		writeDll(strDirectory + "/LoopA.dll", "LoopA.dll", {forwarded("Ping", "LoopB.Pong")});
+		writeDll(strDirectory + "/LoopB.dll", "LoopB.dll", {forwarded("Pong", "LoopA.Ping")});
+		writeDll(strDirectory + "/Self.dll", "Self.dll", {forwarded("Me", "Self.Me")});
+		CHECK(cache.resolve("LoopA.dll", "Ping").result == ERROR_FORWARDER_CYCLE);
+		CHECK(cache.resolve("Self.dll", "Me").result == ERROR_FORWARDER_CYCLE);
+	}
+
+	void testForwarderLimit(const std::string& strDirectory)
+	{
+		// Chain0.F -> Chain1.F -> ... -> Chain32.F -> Chain33.F, which is implemented by Chain33
+		const unsigned int chainLength = 33;
+		for (unsigned int i = 0; i < chainLength; i++)
+		{
+			std::string strName = "Chain" + std::to_string(i);
+			writeDll(strDirectory + "/" + strName + ".dll", strName + ".dll", {forwarded("F", "Chain" + std::to_string(i + 1) + ".F")});
+		}
+		writeDll(strDirectory + "/Chain33.dll", "Chain33.dll", {function("F", 0x1100)});
+
+		// 32 forwards are followed, one more is taken for a cycle
+		ExportCache cache(strDirectory);
+		ResolvedExport resolved = cache.resolve("Chain1.dll", "F");
+		CHECK(resolved.result == ERROR_NONE);
+		CHECK(resolved.forwards == 32);
+		CHECK(resolved.rva == 0x1100);
+
+		resolved = cache.resolve("Chain0.dll", "F");
+		CHECK(resolved.result == ERROR_FORWARDER_CYCLE);
+		CHECK(resolved.forwards == 32);
+	}
+
+	void testPathTraversal(const std::string& strDirectory)
+	{
+		// A DLL next to the directory of the cache must never be found
+		std::string strDllDirectory = strDirectory + "/dlls";
+#ifndef _WIN32
+		::mkdir(strDllDirectory.c_str(), 0700);
+#endif
+		writeDll(strDirectory + "/Outside.dll", "Outside.dll", {function("Secret", 0x1100)});
+		writeDll(strDllDirectory + "/Inside.dll", "Inside.dll",
+			{forwarded("Up", "../Outside.Secret"), forwarded("UpBack", "..\\Outside.Secret"), forwarded("Absolute", (strDirectory + "/Outside.Secret"))});
+
+		ExportCache cache(strDllDirectory);
+		CHECK(cache.resolve("../Outside.dll", "Secret").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("..\\Outside.dll", "Secret").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve(strDirectory + "/Outside.dll", "Secret").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("..", "Secret").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("Inside.dll", "Up").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("Inside.dll", "UpBack").result == ERROR_OPENING_FILE);
+		CHECK(cache.resolve("Inside.dll", "Absolute").result == ERROR_OPENING_FILE);
+		CHECK(cache.getExportTable("../Outside.dll") == nullptr);
+	}
+
+	void testChangedFiles(const std::string& strDirectory)
+	{
+		ExportCache cache(strDirectory);
+		CHECK(cache.resolve("Later.dll", "Func").result == ERROR_OPENING_FILE);
+
+		// A file added after a lookup missed it is found, a changed one is read again
+		writeDll(strDirectory + "/Later.dll", "Later.dll", {function("Func", 0x1100)});
+		CHECK(cache.resolve("later", "Func").rva == 0x1100);
+
+		// The file keeps its size, so it must get another modification time to be seen as changed
+		writeDll(strDirectory + "/Later.dll", "Later.dll", {function("Other", 0x1200), function("Func", 0x1300)});
+		struct utimbuf times;
+		times.actime = times.modtime = 1000000000;
+		::utime((strDirectory + "/Later.dll").c_str(), &times);
+		CHECK(cache.resolve("Later.dll", "Func").rva == 0x1300);
+
+		cache.clear();
+		CHECK(cache.size() == 0);
+		CHECK(cache.resolve("LATER", "Other").rva == 0x1200);
+	}
+}
+
+int main()
+{
+#ifdef _WIN32
+	// The cache lists the directory only on POSIX systems
+	return 0;
+#else
+	const char* szTemp = std::getenv("TMPDIR");
+	std::string strTemplate = std::string(szTemp ? szTemp : "/tmp") + "/pelib_export_cache_XXXXXX";
+	std::vector<char> vTemplate(strTemplate.begin(), strTemplate.end());
+	vTemplate.push_back('\0');
+	if (::mkdtemp(vTemplate.data()) == nullptr)
+	{
+		std::cerr << "cannot create a temporary directory\n";
+		return 1;
+	}
+
+	// Every test gets a directory of its own
+	std::string strDirectory = vTemplate.data();
+	unsigned int testNumber = 0;
+	auto run = [&](void (*test)(const std::string&))
+	{
+		std::string strTestDirectory = strDirectory + "/" + std::to_string(testNumber++);
+		::mkdir(strTestDirectory.c_str(), 0700);
+		test(strTestDirectory);
+	};
+
+	run(testResolve);
+	run(testAliases);
+	run(testHints);
+	run(testForwarders);
+	run(testForwarderLimit);
+	run(testPathTraversal);
+	run(testChangedFiles);
+
+	std::string strCommand = "rm -rf '" + strDirectory + "'";
+	if (std::system(strCommand.c_str()) != 0)
+	{
+		std::cerr << "cannot remove " << strDirectory << "\n";
+	}
+
+	if (failures)
+	{
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	return 0;
+#endif
+}